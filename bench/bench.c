@@ -0,0 +1,479 @@
+/***************************************************************************//**
+
+  @file         bench.c
+
+  @brief        Benchmarks for opening, editing, undoing, rendering, searching and saving
+                on generated corpora. Results are printed as JSON.
+
+  Build from the repository root (links everything except main.c):
+
+      make bench
+
+  Usage:
+
+      editor-bench [-o results.json] [-s scale] [-r runs] [-d dir] [-I]
+
+  -I builds the trigram index after each open (index_ns) and searches with it.
+
+*******************************************************************************/
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/buffer.h"
+#include "../lib/file_io.h"
+#include "../lib/edit_op.h"
+#include "../lib/input.h"
+#include "../lib/output.h"
+#include "../lib/latency.h"
+#include "../lib/event.h"
+#include "../lib/trigram.h"
+#include "../lib/undo.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define BENCH_SCREEN_ROWS 50
+#define BENCH_SCREEN_COLS 160
+#define BENCH_TYPE_KEYS 500
+#define BENCH_PASTE_LINES 20000
+#define BENCH_FRAMES 200
+#define BENCH_SEARCH_STEPS 200
+#define BENCH_NEEDLE "needle_7f3a"
+#define BENCH_MISS "zz_not_in_corpus_qq"
+#define BENCH_REGEX "needle_[0-9a-f]+|\\d{4}-\\d\\d"
+
+/**
+ * @brief One timed measurement, in nanoseconds, across all runs.
+*/
+enum benchMetric
+{
+    M_OPEN = 0,
+    M_INDEX,
+    M_TYPE,
+    M_UNDO_PASTE,
+    M_RENDER,
+    M_SEARCH_HIT,
+    M_SEARCH_BACK,
+    M_SEARCH_MISS,
+    M_SEARCH_TYPE,
+    M_SEARCH_REGEX,
+    M_SAVE,
+    M_COUNT
+};
+
+static const char *metricNames[M_COUNT] = {
+    "open_ns", "index_ns", "type_ns", "undo_paste_ns", "render_ns", "search_hit_ns", "search_back_ns", "search_miss_ns", "search_type_ns", "search_regex_ns", "save_ns"
+};
+
+/**
+ * @brief Deterministic xorshift64 generator so every run sees identical corpora.
+*/
+static uint64_t rngState;
+
+static uint64_t rng()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+static void randomWord(FILE *fp, int minLen, int maxLen)
+{
+    int len = minLen + rng() % (maxLen - minLen + 1);
+    for (int i = 0; i < len; i++) fputc('a' + rng() % 26, fp);
+}
+
+/**
+ * @brief Many short lines of random words, a needle every ~1000 lines.
+*/
+static void genShortLines(FILE *fp, int scale)
+{
+    for (long i = 0; i < 200000L * scale; i++)
+    {
+        int words = 1 + rng() % 8;
+        for (int w = 0; w < words; w++)
+        {
+            if (w) fputc(' ', fp);
+            randomWord(fp, 2, 9);
+        }
+        if (rng() % 1000 == 0) fputs(" " BENCH_NEEDLE, fp);
+        fputc('\n', fp);
+    }
+}
+
+/**
+ * @brief A handful of multi-hundred-KB lines, like minified JSON.
+*/
+static void genHugeLines(FILE *fp, int scale)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        long len = 512L * 1024 * scale;
+        long written = 0;
+        while (written < len)
+        {
+            written += fprintf(fp, "{\"k%lu\":%lu,\"s\":\"", (unsigned long)(rng() % 1000), (unsigned long)(rng() % 100000));
+            randomWord(fp, 4, 12);
+            written += 8;
+            written += fputs("\"},", fp) >= 0 ? 3 : 0;
+            if (rng() % 5000 == 0) written += fprintf(fp, "\"%s\",", BENCH_NEEDLE);
+        }
+        fputc('\n', fp);
+    }
+}
+
+/**
+ * @brief Indentation and alignment with tabs, so render and cursor math do real work.
+*/
+static void genTabHeavy(FILE *fp, int scale)
+{
+    for (long i = 0; i < 100000L * scale; i++)
+    {
+        int depth = rng() % 6;
+        for (int d = 0; d < depth; d++) fputc('\t', fp);
+        int cols = 1 + rng() % 5;
+        for (int c = 0; c < cols; c++)
+        {
+            randomWord(fp, 1, 7);
+            fputc('\t', fp);
+        }
+        if (rng() % 1000 == 0) fputs(BENCH_NEEDLE, fp);
+        fputc('\n', fp);
+    }
+}
+
+/**
+ * @brief C-like source dense in block comments, line comments, strings, numbers and keywords.
+*/
+static void genCommentHeavy(FILE *fp, int scale)
+{
+    static const char *keywords[] = {"int", "char", "return", "if", "while", "struct", "static", "unsigned"};
+
+    for (long i = 0; i < 100000L * scale; i++)
+    {
+        switch (rng() % 6)
+        {
+            case 0:
+                fputs("/* ", fp);
+                randomWord(fp, 3, 10);
+                fputs("\n * ", fp);
+                randomWord(fp, 3, 10);
+                fputs(" */\n", fp);
+                break;
+            case 1:
+                fputs("    // ", fp);
+                randomWord(fp, 5, 30);
+                fputc('\n', fp);
+                break;
+            case 2:
+                fprintf(fp, "    %s x%lu = %lu;\n", keywords[rng() % 8], (unsigned long)(rng() % 100), (unsigned long)(rng() % 100000));
+                break;
+            case 3:
+                fputs("    printf(\"", fp);
+                randomWord(fp, 3, 20);
+                fputs("\\n\");\n", fp);
+                break;
+            default:
+                fprintf(fp, "    %s (", keywords[rng() % 8]);
+                randomWord(fp, 2, 8);
+                fputs(") { return 0; }\n", fp);
+                break;
+        }
+        if (rng() % 1000 == 0) fputs("/* " BENCH_NEEDLE " */\n", fp);
+    }
+}
+
+static const struct
+{
+    const char *name;
+    const char *file; // extension matters, it selects the syntax
+    void (*gen)(FILE *fp, int scale);
+} corpora[] = {
+    {"short_lines", "short_lines.txt", genShortLines},
+    {"huge_lines", "huge_lines.json", genHugeLines},
+    {"tab_heavy", "tab_heavy.txt", genTabHeavy},
+    {"comment_heavy_c", "comment_heavy.c", genCommentHeavy},
+};
+
+static long frameBytes;
+
+/**
+ * @brief Memory sink for frames, counts bytes instead of writing to a terminal.
+*/
+static void benchSink(const char *s, int len)
+{
+    (void)s;
+    frameBytes += len;
+}
+
+/**
+ * @brief Frees all rows and puts the editor back into the state `initEditor` leaves it in.
+*/
+static void benchReset()
+{
+    for (int i = 0; i < editor.numrows; i++) editorFreeRow(&editor.row[i]);
+    free(editor.row);
+    free(editor.fileName);
+
+    editor.cx = editor.cy = editor.rx = 0;
+    editor.rowoff = editor.coloff = 0;
+    editor.numrows = 0;
+    editor.row = NULL;
+    editor.fileName = NULL;
+    editor.syntax = NULL;
+    editor.unsaved = 0;
+    editor.screenRows = BENCH_SCREEN_ROWS - 2;
+    editor.screenCols = BENCH_SCREEN_COLS;
+    editorTrigramReset();
+    editorUndoReset();
+}
+
+/**
+ * @brief A typing burst in the middle of the file: characters with a newline every 60,
+ * @brief then the same number of backspaces.
+*/
+static void benchType()
+{
+    editor.cy = editor.numrows / 2;
+    editor.cx = editor.cy < editor.numrows ? editor.row[editor.cy].size / 2 : 0;
+
+    for (int k = 0; k < BENCH_TYPE_KEYS; k++)
+    {
+        if (k % 60 == 59) editorInsertNewLine();
+        else editorInsertChar('a' + k % 26);
+    }
+    for (int k = 0; k < BENCH_TYPE_KEYS; k++) editorDelChar();
+}
+
+/**
+ * @brief Pastes `BENCH_PASTE_LINES` lines into the middle of the file as one undo step.
+*/
+static void benchPaste()
+{
+    int len = BENCH_PASTE_LINES * 32;
+    char *text = malloc(len);
+
+    for (int i = 0; i < len; i++) text[i] = (i % 32 == 31) ? '\n' : 'a' + i % 26;
+
+    editor.cy = editor.numrows / 2;
+    editor.cx = 0;
+    editorUndoBoundary();
+    editorInsertText(text, len);
+    free(text);
+}
+
+/**
+ * @brief Builds frames at evenly spaced positions through the file.
+*/
+static void benchRender()
+{
+    for (int f = 0; f < BENCH_FRAMES; f++)
+    {
+        editor.cy = editor.numrows ? (int)((long)f * editor.numrows / BENCH_FRAMES) : 0;
+        editor.cx = 0;
+        editorRefreshScreen();
+    }
+}
+
+/**
+ * @brief Types `query` into the find callback, then steps through matches with `key`.
+*/
+static void benchSearch(const char *query, int key, int steps)
+{
+    editor.cx = editor.cy = 0;
+    editorFindCallback((char *)query, query[strlen(query) - 1]);
+    editorEventWaitIdle();
+    for (int s = 0; s < steps; s++) editorFindCallback((char *)query, key);
+    editorFindCallback((char *)query, '\r');
+}
+
+/**
+ * @brief Types `query` into the find prompt one character at a time, each waiting for its matches.
+*/
+static void benchSearchTyped(const char *query)
+{
+    char typed[64];
+    int len = strlen(query);
+
+    editor.cx = editor.cy = 0;
+    for (int i = 1; i <= len; i++)
+    {
+        memcpy(typed, query, i);
+        typed[i] = '\0';
+        editorFindCallback(typed, typed[i - 1]);
+        editorEventWaitIdle();
+    }
+    editorFindCallback(typed, '\r');
+}
+
+/**
+ * @brief Switches the find prompt to regex mode on `pattern` and back.
+ * @return Nanoseconds until the regex match table was complete.
+*/
+static uint64_t benchSearchRegex(const char *pattern)
+{
+    editor.cx = editor.cy = 0;
+
+    uint64_t t = editorLatencyNow();
+    editorFindCallback((char *)pattern, CTRL_KEY('r'));
+    editorEventWaitIdle();
+    t = editorLatencyNow() - t;
+
+    editorFindCallback((char *)pattern, CTRL_KEY('r'));
+    editorFindCallback((char *)pattern, '\r');
+    return t;
+}
+
+static int cmpU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t median(uint64_t *v, int n)
+{
+    qsort(v, n, sizeof(uint64_t), cmpU64);
+    return v[n / 2];
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    int scale = 1;
+    int runs = 3;
+    const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    FILE *out = stdout;
+
+    while ((opt = getopt(argc, argv, "o:s:r:d:I")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o':
+                out = fopen(optarg, "w");
+                if (!out)
+                {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 's': scale = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+            case 'r': runs = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+            case 'd': dir = optarg; break;
+            case 'I': editorTrigramEnable(); break;
+            default:
+                fprintf(stderr, "usage: %s [-o results.json] [-s scale] [-r runs] [-d dir] [-I]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    editorSetFrameSink(benchSink);
+    benchReset();
+
+    int numcorpora = sizeof(corpora) / sizeof(corpora[0]);
+    uint64_t *samples = malloc(sizeof(uint64_t) * runs);
+
+    fprintf(out, "{\n  \"version\": \"%s\",\n  \"scale\": %d,\n  \"runs\": %d,\n  \"corpora\": [\n", VERSION, scale, runs);
+
+    for (int c = 0; c < numcorpora; c++)
+    {
+        char path[4096], savePath[4096];
+        snprintf(path, sizeof(path), "%s/editor-bench-%s", dir, corpora[c].file);
+        snprintf(savePath, sizeof(savePath), "%s/editor-bench-saved-%s", dir, corpora[c].file);
+
+        FILE *fp = fopen(path, "w");
+        if (!fp)
+        {
+            perror(path);
+            return 1;
+        }
+        rngState = 0x9e3779b97f4a7c15ull + c;
+        corpora[c].gen(fp, scale);
+        long bytes = ftell(fp);
+        fclose(fp);
+
+        uint64_t results[M_COUNT][runs];
+        int lines = 0;
+
+        for (int r = 0; r < runs; r++)
+        {
+            benchReset();
+
+            uint64_t t = editorLatencyNow();
+            editorOpen(path);
+            results[M_OPEN][r] = editorLatencyNow() - t;
+            lines = editor.numrows;
+
+            // with -I, searches below go through the trigram index once it is built
+            t = editorLatencyNow();
+            editorEventWaitIdle();
+            results[M_INDEX][r] = editorLatencyNow() - t;
+
+            t = editorLatencyNow();
+            benchType();
+            results[M_TYPE][r] = editorLatencyNow() - t;
+
+            // undoing the paste should cost as much as the paste, whatever the file size
+            benchPaste();
+            t = editorLatencyNow();
+            editorUndo();
+            results[M_UNDO_PASTE][r] = editorLatencyNow() - t;
+
+            frameBytes = 0;
+            t = editorLatencyNow();
+            benchRender();
+            results[M_RENDER][r] = editorLatencyNow() - t;
+
+            t = editorLatencyNow();
+            benchSearch(BENCH_NEEDLE, ARROW_DOWN, BENCH_SEARCH_STEPS);
+            results[M_SEARCH_HIT][r] = editorLatencyNow() - t;
+
+            t = editorLatencyNow();
+            benchSearch(BENCH_NEEDLE, ARROW_UP, BENCH_SEARCH_STEPS);
+            results[M_SEARCH_BACK][r] = editorLatencyNow() - t;
+
+            t = editorLatencyNow();
+            benchSearch(BENCH_MISS, 0, 0);
+            results[M_SEARCH_MISS][r] = editorLatencyNow() - t;
+
+            t = editorLatencyNow();
+            benchSearchTyped(BENCH_NEEDLE);
+            results[M_SEARCH_TYPE][r] = editorLatencyNow() - t;
+
+            results[M_SEARCH_REGEX][r] = benchSearchRegex(BENCH_REGEX);
+
+            free(editor.fileName);
+            editor.fileName = strdup(savePath);
+            t = editorLatencyNow();
+            editorSave();
+            editorEventWaitIdle();
+            results[M_SAVE][r] = editorLatencyNow() - t;
+        }
+
+        fprintf(out, "    {\n      \"name\": \"%s\",\n      \"bytes\": %ld,\n      \"lines\": %d,\n", corpora[c].name, bytes, lines);
+        fprintf(out, "      \"type_keys\": %d,\n      \"frames\": %d,\n      \"frame_bytes\": %ld,\n      \"search_steps\": %d,\n",
+            BENCH_TYPE_KEYS * 2, BENCH_FRAMES, frameBytes, BENCH_SEARCH_STEPS);
+
+        for (int m = 0; m < M_COUNT; m++)
+        {
+            memcpy(samples, results[m], sizeof(uint64_t) * runs);
+            fprintf(out, "      \"%s\": %llu%s\n", metricNames[m], (unsigned long long)median(samples, runs), m + 1 < M_COUNT ? "," : "");
+        }
+        fprintf(out, "    }%s\n", c + 1 < numcorpora ? "," : "");
+        fflush(out);
+
+        unlink(path);
+        unlink(savePath);
+        char *undoPath = editorUndoFile(savePath);
+        unlink(undoPath);
+        free(undoPath);
+    }
+
+    fprintf(out, "  ]\n}\n");
+
+    benchReset();
+    free(samples);
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef BUFLIST_H
+#define BUFLIST_H
+
+void editorBufferOpen(const char *fileName);
+void editorBufferPrompt();
+int editorBufferSwitch(int delta);
+int editorBufferCount();
+int editorBufferCurrent();
+int editorBufferUnsaved();
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef CLIPBOARD_H
+#define CLIPBOARD_H
+
+void editorSelectStart(int block);
+int editorSelectKey(int c);
+void editorSelectClear();
+int editorSelectSpan(int row, int *from, int *to);
+int editorSelectStatus(char *buf, int size);
+void editorClipCopy(int cut);
+void editorClipPaste(int reg);
+void editorClipPastePrompt();
+int editorClipHolds(const char *chars);
+int editorClipTake(char *chars);
+
+#endif
@@ -14,12 +14,65 @@
 #define _BSD_SOURCE
 #define _GNU_SOURCE
 
+#define INPUT_BUF_SIZE 65536
+#define ESCAPE_TIMEOUT 100
+#define EVENT_BATCH 16
+
+#define JOB_MAX_THREADS 16 // background job pool size, one worker per processor up to this
+
+#define SEARCH_MISS_LIMIT 16 // failed memchr candidates before switching to Horspool...
+#define SEARCH_MISS_SPAN 16 // ...if they came more often than one per this many bytes
+#define SEARCH_MAX_THREADS JOB_MAX_THREADS
+#define SEARCH_THREAD_BYTES (1 << 20) // buffers smaller than this are searched on the main thread
+#define SEARCH_CANCEL_ROWS 256 // rows between checks of the cancel flag
+
+#define REGEX_MAX_REPEAT 1000 // largest count in {m,n}
+#define REGEX_MAX_NODES 65536 // NFA size limit, repeats are expanded into copies
+#define REGEX_DFA_STATES 1024 // cached DFA states per matcher before a flush, a power of two
+
+#define TRIGRAM_SLICE_NS 4000000 // indexing work per event loop turn...
+#define TRIGRAM_SLICE_MS 1 // ...and the pause between turns, so keys stay responsive
+#define TRIGRAM_QUERY_LISTS 8 // posting lists intersected per query, the shortest ones
+#define TRIGRAM_PENDING_LIMIT 64 // index unused while more than numrows / this rows await indexing
+
+#define UNDO_MEMORY_LIMIT ((size_t)64 << 20) // bytes of undo history kept, oldest steps are dropped beyond it
+#define UNDO_FILE_MAGIC "EDUNDO01" // first 8 bytes of a history file...
+#define UNDO_FILE_HEADER 16 // ...followed by the hash of the saved text
+
+#define SAVE_CHUNK 65536 // bytes gathered from the snapshot per write
+#define SAVE_PROGRESS_MS 100 // status bar refresh while a save is written
+
+#define WINDOW_MIN_ROWS 2 // text rows a split must leave each window...
+#define WINDOW_MIN_COLS 8 // ...and text columns besides the line numbers
+
+#define BUFFER_CACHED 4 // buffers keeping their render and highlight caches, the shown one included
+
+#define LONG_ROW_BYTES 65536 // rows longer than this render and highlight a window...
+#define LONG_ROW_WINDOW 16384 // ...of this many bytes around the view
+
+#define PAGER_SEGMENT_BYTES (64 << 20) // file bytes indexed per job with -R, offsets within one fit 32 bits
+
+#define WATCH_EVENT_BUF 4096 // inotify events read at once
+
+#define FOLLOW_READ_BYTES (4 << 20) // appended bytes read per event loop turn in follow mode...
+#define FOLLOW_SLICE_MS 1 // ...and the pause before the next turn when more are waiting
+
+#define DIFF_COST_LIMIT 1024 // edit steps a diff searches before settling for a longer script
+
+#define CLIP_REGISTERS 10 // yanks kept, the older ones pasted by number with Ctrl-A
+
+#define LAT_SUB_BITS 5 // 32 sub-buckets per power of two, about 3% precision
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_MAGNITUDES 40 // values up to 2^40 ns
+#define LAT_BUCKETS ((LAT_MAGNITUDES + 1) * LAT_SUB)
+
 #define TAB_STOP 8
 #define LEFT_BOUND 5
 
 #define LN_OFFSET 6
 
 #define QUIT_CONFIRMATION 3
+#define STATUS_TIMEOUT 5
 
 #define HL_HIGHLIGHT_NUMBERS (1<<0)
 #define HL_HIGHLIGHT_STRINGS (1<<1)
@@ -0,0 +1,21 @@
+#ifndef CURSORS_H
+#define CURSORS_H
+
+/**
+ * @brief A cursor besides the one in `editor.cx`, `editor.cy`.
+*/
+struct editorCursor
+{
+    int cx, cy;
+};
+
+void editorCursorAddNext();
+void editorCursorAddLines();
+void editorCursorClear();
+int editorCursorCount();
+int editorCursorKey(int c);
+int editorCursorsOnRow(int row, int *first);
+struct editorCursor *editorCursorAt(int idx);
+int editorCursorStatus(char *buf, int size);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "../lib/const.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Lines `a`..`a + alen - 1` of the old text replaced by lines `b`..`b + blen - 1` of the new.
+*/
+struct diffHunk
+{
+    int a, alen;
+    int b, blen;
+};
+
+uint64_t editorDiffHash(const char *s, size_t len);
+int editorDiff(const uint64_t *a, int n, const uint64_t *b, int m, struct diffHunk **hunks);
+
+#endif
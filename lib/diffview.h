@@ -0,0 +1,21 @@
+#ifndef DIFFVIEW_H
+#define DIFFVIEW_H
+
+enum diffMark
+{
+    DIFF_MARK_NONE = 0,
+    DIFF_MARK_ADDED, // not in the file
+    DIFF_MARK_CHANGED, // in place of other lines of the file
+    DIFF_MARK_DELETED // lines of the file are missing above this row
+};
+
+void editorDiffViewToggle();
+void editorDiffViewClose();
+void editorDiffViewRefresh();
+int editorDiffViewMark(int row);
+void editorDiffViewJump(int dir);
+void editorDiffViewRowChanged(int at);
+void editorDiffViewRowsInserted(int at, int n);
+void editorDiffViewRowsDeleted(int at, int n);
+
+#endif
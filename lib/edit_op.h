@@ -1,11 +1,15 @@
 #ifndef EDIT_OP
 #define EDIT_OP
 
+#include <stddef.h>
+
 void editorInsertChar(int c);
+void editorInsertText(const char *s, int len);
+void editorInsertLines(char **lines, size_t *lens, int n);
 void editorDelChar();
 void editorInsertNewLine();
 void editorFind();
 void editorFindCallback(char *query, int key);
-void reverse_string(char* str);
+void editorReplace();
 
 #endif
\ No newline at end of file
@@ -5,6 +5,15 @@
 #include <termios.h>
 #include <time.h>
 
+/**
+ * @brief The part of a long row held in its `render` and `hl`, see `editorRenderWindow`.
+*/
+struct erowWindow
+{
+    int cstart, cend; // bytes of `chars` rendered
+    int rstart; // render column of `render[0]`
+};
+
 typedef struct erow // editor row
 {
     int idx;
@@ -14,6 +23,10 @@ typedef struct erow // editor row
     char* render;
     unsigned char *hl;
     int hl_open_comment;
+    unsigned int uid; // stable identity for the trigram index, unlike `idx`
+    unsigned int snapshot; // save whose snapshot shares `chars`, see `editorRowWritable`
+    int yanked; // a register may share `chars` as well
+    struct erowWindow *window; // NULL unless the row is over `LONG_ROW_BYTES`, `render` and `hl` then hold this window
 } erow;
 
 struct editorSyntax 
@@ -40,9 +53,11 @@ struct editorConfig
     char *fileName; 
     char statusmsg[80]; // status bar message
     time_t statusmsg_time; // timeout 
+    int statusmsg_keep; // message stays until replaced, used by prompts
     struct editorSyntax *syntax; 
     struct termios originalTermios; // terminal attributes
     int unsaved; // modified flag
+    int headless; // no terminal, input from a script and output to a virtual screen
 };
 
 extern struct editorSyntax HDLB[]; // database for syntaxing
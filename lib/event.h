@@ -0,0 +1,18 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+typedef void (*editorEventCallback)(int fd, void *arg);
+
+void editorEventInit();
+int editorEventAddFd(int fd, editorEventCallback callback, void *arg);
+void editorEventRemoveFd(int fd);
+int editorEventAddTimer(int ms, int periodic, editorEventCallback callback, void *arg);
+void editorEventArmTimer(int fd, int ms, int periodic);
+void editorEventRemoveTimer(int fd);
+void editorEventRequestRedraw();
+void editorEventBusy(int delta);
+void editorEventWaitIdle();
+void editorEventRunFor(int ms);
+int editorEventWaitInput(int timeout);
+
+#endif
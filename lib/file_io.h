@@ -3,19 +3,32 @@
 
 #include <sys/types.h>
 #include "../lib/editor.h"
+#include "../lib/diff.h"
 
 void editorOpen(char *fileName);
 void editorInsertRow(int at, char *s, size_t len);
+void editorInsertRows(int at, char **s, size_t *len, int n);
+void editorReplaceRows(const struct diffHunk *hunks, int count, char **lines, size_t *lens);
 void editorUpdateRow(erow *row);
+void editorUpdateRender(erow *row);
+void editorRenderRow(erow *row);
+void editorRenderWindow(erow *row, int rx, int width);
+int editorRowWidth(erow *row);
 int editorRowCxToRx(erow *row, int cx);
 int editorRowRxToCx(erow *row, int rx);
 void editorRowInsertChar(erow *row, int at, int c);
+void editorRowInsertString(erow *row, int at, const char *s, size_t len);
 void editorInsertChar(int c);
-char *editorRowsToString(int *buflen);
 void editorSave();
+void editorSaveWait();
+int editorSaveRunning();
+int editorSaveStatus(char *buf, int size);
+void editorRowWritable(erow *row);
+void editorRowFreeChars(erow *row);
 void editorRowDelChar(erow *row, int at);
 void editorFreeRow(erow *row);
 void editorDelRow(int at);
+void editorDelRows(int at, int n);
 void editorRowAppendString(erow *row, char *s, size_t len);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+void editorFoldToggle();
+void editorFoldOpenAll();
+int editorFoldToScreen(int row);
+int editorFoldToFile(int line);
+int editorFoldSkip(int row, int dir);
+int editorFoldLength(int row);
+void editorFoldReveal(int row);
+void editorFoldRowsInserted(int at, int n);
+void editorFoldRowsDeleted(int at, int n);
+
+struct foldNode;
+struct foldNode *editorFoldDetach();
+void editorFoldRestore(struct foldNode *t);
+void editorFoldFree(struct foldNode *t);
+
+#endif
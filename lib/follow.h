@@ -0,0 +1,10 @@
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <stddef.h>
+
+void editorFollowStart(const char *fileName);
+void editorFollowCheck();
+void editorFollowSaved(const char *fileName, size_t size);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+int editorHeadlessInit(const char *script, const char *geometry, const char *dumpPath);
+void editorHeadlessWindowSize(int *rows, int *cols);
+int editorHeadlessInput(char *buf, int size, int timeout);
+void editorHeadlessFrame(const char *s, int len);
+void editorHeadlessDump();
+
+#endif
@@ -14,12 +14,15 @@ enum editorKey
   END_KEY,
   HOME_KEY,
   PAGE_UP,
-  PAGE_DOWN
+  PAGE_DOWN,
+  PASTE_KEY
 };
 
 
 void editorProcessKeypress();
 void editorMoveCursor(int key);
+void editorGoToLine();
 char *editorPrompt(char *prompt, void (*callback)(char *, int));
+char *editorPromptAllowEmpty(char *prompt, void (*callback)(char *, int));
 
 #endif
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+/**
+ * @brief Cancellation token shared by a group of jobs. Jobs poll it with `editorJobCancelled`.
+*/
+struct editorJobToken;
+
+typedef void (*editorJobRun)(void *arg, struct editorJobToken *token);
+typedef void (*editorJobDone)(void *arg, struct editorJobToken *token);
+
+struct editorJobToken *editorJobTokenNew();
+void editorJobTokenRelease(struct editorJobToken *token);
+void editorJobCancel(struct editorJobToken *token);
+int editorJobCancelled(struct editorJobToken *token);
+void editorJobSubmit(struct editorJobToken *token, editorJobRun run, editorJobDone done, void *arg);
+void editorJobWait(struct editorJobToken *token);
+int editorJobThreads();
+
+#endif
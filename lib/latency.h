@@ -0,0 +1,40 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "../lib/const.h"
+#include <stdint.h>
+
+enum editorLatencyPhase
+{
+    LAT_EDIT = 0,
+    LAT_HIGHLIGHT,
+    LAT_BUILD,
+    LAT_WRITE,
+    LAT_TOTAL,
+    LAT_PHASES
+};
+
+struct latencyHistogram
+{
+    uint64_t counts[LAT_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+uint64_t editorLatencyNow();
+void editorLatencyKey();
+void editorLatencyBegin(int phase);
+void editorLatencyEnd(int phase);
+void editorLatencyFrame();
+void editorLatencyRecord(struct latencyHistogram *h, uint64_t ns);
+uint64_t editorLatencyPercentile(struct latencyHistogram *h, double p);
+struct latencyHistogram *editorLatencyHistogram(int phase);
+const char *editorLatencyPhaseName(int phase);
+void editorLatencyToggleOverlay();
+int editorLatencyOverlay(char *buf, int size);
+void editorLatencyDumpOnExit(const char *path);
+int editorLatencyDump(const char *path);
+
+#endif
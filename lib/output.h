@@ -6,7 +6,9 @@
 #include <stdarg.h>
 
 
+void editorSetFrameSink(void (*sink)(const char *s, int len));
 void editorRefreshScreen();
+void editorDrawWindow(struct abuf *ab, int top, int left);
 void editorDrawRows(struct abuf *ab);
 void editorCenteredText(const char *s, struct abuf *ab);
 void editorScroll();
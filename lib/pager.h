@@ -0,0 +1,12 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+int editorPagerOpen(const char *fileName);
+int editorPagerActive();
+int editorPagerLines();
+int editorPagerKey(int c);
+int editorPagerCxToRx(int line, int cx);
+int editorPagerRender(int line, int coloff, int cols, char **render, unsigned char **hl);
+int editorPagerStatus(char *buf, int size);
+
+#endif
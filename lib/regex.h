@@ -0,0 +1,22 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+/**
+ * @brief A compiled regular expression: forward and reversed NFAs, shared read-only by matchers.
+*/
+struct regex;
+
+/**
+ * @brief Per-thread matching state: lazily built DFAs over a `struct regex` and a row cursor.
+*/
+struct regexMatcher;
+
+struct regex *editorRegexCompile(const char *pat, int len, const char **error);
+void editorRegexFree(struct regex *re);
+
+struct regexMatcher *editorRegexMatcher(const struct regex *re);
+void editorRegexMatcherFree(struct regexMatcher *m);
+void editorRegexScan(struct regexMatcher *m, const char *text, int len);
+int editorRegexNext(struct regexMatcher *m, int *start, int *len);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+void editorReloadTrack(const char *fileName);
+void editorReloadUntrack(const char *fileName);
+void editorReloadCheck();
+void editorReloadSaved(const char *fileName);
+int editorReloadConfirmSave();
+
+#endif
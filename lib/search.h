@@ -0,0 +1,45 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+/**
+ * @brief A compiled literal search pattern, reusable across rows and in both directions.
+*/
+struct searchPattern
+{
+    char *pat;
+    int len;
+    int shiftFwd[256]; // Horspool shifts keyed on the last byte of the window
+    int shiftBwd[256]; // mirrored shifts keyed on the first byte of the window
+    unsigned char rare; // rarest byte of the pattern, fed to memchr/memrchr
+    int rareIdx; // its position in the pattern
+};
+
+/**
+ * @brief One match in the whole-buffer match table, in `chars` coordinates.
+*/
+struct searchMatch
+{
+    int row;
+    int col;
+    int len;
+};
+
+struct searchPattern *editorSearchCompile(const char *pat, int len);
+void editorSearchFree(struct searchPattern *p);
+int editorSearchForward(const struct searchPattern *p, const char *text, int len, int from);
+int editorSearchBackward(const struct searchPattern *p, const char *text, int len, int at);
+int editorSearchCount(const struct searchPattern *p, const char *text, int len);
+
+void editorSearchStart(const char *query, int len, int regex, void (*onDone)());
+void editorSearchWait();
+void editorSearchCancel();
+int editorSearchDone();
+int editorSearchTotal();
+const char *editorSearchQuery();
+const char *editorSearchError();
+struct searchMatch *editorSearchMatchAt(int idx);
+int editorSearchNext(int row, int col, int direction);
+int editorSearchIndexOf(int row, int col);
+int editorSearchRowMatches(int row, int *first);
+
+#endif
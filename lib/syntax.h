@@ -19,6 +19,7 @@ enum editorHighlight
 typedef struct erow erow;
 
 void editorUpdateSyntax(erow *row);
+void editorUpdateSyntaxRows(const int *rows, int n);
 int editorSyntaxToColor(int hl);
 int isSeparator(int c);
 void editorSelectSyntaxHighlight();
@@ -7,6 +7,7 @@ void disableRaw();
 void enableRaw();
 void die(const char* str);
 int editorReadKey();
+const char *editorReadPaste(int *len);
 int getWindowSize(int* rows, int* cols);
 int getCursorPosition(int* rows, int* cols);
 
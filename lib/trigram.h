@@ -0,0 +1,20 @@
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include "../lib/editor.h"
+
+void editorTrigramEnable();
+int editorTrigramEnabled();
+void editorTrigramReset();
+
+struct trigramIndex;
+struct trigramIndex *editorTrigramDetach();
+void editorTrigramRestore(struct trigramIndex *t);
+void editorTrigramFree(struct trigramIndex *t);
+void editorTrigramRowAdded(erow *row);
+void editorTrigramRowChanged(erow *row);
+void editorTrigramRowRemoved(erow *row);
+int editorTrigramCandidates(const char *query, int len, int **rows);
+int editorTrigramStatus(char *buf, int size);
+
+#endif
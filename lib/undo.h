@@ -0,0 +1,49 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include "../lib/const.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Hash of a file text fed in pieces, as it is written.
+*/
+struct undoHashState
+{
+    uint64_t h[4];
+    unsigned char carry[32]; // bytes short of a whole block
+    size_t carried;
+};
+
+void editorUndoSetLimit(size_t bytes);
+void editorUndoReset();
+void editorUndoAttach(const char *fileName);
+
+struct undoHistory;
+struct undoHistory *editorUndoDetach();
+void editorUndoRestore(struct undoHistory *h);
+void editorUndoFree(struct undoHistory *h);
+char *editorUndoFile(const char *fileName);
+void editorUndoSuspend();
+void editorUndoResume();
+void editorUndoBoundary();
+void editorUndoSeparate();
+
+struct undoDiskWrite;
+struct undoDiskWrite *editorUndoBeforeSave();
+void editorUndoSaveWrite(struct undoDiskWrite *w, uint64_t hash);
+void editorUndoSaveFailed(struct undoDiskWrite *w);
+void editorUndoSaved(struct undoDiskWrite *w);
+
+void editorUndoReloaded();
+void editorUndoHashInit(struct undoHashState *s, size_t len);
+void editorUndoHashUpdate(struct undoHashState *s, const void *buf, size_t len);
+uint64_t editorUndoHashFinal(struct undoHashState *s);
+void editorUndoChange(int row, int col, const char *old, int oldLen, const char *text, int len);
+void editorUndoRowsInserted(int at, int n);
+void editorUndoRowsDeleted(int at, int n);
+void editorUndoLinesInserted(int at, char **lines, size_t *lens, int n);
+int editorUndo();
+int editorRedo();
+
+#endif
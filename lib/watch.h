@@ -0,0 +1,9 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+typedef void (*editorWatchCallback)(const char *path, void *arg);
+
+int editorWatchAdd(const char *path, editorWatchCallback changed, void *arg);
+void editorWatchRemove(int id);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include "../lib/buffer.h"
+
+void editorWindowResize(int rows, int cols);
+void editorWindowCommand(int key);
+int editorWindowCount();
+void editorWindowOrigin(int *top, int *left);
+int editorWindowScreenCols();
+void editorWindowDraw(struct abuf *ab);
+void editorWindowRowsInserted(int at, int n);
+void editorWindowRowsDeleted(int at, int n);
+
+#endif
@@ -19,19 +19,105 @@
 #include "lib/terminal.h"
 #include "lib/file_io.h"
 #include "lib/syntax.h"
+#include "lib/event.h"
+#include "lib/latency.h"
+#include "lib/headless.h"
+#include "lib/trigram.h"
+#include "lib/undo.h"
+#include "lib/buflist.h"
+#include "lib/pager.h"
+#include "lib/follow.h"
+#include "lib/reload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
  
 int main(int argc, char *argv[])
 {
-	enableRaw();
-	initEditor();
+    int opt;
+    char *script = NULL;
+    char *geometry = NULL;
+    char *dumpPath = NULL;
+    int pager = 0;
+    int follow = 0;
+
+    // -L <file>: dump input-to-screen latency histograms to <file> on exit
+    // -H <script>: headless, keys come from <script> instead of the terminal
+    // -g <cols>x<rows>: headless screen size
+    // -D <file>: headless frame dumps
+    // -I: keep a trigram index of the buffer for fast repeated searches
+    // -U <MiB>: memory kept for undo history
+    // -R: read-only pager on a mapped file, for logs too big to edit
+    // -f: follow the file, appending what is written to it
+    while ((opt = getopt(argc, argv, "L:H:g:D:IU:Rf")) != -1)
+    {
+        switch (opt)
+        {
+            case 'L':
+                editorLatencyDumpOnExit(optarg);
+                break;
+            case 'H':
+                script = optarg;
+                break;
+            case 'g':
+                geometry = optarg;
+                break;
+            case 'D':
+                dumpPath = optarg;
+                break;
+            case 'I':
+                editorTrigramEnable();
+                break;
+            case 'U':
+                editorUndoSetLimit((size_t)atoi(optarg) << 20);
+                break;
+            case 'R':
+                pager = 1;
+                break;
+            case 'f':
+                follow = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-L latency] [-I] [-U MiB] [-R | -f] [-H script [-g COLSxROWS] [-D dump]] [file ...]\n", argv[0]);
+                exit(1);
+        }
+    }
 
-  if (argc >= 2)
+	editorEventInit();
+
+    if (script)
+    {
+        if (editorHeadlessInit(script, geometry, dumpPath) == -1)
+        {
+            perror("headless");
+            exit(1);
+        }
+    }
+    else
     {
-      editorOpen(argv[1]);
+	    enableRaw();
+    }
+
+	initEditor();
 
+  if (optind < argc && pager)
+    {
+      if (editorPagerOpen(argv[optind]) == -1) die("open");
     }
+  else if (optind < argc)
+    {
+      editorOpen(argv[optind]);
+      if (follow) editorFollowStart(argv[optind]);
+      else editorReloadTrack(argv[optind]);
+    }
+
+    // the rest are read in the background, Ctrl-N/Ctrl-P switch to them
+    for (int i = optind + 1; i < argc && !pager; i++) editorBufferOpen(argv[i]);
 
-    editorSetStatusMessage("HELP: Ctrl-Q to quit | Ctrl-S to save | Ctrl-F to find"); 
+    if (pager)
+        editorSetStatusMessage("HELP: Ctrl-Q to quit | Ctrl-F to find, n/N for the next/previous | Ctrl-G to go to line");
+    else
+        editorSetStatusMessage("HELP: Ctrl-Q to quit | Ctrl-S to save | Ctrl-F to find"); 
 
     while (1)
     {
@@ -0,0 +1,427 @@
+#include "../lib/buflist.h"
+#include "../lib/const.h"
+#include "../lib/diffview.h"
+#include "../lib/editor.h"
+#include "../lib/event.h"
+#include "../lib/file_io.h"
+#include "../lib/fold.h"
+#include "../lib/follow.h"
+#include "../lib/input.h"
+#include "../lib/jobs.h"
+#include "../lib/output.h"
+#include "../lib/reload.h"
+#include "../lib/search.h"
+#include "../lib/syntax.h"
+#include "../lib/trigram.h"
+#include "../lib/undo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+/*
+ * The shown buffer lives in `editor`, as it always has, so the rest of the editor keeps working
+ * on `editor.row` and friends. Switching parks those fields in the buffer's entry here, along
+ * with its undo history, trigram index and folds, and moves the next buffer's fields in.
+*/
+
+/**
+ * @brief One open file. While shown, its fields are only current in `editor`.
+*/
+struct editorBuffer
+{
+    int cx, cy, rx;
+    int rowoff, coloff;
+    int numrows;
+    erow *row;
+    char *fileName;
+    struct editorSyntax *syntax;
+    int unsaved;
+
+    struct undoHistory *undo; // set aside while not shown
+    struct trigramIndex *index;
+    struct foldNode *folds;
+    int shown; // has been shown before, so `undo` and `index` are valid
+    int cached; // rows have `render` and `hl`
+    unsigned long lastUsed;
+
+    // read by a job after `editorBufferOpen`
+    int loading; // job submitted and not done yet
+    int rowcap;
+    int error;
+};
+
+static struct
+{
+    struct editorBuffer **list;
+    int count;
+    int current;
+    unsigned long clock;
+} buffers;
+
+/**
+ * @brief Creates the list on first use, with the buffer already in `editor` as its only entry.
+*/
+static void bufferInit()
+{
+    if (buffers.count) return;
+
+    struct editorBuffer *b = calloc(1, sizeof(struct editorBuffer));
+    b->shown = 1;
+    b->cached = 1;
+
+    buffers.list = malloc(sizeof(struct editorBuffer *));
+    buffers.list[0] = b;
+    buffers.count = 1;
+    buffers.current = 0;
+}
+
+/**
+ * @brief Appends a line to a buffer being loaded, rendered but not highlighted.
+*/
+static void bufferAppendRow(struct editorBuffer *b, const char *s, size_t len)
+{
+    if (b->numrows == b->rowcap)
+    {
+        b->rowcap = b->rowcap ? b->rowcap * 2 : 1024;
+        b->row = realloc(b->row, sizeof(erow) * b->rowcap);
+    }
+
+    erow *row = &b->row[b->numrows];
+    memset(row, 0, sizeof(erow));
+    row->idx = b->numrows++;
+    row->size = len;
+    row->chars = malloc(len + 1);
+    memcpy(row->chars, s, len);
+    row->chars[len] = '\0';
+
+    // rendering only depends on the row itself, unlike highlighting
+    editorRenderRow(row);
+}
+
+/**
+ * @brief Loader job: reads the whole file into the buffer's rows. A missing file gives an
+ * @brief empty buffer that saving will create.
+*/
+static void bufferLoad(void *arg, struct editorJobToken *token)
+{
+    (void)token;
+    struct editorBuffer *b = arg;
+
+    FILE *fp = fopen(b->fileName, "r");
+    if (!fp)
+    {
+        if (errno != ENOENT) b->error = errno;
+    }
+    else
+    {
+        char *line = NULL;
+        ssize_t linelen;
+        size_t linecap = 0;
+
+        while ((linelen = getline(&line, &linecap, fp)) != -1)
+        {
+            while (linelen > 0 && (line[linelen-1] == '\n' || line[linelen-1] == '\r'))
+                linelen--;
+
+            bufferAppendRow(b, line, linelen);
+        }
+        if (ferror(fp)) b->error = EIO;
+        free(line);
+        fclose(fp);
+    }
+}
+
+static void bufferFreeRows(erow *row, int numrows)
+{
+    for (int i = 0; i < numrows; i++) editorFreeRow(&row[i]);
+    free(row);
+}
+
+/**
+ * @brief Removes a buffer that is not shown from the list and frees it, its file is no longer
+ * @brief watched.
+*/
+static void bufferRemove(int i)
+{
+    struct editorBuffer *b = buffers.list[i];
+
+    editorReloadUntrack(b->fileName);
+    bufferFreeRows(b->row, b->numrows);
+    free(b->fileName);
+    editorUndoFree(b->undo);
+    editorTrigramFree(b->index);
+    editorFoldFree(b->folds);
+    free(b);
+
+    memmove(&buffers.list[i], &buffers.list[i + 1], sizeof(struct editorBuffer *) * (buffers.count - i - 1));
+    buffers.count--;
+    if (buffers.current > i) buffers.current--;
+}
+
+/**
+ * @brief Moves the shown buffer out of `editor` into its entry.
+*/
+static void bufferPark(struct editorBuffer *b)
+{
+    // matches point at rows that are about to go away, and a save still reads them
+    editorSearchCancel();
+    editorSaveWait();
+
+    // the diff view follows the rows of one buffer only
+    editorDiffViewClose();
+
+    b->cx = editor.cx;
+    b->cy = editor.cy;
+    b->rx = editor.rx;
+    b->rowoff = editor.rowoff;
+    b->coloff = editor.coloff;
+    b->numrows = editor.numrows;
+    b->row = editor.row;
+    b->fileName = editor.fileName;
+    b->syntax = editor.syntax;
+    b->unsaved = editor.unsaved;
+
+    b->undo = editorUndoDetach();
+    b->index = editorTrigramDetach();
+    b->folds = editorFoldDetach();
+    b->lastUsed = ++buffers.clock;
+}
+
+/**
+ * @brief Moves a buffer's fields into `editor`, rebuilding the caches it dropped.
+*/
+static void bufferShow(struct editorBuffer *b)
+{
+    editor.cx = b->cx;
+    editor.cy = b->cy;
+    editor.rx = b->rx;
+    editor.rowoff = b->rowoff;
+    editor.coloff = b->coloff;
+    editor.fileName = b->fileName;
+    editor.unsaved = b->unsaved;
+
+    if (!b->shown)
+    {
+        // picked before the rows go in, so they are highlighted once below
+        editor.numrows = 0;
+        editor.row = NULL;
+        editorSelectSyntaxHighlight();
+        b->syntax = editor.syntax;
+    }
+    editor.syntax = b->syntax;
+    editor.numrows = b->numrows;
+    editor.row = b->row;
+
+    if (!b->cached)
+    {
+        for (int i = 0; i < editor.numrows; i++)
+        {
+            if (editor.row[i].render == NULL) editorRenderRow(&editor.row[i]);
+        }
+
+        // rows already reached by a spilling multiline comment have their `hl` set and are skipped
+        for (int i = 0; i < editor.numrows; i++)
+        {
+            if (editor.row[i].hl == NULL) editorUpdateSyntax(&editor.row[i]);
+        }
+        b->cached = 1;
+    }
+
+    if (b->shown)
+    {
+        editorUndoRestore(b->undo);
+        editorTrigramRestore(b->index);
+        editorFoldRestore(b->folds);
+    }
+    else
+    {
+        editorUndoRestore(NULL);
+        editorUndoAttach(editor.fileName);
+        editorTrigramRestore(NULL);
+        editorFoldRestore(NULL);
+        b->shown = 1;
+    }
+    b->undo = NULL;
+    b->index = NULL;
+    b->folds = NULL;
+}
+
+/**
+ * @brief Frees `render` and `hl` of the least recently shown buffers beyond `BUFFER_CACHED`.
+ * @brief Both are rebuilt from `chars` when the buffer is shown again.
+*/
+static void bufferDropCaches()
+{
+    for (;;)
+    {
+        int cached = 0, oldest = -1;
+
+        for (int i = 0; i < buffers.count; i++)
+        {
+            struct editorBuffer *b = buffers.list[i];
+            if (!b->cached) continue;
+
+            cached++;
+            if (i != buffers.current && (oldest == -1 || b->lastUsed < buffers.list[oldest]->lastUsed))
+                oldest = i;
+        }
+        if (cached <= BUFFER_CACHED || oldest == -1) return;
+
+        struct editorBuffer *b = buffers.list[oldest];
+        for (int i = 0; i < b->numrows; i++)
+        {
+            free(b->row[i].render);
+            free(b->row[i].hl);
+            b->row[i].render = NULL;
+            b->row[i].hl = NULL;
+            b->row[i].rsize = 0;
+        }
+        b->cached = 0;
+    }
+}
+
+/**
+ * @brief Swaps the buffer at `target` into `editor`.
+*/
+static void bufferActivate(int target)
+{
+    bufferPark(buffers.list[buffers.current]);
+    buffers.current = target;
+    bufferShow(buffers.list[target]);
+    bufferDropCaches();
+
+    // a followed file may have grown while another buffer was shown
+    editorFollowCheck();
+
+    editorSetStatusMessage("[%d/%d] %.20s", target + 1, buffers.count,
+        editor.fileName ? editor.fileName : "NO FILE");
+
+    // and any other file may have been changed elsewhere, which says so over the message above
+    editorReloadCheck();
+}
+
+/**
+ * @brief Runs on the main thread once a loader job is done, takes the buffer in.
+*/
+static void bufferLoaded(void *arg, struct editorJobToken *token)
+{
+    struct editorBuffer *b = arg;
+    editorJobTokenRelease(token);
+
+    int i = 0;
+    while (buffers.list[i] != b) i++;
+    b->loading = 0;
+
+    if (b->error)
+    {
+        editorSetStatusMessage("Can't open %s: %s", b->fileName, strerror(b->error));
+        bufferRemove(i);
+    }
+    else
+    {
+        editorSetStatusMessage("Opened %.20s (%d lines) [%d/%d] - Ctrl-N/Ctrl-P to switch",
+            b->fileName, b->numrows, i + 1, buffers.count);
+    }
+
+    editorEventRequestRedraw();
+}
+
+/**
+ * @brief Opens `fileName` in a new buffer without showing it. The file is read on a thread
+ * @brief while editing carries on, a file already open is switched to instead.
+*/
+void editorBufferOpen(const char *fileName)
+{
+    bufferInit();
+
+    for (int i = 0; i < buffers.count; i++)
+    {
+        const char *name = (i == buffers.current) ? editor.fileName : buffers.list[i]->fileName;
+        if (name == NULL || strcmp(name, fileName) != 0) continue;
+
+        if (buffers.list[i]->loading) editorSetStatusMessage("Still opening %.20s...", fileName);
+        else if (i != buffers.current) bufferActivate(i);
+        return;
+    }
+
+    struct editorBuffer *b = calloc(1, sizeof(struct editorBuffer));
+    b->fileName = strdup(fileName);
+    b->loading = 1;
+
+    buffers.list = realloc(buffers.list, sizeof(struct editorBuffer *) * (buffers.count + 1));
+    buffers.list[buffers.count++] = b;
+    editorReloadTrack(fileName);
+
+    // the token only lives as long as the job, loads are not cancelled
+    editorJobSubmit(editorJobTokenNew(), bufferLoad, bufferLoaded, b);
+}
+
+/**
+ * @brief Asks for a file name and opens it with `editorBufferOpen`.
+*/
+void editorBufferPrompt()
+{
+    char *fileName = editorPrompt("Open: %s (Ctrl-X to cancel)", NULL);
+    if (fileName == NULL) return;
+
+    editorBufferOpen(fileName);
+    free(fileName);
+}
+
+/**
+ * @brief Shows the buffer `delta` places after the current one in the list, wrapping around and
+ * @brief skipping buffers still being read.
+ * @return 1 if another buffer is shown, 0 if there is none.
+*/
+int editorBufferSwitch(int delta)
+{
+    bufferInit();
+
+    int step = (delta < 0) ? -1 : 1;
+    int target = buffers.current;
+    int moved = 0;
+
+    while (moved < abs(delta))
+    {
+        target = (target + step + buffers.count) % buffers.count;
+        if (target == buffers.current) break;
+        if (!buffers.list[target]->loading) moved++;
+    }
+
+    if (target == buffers.current || buffers.list[target]->loading)
+    {
+        editorSetStatusMessage(buffers.count > 1 ? "Other buffers are still opening." : "No other buffer.");
+        return 0;
+    }
+
+    bufferActivate(target);
+    return 1;
+}
+
+int editorBufferCount()
+{
+    return buffers.count ? buffers.count : 1;
+}
+
+/**
+ * @return Index of the shown buffer, from 0.
+*/
+int editorBufferCurrent()
+{
+    return buffers.current;
+}
+
+/**
+ * @return Number of buffers with unsaved changes, the shown one included.
+*/
+int editorBufferUnsaved()
+{
+    int n = editor.unsaved ? 1 : 0;
+
+    for (int i = 0; i < buffers.count; i++)
+    {
+        if (i != buffers.current && buffers.list[i]->unsaved) n++;
+    }
+    return n;
+}
@@ -0,0 +1,572 @@
+#include "../lib/clipboard.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/edit_op.h"
+#include "../lib/file_io.h"
+#include "../lib/input.h"
+#include "../lib/output.h"
+#include "../lib/syntax.h"
+#include "../lib/undo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Yanking does not copy text: a register holds slices of the rows' `chars`, and the blocks they
+ * point into are pinned in a table counting the slices using them. A row whose `chars` may be
+ * pinned is marked `yanked`, so it takes a copy before its first change, see `editorRowWritable`,
+ * and `chars` it drops meanwhile are left to the registers, which free them with their last slice.
+*/
+
+struct clipSlice
+{
+    char *block; // pinned `chars` of the row it was yanked from
+    int from, len;
+};
+
+struct clipRegister
+{
+    struct clipSlice *lines;
+    int numlines;
+    int block; // rectangular: each line goes to the next row, at the same column
+};
+
+struct clipPin
+{
+    char *block; // NULL for a free slot
+    int refs;
+    int orphan; // no row uses `block` any more, the last slice frees it
+};
+
+enum selectMode
+{
+    SELECT_NONE = 0,
+    SELECT_LINEAR,
+    SELECT_BLOCK
+};
+
+static struct
+{
+    struct clipRegister regs[CLIP_REGISTERS]; // newest first
+
+    struct clipPin *pins; // open addressing with linear probing, `pincap` a power of two
+    int numpins, pincap;
+
+    enum selectMode mode;
+    int mx, my; // the mark, the other end of the selection being the cursor
+} clip;
+
+static size_t clipSlot(const char *block)
+{
+    uint64_t h = (uintptr_t)block * 0x9E3779B97F4A7C15ull;
+    return (h >> 32) & (clip.pincap - 1);
+}
+
+static struct clipPin *clipFind(const char *block)
+{
+    if (clip.numpins == 0) return NULL;
+
+    for (size_t i = clipSlot(block);; i = (i + 1) & (clip.pincap - 1))
+    {
+        if (clip.pins[i].block == NULL) return NULL;
+        if (clip.pins[i].block == block) return &clip.pins[i];
+    }
+}
+
+/**
+ * @brief Finds the slot of `block`, or the free one it would take.
+*/
+static struct clipPin *clipSlotOf(const char *block)
+{
+    size_t i = clipSlot(block);
+    while (clip.pins[i].block && clip.pins[i].block != block) i = (i + 1) & (clip.pincap - 1);
+    return &clip.pins[i];
+}
+
+static void clipPin(char *block)
+{
+    if ((clip.numpins + 1) * 2 > clip.pincap)
+    {
+        struct clipPin *old = clip.pins;
+        int oldcap = clip.pincap;
+
+        clip.pincap = oldcap ? oldcap * 2 : 1024;
+        clip.pins = calloc(clip.pincap, sizeof(struct clipPin));
+        for (int i = 0; i < oldcap; i++)
+        {
+            if (old[i].block) *clipSlotOf(old[i].block) = old[i];
+        }
+        free(old);
+    }
+
+    struct clipPin *p = clipSlotOf(block);
+    if (p->block == NULL)
+    {
+        *p = (struct clipPin){ block, 0, 0 };
+        clip.numpins++;
+    }
+    p->refs++;
+}
+
+static void clipUnpin(char *block)
+{
+    struct clipPin *p = clipFind(block);
+    if (--p->refs > 0) return;
+    if (p->orphan) free(block);
+
+    // backward-shift deletion: later entries of the probe sequence move into the hole
+    size_t mask = clip.pincap - 1;
+    size_t i = p - clip.pins, j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (clip.pins[j].block == NULL) break;
+
+        size_t k = clipSlot(clip.pins[j].block);
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+        {
+            clip.pins[i] = clip.pins[j];
+            i = j;
+        }
+    }
+    clip.pins[i].block = NULL;
+    clip.numpins--;
+}
+
+/**
+ * @return 1 if a register holds slices of `chars`.
+*/
+int editorClipHolds(const char *chars)
+{
+    return clipFind(chars) != NULL;
+}
+
+/**
+ * @brief Takes `chars` dropped by their row if a register still holds slices of them.
+ * @return 1 if taken, the registers then free them.
+*/
+int editorClipTake(char *chars)
+{
+    struct clipPin *p = clipFind(chars);
+    if (p == NULL) return 0;
+
+    p->orphan = 1;
+    return 1;
+}
+
+static void clipAddSlice(struct clipRegister *r, erow *row, int from, int len)
+{
+    clipPin(row->chars);
+    row->yanked = 1;
+    r->lines[r->numlines++] = (struct clipSlice){ row->chars, from, len };
+}
+
+/**
+ * @brief Makes `r` the newest register, dropping the oldest one.
+*/
+static void clipStore(struct clipRegister r)
+{
+    struct clipRegister *oldest = &clip.regs[CLIP_REGISTERS - 1];
+    for (int i = 0; i < oldest->numlines; i++) clipUnpin(oldest->lines[i].block);
+    free(oldest->lines);
+
+    memmove(&clip.regs[1], &clip.regs[0], sizeof(struct clipRegister) * (CLIP_REGISTERS - 1));
+    clip.regs[0] = r;
+}
+
+/**
+ * @brief Sets the mark at the cursor, or drops the selection if one of the same kind is active.
+ * @param block 1 for a rectangular selection.
+*/
+void editorSelectStart(int block)
+{
+    enum selectMode mode = block ? SELECT_BLOCK : SELECT_LINEAR;
+
+    if (clip.mode == mode)
+    {
+        clip.mode = SELECT_NONE;
+        editorSetStatusMessage("Selection dropped.");
+        return;
+    }
+
+    clip.mode = mode;
+    clip.mx = editor.cx;
+    clip.my = editor.cy;
+    editorSetStatusMessage("%s mark set - move to select, Ctrl-C copy, Ctrl-X cut, Esc drop",
+        block ? "Block" : "Linear");
+}
+
+/**
+ * @brief Orders the mark and the cursor into a linear range, end excluded. A position past the
+ * @brief last row counts as the end of the last row.
+*/
+static void clipLinearRange(int *y0, int *x0, int *y1, int *x1)
+{
+    int ay = clip.my, ax = clip.mx, by = editor.cy, bx = editor.cx;
+
+    if (ay > by || (ay == by && ax > bx))
+    {
+        int t;
+        t = ay; ay = by; by = t;
+        t = ax; ax = bx; bx = t;
+    }
+    if (by >= editor.numrows)
+    {
+        by = editor.numrows - 1;
+        bx = editor.row[by].size;
+    }
+    if (ay > by)
+    {
+        ay = by;
+        ax = bx;
+    }
+
+    *y0 = ay;
+    *x0 = ax;
+    *y1 = by;
+    *x1 = bx;
+}
+
+/**
+ * @brief Rows and render columns of a rectangular selection, both columns included.
+*/
+static void clipBlockRange(int *y0, int *y1, int *rx0, int *rx1)
+{
+    int a = (clip.my < editor.numrows) ? editorRowCxToRx(&editor.row[clip.my], clip.mx) : 0;
+    int b = (editor.cy < editor.numrows) ? editorRowCxToRx(&editor.row[editor.cy], editor.cx) : 0;
+
+    *y0 = clip.my < editor.cy ? clip.my : editor.cy;
+    *y1 = clip.my < editor.cy ? editor.cy : clip.my;
+    if (*y1 >= editor.numrows) *y1 = editor.numrows - 1;
+
+    *rx0 = a < b ? a : b;
+    *rx1 = a < b ? b : a;
+}
+
+/**
+ * @brief Render columns of a row that are selected, for drawing them.
+ * @param from Set to the first selected column.
+ * @param to Set to the column after the last one.
+ * @return 1 if part of the row is selected.
+*/
+int editorSelectSpan(int row, int *from, int *to)
+{
+    if (clip.mode == SELECT_NONE || editor.numrows == 0) return 0;
+
+    if (clip.mode == SELECT_BLOCK)
+    {
+        int y0, y1, rx0, rx1;
+        clipBlockRange(&y0, &y1, &rx0, &rx1);
+        if (row < y0 || row > y1) return 0;
+
+        *from = rx0;
+        *to = rx1 + 1;
+        return 1;
+    }
+
+    int y0, x0, y1, x1;
+    clipLinearRange(&y0, &x0, &y1, &x1);
+    if (row < y0 || row > y1) return 0;
+
+    erow *r = &editor.row[row];
+    *from = (row == y0) ? editorRowCxToRx(r, x0) : 0;
+    *to = (row == y1) ? editorRowCxToRx(r, x1) : editorRowWidth(r) + 1; // the line break is selected too
+    return *from < *to;
+}
+
+/**
+ * @brief Writes the size of the selection for the status bar.
+ * @return Length written, 0 without a selection.
+*/
+int editorSelectStatus(char *buf, int size)
+{
+    if (clip.mode == SELECT_NONE || editor.numrows == 0) return 0;
+
+    if (clip.mode == SELECT_BLOCK)
+    {
+        int y0, y1, rx0, rx1;
+        clipBlockRange(&y0, &y1, &rx0, &rx1);
+        return snprintf(buf, size, "block %dx%d", y1 - y0 + 1, rx1 - rx0 + 1);
+    }
+
+    int y0, x0, y1, x1;
+    clipLinearRange(&y0, &x0, &y1, &x1);
+    return snprintf(buf, size, "sel %d lines", y1 - y0 + 1);
+}
+
+/**
+ * @brief Replaces the text of `row` with `chars`, logging the span from `col` that changed.
+*/
+static void clipRewriteRow(erow *row, char *chars, int size, int col, int oldLen, int len)
+{
+    editorUndoChange(row->idx, col, &row->chars[col], oldLen, &chars[col], len);
+    editorRowFreeChars(row);
+    row->chars = chars;
+    row->size = size;
+    editorUpdateRender(row);
+}
+
+/**
+ * @brief Yanks a linear selection, then deletes it if `cut`.
+*/
+static void clipLinear(int cut)
+{
+    int y0, x0, y1, x1;
+    clipLinearRange(&y0, &x0, &y1, &x1);
+
+    struct clipRegister r = { malloc(sizeof(struct clipSlice) * (y1 - y0 + 1)), 0, 0 };
+    for (int y = y0; y <= y1; y++)
+    {
+        erow *row = &editor.row[y];
+        int from = (y == y0) ? x0 : 0;
+        int to = (y == y1) ? x1 : row->size;
+        clipAddSlice(&r, row, from, to - from);
+    }
+    clipStore(r);
+
+    if (!cut) return;
+
+    erow *first = &editor.row[y0], *last = &editor.row[y1];
+    int tail = last->size - x1;
+
+    char *chars = malloc(x0 + tail + 1);
+    memcpy(chars, first->chars, x0);
+    memcpy(&chars[x0], &last->chars[x1], tail);
+    chars[x0 + tail] = '\0';
+
+    clipRewriteRow(first, chars, x0 + tail, x0, first->size - x0, tail);
+    editorDelRows(y0 + 1, y1 - y0);
+    editorUpdateSyntax(&editor.row[y0]);
+    editor.unsaved++;
+
+    editor.cx = x0;
+    editor.cy = y0;
+}
+
+/**
+ * @brief Yanks a rectangular selection, then deletes it if `cut`. Each affected row is rebuilt
+ * @brief once and all of them are highlighted in one pass.
+*/
+static void clipBlock(int cut)
+{
+    int y0, y1, rx0, rx1;
+    clipBlockRange(&y0, &y1, &rx0, &rx1);
+
+    struct clipRegister r = { malloc(sizeof(struct clipSlice) * (y1 - y0 + 1)), 0, 1 };
+    int *rows = malloc(sizeof(int) * (y1 - y0 + 1));
+    int numrows = 0;
+
+    for (int y = y0; y <= y1; y++)
+    {
+        erow *row = &editor.row[y];
+        int from = editorRowRxToCx(row, rx0);
+        int to = editorRowRxToCx(row, rx1 + 1);
+        clipAddSlice(&r, row, from, to - from);
+
+        if (!cut || to == from) continue;
+
+        char *chars = malloc(row->size - (to - from) + 1);
+        memcpy(chars, row->chars, from);
+        memcpy(&chars[from], &row->chars[to], row->size - to + 1);
+
+        clipRewriteRow(row, chars, row->size - (to - from), from, to - from, 0);
+        rows[numrows++] = y;
+    }
+    clipStore(r);
+
+    if (numrows)
+    {
+        editorUpdateSyntaxRows(rows, numrows);
+        editor.unsaved++;
+    }
+    free(rows);
+
+    if (cut)
+    {
+        editor.cy = y0;
+        editor.cx = editorRowRxToCx(&editor.row[y0], rx0);
+    }
+}
+
+/**
+ * @brief Copies the selection into a new register, or cuts it if `cut`, and drops the selection.
+ * @brief The register refers to the rows' text rather than copying it.
+*/
+void editorClipCopy(int cut)
+{
+    int empty = clip.mode == SELECT_NONE || editor.numrows == 0;
+    if (!empty && clip.mode == SELECT_LINEAR)
+    {
+        int y0, x0, y1, x1;
+        clipLinearRange(&y0, &x0, &y1, &x1);
+        empty = y0 == y1 && x0 == x1;
+    }
+    else if (!empty)
+    {
+        // both ends past the last row
+        empty = clip.my >= editor.numrows && editor.cy >= editor.numrows;
+    }
+
+    if (empty)
+    {
+        editorSetStatusMessage("Nothing selected - Ctrl-@ or Ctrl-B sets the mark.");
+        return;
+    }
+
+    if (clip.mode == SELECT_BLOCK) clipBlock(cut);
+    else clipLinear(cut);
+
+    clip.mode = SELECT_NONE;
+    editorSetStatusMessage("%s %d lines%s - Ctrl-V paste", cut ? "Cut" : "Copied", clip.regs[0].numlines,
+        clip.regs[0].block ? " as a block" : "");
+}
+
+/**
+ * @brief Pastes a rectangular register: each line goes into the next row at the cursor's column,
+ * @brief short rows padded with spaces and missing rows added at the end in one go.
+*/
+static void clipPasteBlock(struct clipRegister *r)
+{
+    int rx = (editor.cy < editor.numrows) ? editorRowCxToRx(&editor.row[editor.cy], editor.cx) : 0;
+
+    int missing = editor.cy + r->numlines - editor.numrows;
+    if (missing > 0)
+    {
+        char **lines = malloc(sizeof(char *) * missing);
+        size_t *lens = malloc(sizeof(size_t) * missing);
+        for (int i = 0; i < missing; i++)
+        {
+            lines[i] = "";
+            lens[i] = 0;
+        }
+        editorInsertRows(editor.numrows, lines, lens, missing);
+        free(lines);
+        free(lens);
+    }
+
+    int *rows = malloc(sizeof(int) * r->numlines);
+    int numrows = 0;
+
+    for (int i = 0; i < r->numlines; i++)
+    {
+        struct clipSlice *s = &r->lines[i];
+        erow *row = &editor.row[editor.cy + i];
+
+        int at = editorRowRxToCx(row, rx);
+        int width = editorRowWidth(row);
+        int pad = (width < rx) ? rx - width : 0;
+        int len = pad + s->len;
+        if (len == 0) continue;
+
+        char *chars = malloc(row->size + len + 1);
+        memcpy(chars, row->chars, at);
+        memset(&chars[at], ' ', pad);
+        memcpy(&chars[at + pad], &s->block[s->from], s->len);
+        memcpy(&chars[at + len], &row->chars[at], row->size - at + 1);
+
+        clipRewriteRow(row, chars, row->size + len, at, 0, len);
+        rows[numrows++] = row->idx;
+    }
+
+    editorUpdateSyntaxRows(rows, numrows);
+    free(rows);
+    editor.unsaved++;
+    editor.cx = editorRowRxToCx(&editor.row[editor.cy], rx);
+}
+
+/**
+ * @brief Pastes register `reg`, 0 being the newest, at the cursor. Lines of a linear register are
+ * @brief inserted with `editorInsertLines`, so the rows go in with one reallocation.
+*/
+void editorClipPaste(int reg)
+{
+    struct clipRegister *r = &clip.regs[reg];
+    if (r->numlines == 0)
+    {
+        editorSetStatusMessage(reg ? "Register %d is empty." : "Nothing to paste.", reg);
+        return;
+    }
+
+    clip.mode = SELECT_NONE;
+
+    if (r->block)
+    {
+        clipPasteBlock(r);
+        return;
+    }
+
+    char **lines = malloc(sizeof(char *) * r->numlines);
+    size_t *lens = malloc(sizeof(size_t) * r->numlines);
+    for (int i = 0; i < r->numlines; i++)
+    {
+        lines[i] = &r->lines[i].block[r->lines[i].from];
+        lens[i] = r->lines[i].len;
+    }
+
+    editorInsertLines(lines, lens, r->numlines);
+
+    free(lines);
+    free(lens);
+}
+
+/**
+ * @brief Asks for a register number and pastes it.
+*/
+void editorClipPastePrompt()
+{
+    char *answer = editorPrompt("Paste register: %s (0 newest - 9, Ctrl-X to cancel)", NULL);
+    if (answer == NULL) return;
+
+    int reg = atoi(answer);
+    free(answer);
+
+    if (reg < 0 || reg >= CLIP_REGISTERS)
+    {
+        editorSetStatusMessage("No register %d.", reg);
+        return;
+    }
+    editorClipPaste(reg);
+}
+
+/**
+ * @brief Drops the selection, for when the rows change under the mark.
+*/
+void editorSelectClear()
+{
+    clip.mode = SELECT_NONE;
+}
+
+/**
+ * @brief Keeps the selection through movement keys and drops it on any other key.
+ * @return 1 if the key was handled, which is only Escape while there is a selection.
+*/
+int editorSelectKey(int c)
+{
+    if (clip.mode == SELECT_NONE) return 0;
+
+    switch (c)
+    {
+        case ARROW_UP:
+        case ARROW_DOWN:
+        case ARROW_RIGHT:
+        case ARROW_LEFT:
+        case HOME_KEY:
+        case END_KEY:
+        case PAGE_UP:
+        case PAGE_DOWN:
+        case CTRL_KEY('c'):
+        case CTRL_KEY('x'):
+        case CTRL_KEY('@'):
+        case CTRL_KEY('b'):
+        case CTRL_KEY('t'):
+            return 0;
+
+        case '\x1b':
+            clip.mode = SELECT_NONE;
+            return 1;
+    }
+
+    clip.mode = SELECT_NONE;
+    return 0;
+}
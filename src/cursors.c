@@ -0,0 +1,503 @@
+#include "../lib/cursors.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/edit_op.h"
+#include "../lib/file_io.h"
+#include "../lib/input.h"
+#include "../lib/output.h"
+#include "../lib/syntax.h"
+#include "../lib/terminal.h"
+#include "../lib/undo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+/*
+ * Extra cursors are kept sorted by row, then column, apart from the primary one in `editor`. A
+ * key is applied to all of them as one batch: the cursors of a row are handled together, so each
+ * affected row is rebuilt in one allocation and rendered once, then all of them are highlighted
+ * in a single top-down pass. Keys a batch cannot apply, like Enter or undo, drop the extra
+ * cursors first and act on the primary one alone.
+*/
+
+static struct
+{
+    struct editorCursor *list; // extra cursors, sorted
+    int count, cap;
+
+    struct editorCursor *batch; // every cursor during a batch, the primary one included
+    int batchcap;
+
+    char *word; // whole word added by `editorCursorAddNext`, NULL if none
+    int wordLen;
+    int offset; // column of the cursors within it
+    struct editorCursor last; // start of the occurrence added last
+} cursors;
+
+static int cursorCompare(const void *a, const void *b)
+{
+    const struct editorCursor *x = a, *y = b;
+    if (x->cy != y->cy) return x->cy < y->cy ? -1 : 1;
+    return (x->cx > y->cx) - (x->cx < y->cx);
+}
+
+static int cursorIsWord(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static void cursorPush(int cx, int cy)
+{
+    if (cursors.count == cursors.cap)
+    {
+        cursors.cap = cursors.cap ? cursors.cap * 2 : 64;
+        cursors.list = realloc(cursors.list, sizeof(struct editorCursor) * cursors.cap);
+    }
+    cursors.list[cursors.count++] = (struct editorCursor){ cx, cy };
+}
+
+/**
+ * @brief Sorts `cursors.batch`, then moves the cursor at `primary` back into `editor` and the
+ * @brief others into the list, dropping cursors that ended up in the same place.
+*/
+static void cursorScatter(int n, struct editorCursor primary)
+{
+    qsort(cursors.batch, n, sizeof(struct editorCursor), cursorCompare);
+
+    editor.cx = primary.cx;
+    editor.cy = primary.cy;
+    cursors.count = 0;
+
+    // the cursors moved, so `editorCursorAddNext` starts over from the word under the primary one
+    free(cursors.word);
+    cursors.word = NULL;
+
+    for (int i = 0; i < n; i++)
+    {
+        struct editorCursor *c = &cursors.batch[i];
+        if (cursorCompare(c, &primary) == 0) continue;
+        if (cursors.count && cursorCompare(c, &cursors.list[cursors.count - 1]) == 0) continue;
+        cursorPush(c->cx, c->cy);
+    }
+}
+
+/**
+ * @brief Copies every cursor into `cursors.batch` in order.
+ * @param primary Set to the index of the primary cursor.
+ * @return Number of cursors.
+*/
+static int cursorGather(int *primary)
+{
+    int n = cursors.count + 1;
+    if (n > cursors.batchcap)
+    {
+        cursors.batchcap = n * 2;
+        cursors.batch = realloc(cursors.batch, sizeof(struct editorCursor) * cursors.batchcap);
+    }
+
+    struct editorCursor p = { editor.cx, editor.cy };
+    int at = 0;
+    while (at < cursors.count && cursorCompare(&cursors.list[at], &p) < 0) at++;
+
+    memcpy(cursors.batch, cursors.list, sizeof(struct editorCursor) * at);
+    cursors.batch[at] = p;
+    memcpy(&cursors.batch[at + 1], &cursors.list[at], sizeof(struct editorCursor) * (cursors.count - at));
+
+    *primary = at;
+    return n;
+}
+
+/**
+ * @brief Replaces the text of `row` with `chars`, logging the span from `col` that changed.
+*/
+static void cursorRewriteRow(erow *row, char *chars, int size, int col, int oldLen, int len)
+{
+    editorUndoChange(row->idx, col, &row->chars[col], oldLen, &chars[col], len);
+    editorRowFreeChars(row);
+    row->chars = chars;
+    row->size = size;
+    editorUpdateRender(row);
+}
+
+/**
+ * @brief Inserts `s` at every cursor, each affected row rebuilt once.
+*/
+static void cursorInsert(const char *s, int len)
+{
+    int primary;
+    int n = cursorGather(&primary);
+
+    // only the last cursor can be past the last row, typing there adds one like `editorInsertChar`
+    if (cursors.batch[n - 1].cy == editor.numrows) editorInsertRow(editor.numrows, "", 0);
+
+    int *rows = malloc(sizeof(int) * n);
+    int numrows = 0;
+
+    for (int i = 0, next; i < n; i = next)
+    {
+        erow *row = &editor.row[cursors.batch[i].cy];
+        for (next = i; next < n && cursors.batch[next].cy == row->idx; next++);
+
+        int first = cursors.batch[i].cx, last = cursors.batch[next - 1].cx;
+        char *chars = malloc(row->size + (size_t)(next - i) * len + 1);
+        int from = 0, to = 0;
+
+        for (int j = i; j < next; j++)
+        {
+            int at = cursors.batch[j].cx;
+            memcpy(&chars[to], &row->chars[from], at - from);
+            to += at - from;
+            memcpy(&chars[to], s, len);
+            to += len;
+            from = at;
+            cursors.batch[j].cx = to;
+        }
+        memcpy(&chars[to], &row->chars[from], row->size - from);
+        to += row->size - from;
+        chars[to] = '\0';
+
+        cursorRewriteRow(row, chars, to, first, last - first, last - first + (next - i) * len);
+        rows[numrows++] = row->idx;
+    }
+
+    editorUpdateSyntaxRows(rows, numrows);
+    free(rows);
+    editor.unsaved++;
+
+    cursorScatter(n, cursors.batch[primary]);
+}
+
+/**
+ * @brief Deletes the byte before every cursor, or under it for `DEL_KEY`. Rows are not joined:
+ * @brief a cursor at the start of its row, or at the end for `DEL_KEY`, deletes nothing.
+*/
+static void cursorDelete(int backspace)
+{
+    int primary;
+    int n = cursorGather(&primary);
+
+    int *rows = malloc(sizeof(int) * n);
+    int numrows = 0;
+
+    for (int i = 0, next; i < n; i = next)
+    {
+        int cy = cursors.batch[i].cy;
+        for (next = i; next < n && cursors.batch[next].cy == cy; next++);
+        if (cy >= editor.numrows) continue;
+
+        erow *row = &editor.row[cy];
+        char *chars = malloc(row->size + 1);
+        int from = 0, to = 0, first = -1, last = 0, deleted = 0;
+
+        for (int j = i; j < next; j++)
+        {
+            int cx = cursors.batch[j].cx;
+            int at = cx - backspace;
+
+            if (at < 0 || at >= row->size)
+            {
+                memcpy(&chars[to], &row->chars[from], cx - from);
+                to += cx - from;
+                from = cx;
+            }
+            else
+            {
+                if (first == -1) first = at;
+                memcpy(&chars[to], &row->chars[from], at - from);
+                to += at - from;
+                from = last = at + 1;
+                deleted++;
+            }
+            cursors.batch[j].cx = to;
+        }
+
+        if (deleted == 0)
+        {
+            free(chars);
+            continue;
+        }
+
+        memcpy(&chars[to], &row->chars[from], row->size - from);
+        to += row->size - from;
+        chars[to] = '\0';
+
+        cursorRewriteRow(row, chars, to, first, last - first, last - first - deleted);
+        rows[numrows++] = cy;
+    }
+
+    editorUpdateSyntaxRows(rows, numrows);
+    free(rows);
+    if (numrows) editor.unsaved++;
+
+    cursorScatter(n, cursors.batch[primary]);
+}
+
+/**
+ * @brief Moves every cursor like `editorMoveCursor` moves the primary one.
+*/
+static void cursorMove(int key)
+{
+    int primary;
+    int n = cursorGather(&primary);
+
+    for (int i = 0; i < n; i++)
+    {
+        struct editorCursor *c = &cursors.batch[i];
+        editor.cx = c->cx;
+        editor.cy = c->cy;
+
+        if (key == HOME_KEY) editor.cx = 0;
+        else if (key == END_KEY) editor.cx = (editor.cy < editor.numrows) ? editor.row[editor.cy].size : 0;
+        else editorMoveCursor(key);
+
+        c->cx = editor.cx;
+        c->cy = editor.cy;
+    }
+
+    cursorScatter(n, cursors.batch[primary]);
+}
+
+/**
+ * @brief Finds `cursors.word` as a whole word in `row` at or after `from`.
+ * @return Its column, or -1.
+*/
+static int cursorFindWord(erow *row, int from)
+{
+    while (from + cursors.wordLen <= row->size)
+    {
+        char *p = memmem(&row->chars[from], row->size - from, cursors.word, cursors.wordLen);
+        if (p == NULL) return -1;
+
+        int at = p - row->chars;
+        int end = at + cursors.wordLen;
+        if ((at == 0 || !cursorIsWord(row->chars[at - 1])) && (end == row->size || !cursorIsWord(row->chars[end])))
+            return at;
+        from = at + 1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Adds a cursor at the next occurrence of the word under the primary cursor, after the
+ * @brief one added last and wrapping around, at the same place within the word.
+*/
+void editorCursorAddNext()
+{
+    if (cursors.word == NULL)
+    {
+        erow *row = (editor.cy < editor.numrows) ? &editor.row[editor.cy] : NULL;
+        int start = editor.cx, end = editor.cx;
+
+        while (row && start > 0 && cursorIsWord(row->chars[start - 1])) start--;
+        while (row && end < row->size && cursorIsWord(row->chars[end])) end++;
+        if (start == end)
+        {
+            editorSetStatusMessage("No word under the cursor.");
+            return;
+        }
+
+        cursors.wordLen = end - start;
+        cursors.word = malloc(cursors.wordLen);
+        memcpy(cursors.word, &row->chars[start], cursors.wordLen);
+        cursors.offset = editor.cx - start;
+        cursors.last = (struct editorCursor){ start, editor.cy };
+    }
+
+    int cy = cursors.last.cy;
+    int from = cursors.last.cx + cursors.wordLen;
+
+    // the row of the last occurrence is visited again from its start after wrapping around
+    for (int n = 0; n <= editor.numrows; n++)
+    {
+        int at = cy < editor.numrows ? cursorFindWord(&editor.row[cy], from) : -1;
+        if (at != -1)
+        {
+            struct editorCursor c = { at + cursors.offset, cy };
+            struct editorCursor p = { editor.cx, editor.cy };
+            int taken = cursorCompare(&c, &p) == 0;
+
+            for (int i = 0; i < cursors.count && !taken; i++)
+                taken = cursorCompare(&c, &cursors.list[i]) == 0;
+            if (taken) break;
+
+            cursors.last = (struct editorCursor){ at, cy };
+            cursorPush(c.cx, c.cy);
+            qsort(cursors.list, cursors.count, sizeof(struct editorCursor), cursorCompare);
+            editorSetStatusMessage("%d cursors - Esc to drop the extra ones", cursors.count + 1);
+            return;
+        }
+
+        cy = (cy + 1) % (editor.numrows ? editor.numrows : 1);
+        from = 0;
+    }
+
+    editorSetStatusMessage("No more matches of %.*s.", cursors.wordLen < 32 ? cursors.wordLen : 32, cursors.word);
+}
+
+/**
+ * @brief Asks for a line and adds a cursor on every line from the primary cursor to it, in the
+ * @brief same screen column where lines are long enough.
+*/
+void editorCursorAddLines()
+{
+    char *answer = editorPrompt("Cursors down to line: %s (Ctrl-X to cancel)", NULL);
+    if (answer == NULL) return;
+
+    int target = atoi(answer) - 1;
+    free(answer);
+
+    if (target < 0 || editor.numrows == 0)
+    {
+        editorSetStatusMessage("No such line.");
+        return;
+    }
+    if (target >= editor.numrows) target = editor.numrows - 1;
+
+    int rx = (editor.cy < editor.numrows) ? editorRowCxToRx(&editor.row[editor.cy], editor.cx) : 0;
+    int step = (target >= editor.cy) ? 1 : -1;
+
+    free(cursors.word);
+    cursors.word = NULL;
+
+    for (int cy = editor.cy + step; cy != target + step; cy += step)
+    {
+        if (cy < 0 || cy >= editor.numrows) continue;
+        cursorPush(editorRowRxToCx(&editor.row[cy], rx), cy);
+    }
+
+    if (cursors.count == 0)
+    {
+        editorSetStatusMessage("No other line up to there.");
+        return;
+    }
+
+    int primary;
+    int n = cursorGather(&primary);
+    cursorScatter(n, cursors.batch[primary]);
+
+    editorSetStatusMessage("%d cursors - Esc to drop the extra ones", cursors.count + 1);
+}
+
+/**
+ * @brief Drops the extra cursors.
+*/
+void editorCursorClear()
+{
+    cursors.count = 0;
+    free(cursors.word);
+    cursors.word = NULL;
+}
+
+/**
+ * @return Number of extra cursors.
+*/
+int editorCursorCount()
+{
+    return cursors.count;
+}
+
+/**
+ * @brief Applies a key to every cursor while there are several.
+ * @return 1 if the key was handled, 0 if it is left to `editorProcessKeypress`. Keys a batch
+ * @return cannot apply drop the extra cursors before returning 0.
+*/
+int editorCursorKey(int c)
+{
+    if (cursors.count == 0) return 0;
+
+    switch (c)
+    {
+        case ARROW_UP:
+        case ARROW_DOWN:
+        case ARROW_RIGHT:
+        case ARROW_LEFT:
+        case HOME_KEY:
+        case END_KEY:
+            cursorMove(c);
+            return 1;
+
+        case BACKSPACE:
+        case CTRL_KEY('h'):
+            cursorDelete(1);
+            return 1;
+
+        case DEL_KEY:
+            cursorDelete(0);
+            return 1;
+
+        case '\x1b':
+            editorCursorClear();
+            return 1;
+
+        case PASTE_KEY:
+            {
+                int len;
+                const char *text = editorReadPaste(&len);
+                if (len > 0 && !memchr(text, '\n', len) && !memchr(text, '\r', len))
+                {
+                    cursorInsert(text, len);
+                    return 1;
+                }
+
+                editorCursorClear();
+                editorInsertText(text, len);
+            }
+            return 1;
+
+        // keys that leave the cursors alone
+        case CTRL_KEY('d'):
+        case CTRL_KEY('e'):
+        case CTRL_KEY('s'):
+        case CTRL_KEY('t'):
+        case CTRL_KEY('q'):
+            return 0;
+    }
+
+    if (c == '\t' || (c >= ' ' && c < 256 && c != BACKSPACE))
+    {
+        char ch = c;
+        cursorInsert(&ch, 1);
+        return 1;
+    }
+
+    editorCursorClear();
+    return 0;
+}
+
+/**
+ * @brief Finds the extra cursors on a row, for drawing them.
+ * @param first Set to the index of the first one, see `editorCursorAt`.
+ * @return Number of extra cursors on the row.
+*/
+int editorCursorsOnRow(int row, int *first)
+{
+    int lo = 0, hi = cursors.count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (cursors.list[mid].cy < row) lo = mid + 1;
+        else hi = mid;
+    }
+
+    int end = lo;
+    while (end < cursors.count && cursors.list[end].cy == row) end++;
+
+    *first = lo;
+    return end - lo;
+}
+
+struct editorCursor *editorCursorAt(int idx)
+{
+    return &cursors.list[idx];
+}
+
+/**
+ * @brief Writes the number of cursors for the status bar.
+ * @return Length written, 0 while there is a single cursor.
+*/
+int editorCursorStatus(char *buf, int size)
+{
+    if (cursors.count == 0) return 0;
+    return snprintf(buf, size, "%d cursors", cursors.count + 1);
+}
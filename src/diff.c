@@ -0,0 +1,228 @@
+#include "../lib/diff.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/*
+ * Myers' O(ND) difference algorithm in linear space, over one hash per line: the middle snake of
+ * the shortest edit script is searched from both ends at once, then both halves are diffed the
+ * same way. A search costing more than `DIFF_COST_LIMIT` steps gives up on the shortest script
+ * and splits at the furthest point it reached, so two unrelated files take bounded time. The
+ * script is then still correct, just not the smallest.
+*/
+
+struct diffContext
+{
+    const uint64_t *a, *b;
+    int *fd, *bd; // furthest x reached on each diagonal `x - y`, forwards and backwards
+    struct diffHunk *hunks;
+    int count, cap;
+};
+
+/**
+ * @brief Returns a 64-bit hash of one line, read a word at a time.
+*/
+uint64_t editorDiffHash(const char *s, size_t len)
+{
+    uint64_t h = len * 0x9e3779b97f4a7c15ull;
+    uint64_t w;
+
+    for (; len >= 8; s += 8, len -= 8)
+    {
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+
+    w = 0;
+    memcpy(&w, s, len);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 29;
+    return h;
+}
+
+/**
+ * @brief Appends a hunk, merged into the previous one when they touch.
+*/
+static void diffEmit(struct diffContext *ctx, int a, int alen, int b, int blen)
+{
+    if (ctx->count)
+    {
+        struct diffHunk *last = &ctx->hunks[ctx->count - 1];
+        if (last->a + last->alen == a && last->b + last->blen == b)
+        {
+            last->alen += alen;
+            last->blen += blen;
+            return;
+        }
+    }
+
+    if (ctx->count == ctx->cap)
+    {
+        ctx->cap = ctx->cap ? ctx->cap * 2 : 16;
+        ctx->hunks = realloc(ctx->hunks, sizeof(struct diffHunk) * ctx->cap);
+    }
+    ctx->hunks[ctx->count++] = (struct diffHunk){ a, alen, b, blen };
+}
+
+/**
+ * @brief Finds where the shortest edit script from (`xoff`, `yoff`) to (`xlim`, `ylim`) crosses
+ * @brief its middle, or a point on the way there once `DIFF_COST_LIMIT` is spent.
+*/
+static void diffSplit(struct diffContext *ctx, int xoff, int xlim, int yoff, int ylim, int *xmid, int *ymid)
+{
+    const uint64_t *a = ctx->a, *b = ctx->b;
+    int *fd = ctx->fd, *bd = ctx->bd;
+
+    int dmin = xoff - ylim, dmax = xlim - yoff;
+    int fmid = xoff - yoff, bmid = xlim - ylim;
+    int fmin = fmid, fmax = fmid;
+    int bmin = bmid, bmax = bmid;
+    int odd = (fmid - bmid) & 1;
+
+    fd[fmid] = xoff;
+    bd[bmid] = xlim;
+
+    for (int c = 1;; c++)
+    {
+        // one more edit forwards on every diagonal in reach
+        if (fmin > dmin) fd[--fmin - 1] = -1;
+        else fmin++;
+        if (fmax < dmax) fd[++fmax + 1] = -1;
+        else fmax--;
+
+        for (int d = fmax; d >= fmin; d -= 2)
+        {
+            int x = fd[d - 1] < fd[d + 1] ? fd[d + 1] : fd[d - 1] + 1;
+            int y = x - d;
+
+            while (x < xlim && y < ylim && a[x] == b[y]) x++, y++;
+            fd[d] = x;
+
+            if (odd && bmin <= d && d <= bmax && bd[d] <= x)
+            {
+                *xmid = x;
+                *ymid = y;
+                return;
+            }
+        }
+
+        // and backwards
+        if (bmin > dmin) bd[--bmin - 1] = INT_MAX;
+        else bmin++;
+        if (bmax < dmax) bd[++bmax + 1] = INT_MAX;
+        else bmax--;
+
+        for (int d = bmax; d >= bmin; d -= 2)
+        {
+            int x = bd[d - 1] < bd[d + 1] ? bd[d - 1] : bd[d + 1] - 1;
+            int y = x - d;
+
+            while (x > xoff && y > yoff && a[x - 1] == b[y - 1]) x--, y--;
+            bd[d] = x;
+
+            if (!odd && fmin <= d && d <= fmax && x <= fd[d])
+            {
+                *xmid = x;
+                *ymid = y;
+                return;
+            }
+        }
+
+        if (c < DIFF_COST_LIMIT) continue;
+
+        // too expensive: split at whichever search got furthest from its end
+        int fxy = -1, fx = xoff;
+        for (int d = fmax; d >= fmin; d -= 2)
+        {
+            int x = fd[d] < xlim ? fd[d] : xlim;
+            int y = x - d;
+            if (y > ylim)
+            {
+                x = ylim + d;
+                y = ylim;
+            }
+            if (x + y > fxy)
+            {
+                fxy = x + y;
+                fx = x;
+            }
+        }
+
+        int bxy = INT_MAX, bx = xlim;
+        for (int d = bmax; d >= bmin; d -= 2)
+        {
+            int x = bd[d] > xoff ? bd[d] : xoff;
+            int y = x - d;
+            if (y < yoff)
+            {
+                x = yoff + d;
+                y = yoff;
+            }
+            if (x + y < bxy)
+            {
+                bxy = x + y;
+                bx = x;
+            }
+        }
+
+        if ((xlim + ylim) - bxy < fxy - (xoff + yoff))
+        {
+            *xmid = fx;
+            *ymid = fxy - fx;
+        }
+        else
+        {
+            *xmid = bx;
+            *ymid = bxy - bx;
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Diffs lines `xoff`..`xlim - 1` of the old text against `yoff`..`ylim - 1` of the new.
+*/
+static void diffRange(struct diffContext *ctx, int xoff, int xlim, int yoff, int ylim)
+{
+    // the second half is diffed by the loop rather than recursion, halving the depth
+    for (;;)
+    {
+        while (xoff < xlim && yoff < ylim && ctx->a[xoff] == ctx->b[yoff]) xoff++, yoff++;
+        while (xoff < xlim && yoff < ylim && ctx->a[xlim - 1] == ctx->b[ylim - 1]) xlim--, ylim--;
+
+        if (xoff == xlim || yoff == ylim)
+        {
+            if (xoff < xlim || yoff < ylim) diffEmit(ctx, xoff, xlim - xoff, yoff, ylim - yoff);
+            return;
+        }
+
+        int xmid, ymid;
+        diffSplit(ctx, xoff, xlim, yoff, ylim, &xmid, &ymid);
+
+        diffRange(ctx, xoff, xmid, yoff, ymid);
+        xoff = xmid;
+        yoff = ymid;
+    }
+}
+
+/**
+ * @brief Diffs the `n` line hashes `a` of the old text against the `m` hashes `b` of the new.
+ * @param hunks Set to the changes in order, to be freed by the caller.
+ * @return Number of hunks, 0 if the texts are the same.
+*/
+int editorDiff(const uint64_t *a, int n, const uint64_t *b, int m, struct diffHunk **hunks)
+{
+    struct diffContext ctx = { .a = a, .b = b };
+
+    // diagonals run from -m - 1 to n + 1
+    int *fd = malloc(sizeof(int) * 2 * (n + m + 3));
+    ctx.fd = fd + m + 1;
+    ctx.bd = fd + (n + m + 3) + m + 1;
+
+    diffRange(&ctx, 0, n, 0, m);
+
+    free(fd);
+    *hunks = ctx.hunks;
+    return ctx.count;
+}
@@ -0,0 +1,419 @@
+#include "../lib/diffview.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/diff.h"
+#include "../lib/file_io.h"
+#include "../lib/output.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/*
+ * The diff view (Ctrl-K) marks in the gutter the rows that differ from the file on disk. The
+ * file is read once, keeping one hash per line, and diffed against the row hashes. From then on
+ * edits only shift the hunks and widen a range of rows touched since the last diff; before the
+ * next frame just that range, grown to the hunks it meets, is hashed and diffed again against
+ * the lines of the file it stands for. The file is read again when it changes, as after a save.
+*/
+
+static struct
+{
+    int active;
+    char *path;
+    off_t size; // the file as `disk` was read from it
+    ino_t ino;
+    struct timespec mtime;
+
+    uint64_t *disk; // hash of each line of the file
+    int ndisk;
+
+    struct diffHunk *hunks; // lines `a`.. of the file against rows `b`.., rows kept current by edits
+    int count, cap;
+
+    int dirty; // rows `lo`..`hi - 1` were edited since the last diff, `lo == hi` is a deletion there
+    int lo, hi;
+} diffview;
+
+static int diffviewSameFile(const struct stat *st)
+{
+    return st->st_size == diffview.size && st->st_ino == diffview.ino &&
+        st->st_mtim.tv_sec == diffview.mtime.tv_sec && st->st_mtim.tv_nsec == diffview.mtime.tv_nsec;
+}
+
+/**
+ * @brief Reads the file and hashes its lines the way `editorOpen` splits them.
+ * @return 0, or -1 if it could not be read.
+*/
+static int diffviewLoad()
+{
+    int fd = open(diffview.path, O_RDONLY);
+    if (fd == -1) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // bytes appended meanwhile are left for the next read
+    size_t size = st.st_size, len = 0;
+    char *buf = malloc(size ? size : 1);
+    ssize_t n;
+
+    while (len < size && (n = read(fd, &buf[len], size - len)) != 0)
+    {
+        if (n == -1)
+        {
+            if (errno == EINTR) continue;
+            free(buf);
+            close(fd);
+            return -1;
+        }
+        len += n;
+    }
+    close(fd);
+
+    int cap = 0;
+    diffview.ndisk = 0;
+
+    for (size_t i = 0; i < len;)
+    {
+        char *nl = memchr(&buf[i], '\n', len - i);
+        size_t end = nl ? (size_t)(nl - buf) : len;
+        size_t linelen = end - i;
+
+        while (linelen > 0 && buf[i + linelen - 1] == '\r') linelen--;
+
+        if (diffview.ndisk == cap)
+        {
+            cap = cap ? cap * 2 : 1024;
+            diffview.disk = realloc(diffview.disk, sizeof(uint64_t) * cap);
+        }
+        diffview.disk[diffview.ndisk++] = editorDiffHash(&buf[i], linelen);
+        i = end + 1;
+    }
+    free(buf);
+
+    diffview.size = st.st_size;
+    diffview.ino = st.st_ino;
+    diffview.mtime = st.st_mtim;
+    return 0;
+}
+
+/**
+ * @brief Adds rows `lo`..`hi - 1` to the ones to diff again.
+*/
+static void diffviewTouch(int lo, int hi)
+{
+    if (!diffview.dirty)
+    {
+        diffview.dirty = 1;
+        diffview.lo = lo;
+        diffview.hi = hi;
+        return;
+    }
+    if (lo < diffview.lo) diffview.lo = lo;
+    if (hi > diffview.hi) diffview.hi = hi;
+}
+
+/**
+ * @brief Index of the first hunk whose rows end at or after `row`.
+*/
+static int diffviewFirstEnding(int row)
+{
+    int lo = 0, hi = diffview.count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (diffview.hunks[mid].b + diffview.hunks[mid].blen < row) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief Diffs the edited rows, and the hunks they meet, again and puts the result in place of
+ * @brief those hunks. The rows between hunks hold their lines of the file, so the range maps to
+ * @brief lines through the hunks on either side.
+*/
+static void diffviewUpdate()
+{
+    struct diffHunk *h = diffview.hunks;
+    int lo = diffview.lo < 0 ? 0 : diffview.lo;
+    int hi = diffview.hi > editor.numrows ? editor.numrows : diffview.hi;
+    if (lo > editor.numrows) lo = editor.numrows;
+    if (hi < lo) hi = lo;
+
+    // the range grows over every hunk it meets, those are replaced
+    int k0 = diffviewFirstEnding(lo), k1 = k0;
+    while (k1 < diffview.count && h[k1].b <= hi)
+    {
+        if (h[k1].b < lo) lo = h[k1].b;
+        if (h[k1].b + h[k1].blen > hi) hi = h[k1].b + h[k1].blen;
+        k1++;
+    }
+    while (k0 > 0 && h[k0 - 1].b + h[k0 - 1].blen >= lo)
+    {
+        k0--;
+        if (h[k0].b < lo) lo = h[k0].b;
+    }
+
+    int d0 = k0 > 0 ? h[k0 - 1].a + h[k0 - 1].alen + lo - (h[k0 - 1].b + h[k0 - 1].blen) : lo;
+    int d1 = k1 < diffview.count ? h[k1].a - (h[k1].b - hi) : diffview.ndisk - (editor.numrows - hi);
+
+    if (d0 < 0 || d1 < d0 || d1 > diffview.ndisk)
+    {
+        // cannot happen while every edit is reported, but a whole diff is always right
+        lo = k0 = 0;
+        hi = editor.numrows;
+        k1 = diffview.count;
+        d0 = 0;
+        d1 = diffview.ndisk;
+    }
+
+    int n = hi - lo;
+    uint64_t *rows = malloc(sizeof(uint64_t) * (n ? n : 1));
+    for (int i = 0; i < n; i++) rows[i] = editorDiffHash(editor.row[lo + i].chars, editor.row[lo + i].size);
+
+    struct diffHunk *fresh;
+    int nf = editorDiff(&diffview.disk[d0], d1 - d0, rows, n, &fresh);
+    free(rows);
+
+    int count = diffview.count - (k1 - k0) + nf;
+    if (count > diffview.cap)
+    {
+        diffview.cap = count * 2;
+        diffview.hunks = realloc(diffview.hunks, sizeof(struct diffHunk) * diffview.cap);
+    }
+    h = diffview.hunks;
+
+    if (diffview.count > k1) memmove(&h[k0 + nf], &h[k1], sizeof(struct diffHunk) * (diffview.count - k1));
+    for (int k = 0; k < nf; k++)
+    {
+        h[k0 + k] = fresh[k];
+        h[k0 + k].a += d0;
+        h[k0 + k].b += lo;
+    }
+    free(fresh);
+
+    diffview.count = count;
+    diffview.dirty = 0;
+}
+
+/**
+ * @brief Brings the hunks up to date before a frame: diffs the rows edited since the last time,
+ * @brief or all of them if the file changed. The file is not looked at while a save writes it.
+*/
+void editorDiffViewRefresh()
+{
+    if (!diffview.active) return;
+
+    struct stat st;
+    if (!editorSaveRunning())
+    {
+        if (stat(diffview.path, &st) == -1)
+        {
+            editorSetStatusMessage("%.20s is gone, diff view off.", diffview.path);
+            editorDiffViewClose();
+            return;
+        }
+
+        if (!diffviewSameFile(&st))
+        {
+            if (diffviewLoad() == -1)
+            {
+                editorSetStatusMessage("Can't read %.20s, diff view off.", diffview.path);
+                editorDiffViewClose();
+                return;
+            }
+            diffview.count = 0;
+            diffviewTouch(0, editor.numrows);
+        }
+    }
+
+    if (diffview.dirty) diffviewUpdate();
+}
+
+/**
+ * @brief Stops the diff view and frees what it kept.
+*/
+void editorDiffViewClose()
+{
+    free(diffview.path);
+    free(diffview.disk);
+    free(diffview.hunks);
+    memset(&diffview, 0, sizeof(diffview));
+}
+
+/**
+ * @brief Shows the rows that differ from the file on disk, or stops showing them.
+*/
+void editorDiffViewToggle()
+{
+    if (diffview.active)
+    {
+        editorDiffViewClose();
+        editorSetStatusMessage("Diff view off.");
+        return;
+    }
+
+    if (editor.fileName == NULL)
+    {
+        editorSetStatusMessage("No file to diff against.");
+        return;
+    }
+
+    // the file is read whole, not halfway through a save
+    editorSaveWait();
+
+    diffview.path = strdup(editor.fileName);
+    if (diffviewLoad() == -1)
+    {
+        editorSetStatusMessage("Can't read %.20s to diff against.", diffview.path);
+        editorDiffViewClose();
+        return;
+    }
+
+    diffview.active = 1;
+    diffviewTouch(0, editor.numrows);
+    editorDiffViewRefresh();
+
+    int added = 0, removed = 0;
+    for (int k = 0; k < diffview.count; k++)
+    {
+        added += diffview.hunks[k].blen;
+        removed += diffview.hunks[k].alen;
+    }
+    editorSetStatusMessage("%d hunks against %.20s, +%d -%d lines. Ctrl-J/Ctrl-U next/previous.",
+        diffview.count, diffview.path, added, removed);
+}
+
+/**
+ * @brief What the gutter shows for `row`.
+ * @return One of `enum diffMark`.
+*/
+int editorDiffViewMark(int row)
+{
+    if (!diffview.active || diffview.count == 0) return DIFF_MARK_NONE;
+
+    // the last hunk starting at or before the row
+    int lo = 0, hi = diffview.count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (diffview.hunks[mid].b <= row) lo = mid + 1;
+        else hi = mid;
+    }
+
+    if (lo > 0)
+    {
+        const struct diffHunk *h = &diffview.hunks[lo - 1];
+        if (row < h->b + h->blen) return row - h->b < h->alen ? DIFF_MARK_CHANGED : DIFF_MARK_ADDED;
+        if (h->blen == 0 && h->b == row) return DIFF_MARK_DELETED;
+    }
+
+    // lines missing from the end show on the last row
+    const struct diffHunk *last = &diffview.hunks[diffview.count - 1];
+    if (row == editor.numrows - 1 && last->b == editor.numrows) return DIFF_MARK_DELETED;
+
+    return DIFF_MARK_NONE;
+}
+
+/**
+ * @brief Moves the cursor to the start of the next hunk below it (`dir` > 0) or above it,
+ * @brief wrapping around.
+*/
+void editorDiffViewJump(int dir)
+{
+    if (!diffview.active)
+    {
+        editorSetStatusMessage("Diff view is off, Ctrl-K shows it.");
+        return;
+    }
+
+    editorDiffViewRefresh();
+    if (!diffview.active) return;
+    if (diffview.count == 0)
+    {
+        editorSetStatusMessage("No changes against %.20s.", diffview.path);
+        return;
+    }
+
+    int k = 0;
+    while (k < diffview.count && diffview.hunks[k].b < editor.cy + (dir > 0)) k++;
+
+    if (dir > 0) k = k < diffview.count ? k : 0;
+    else k = k > 0 ? k - 1 : diffview.count - 1;
+
+    const struct diffHunk *h = &diffview.hunks[k];
+    editor.cy = h->b;
+    editor.cx = 0;
+    editorSetStatusMessage("Hunk %d/%d: -%d +%d lines.", k + 1, diffview.count, h->alen, h->blen);
+}
+
+/**
+ * @brief Called whenever the text of row `at` changes.
+*/
+void editorDiffViewRowChanged(int at)
+{
+    if (diffview.active) diffviewTouch(at, at + 1);
+}
+
+/**
+ * @brief Called when `n` rows are inserted at `at`: hunks below move down, one the rows land in
+ * @brief grows.
+*/
+void editorDiffViewRowsInserted(int at, int n)
+{
+    if (!diffview.active) return;
+
+    for (int k = diffviewFirstEnding(at); k < diffview.count; k++)
+    {
+        struct diffHunk *h = &diffview.hunks[k];
+        if (h->b >= at) h->b += n;
+        else if (h->b + h->blen > at) h->blen += n;
+    }
+
+    if (diffview.dirty)
+    {
+        if (diffview.lo >= at) diffview.lo += n;
+        if (diffview.hi > at) diffview.hi += n;
+    }
+    diffviewTouch(at, at + n);
+}
+
+/**
+ * @brief Where row `p` ends up once rows `at`..`at + n - 1` are deleted.
+*/
+static int diffviewDeletedMap(int p, int at, int n)
+{
+    return p <= at ? p : (p >= at + n ? p - n : at);
+}
+
+/**
+ * @brief Called when `n` rows are deleted at `at`: hunks below move up, those holding the rows
+ * @brief shrink.
+*/
+void editorDiffViewRowsDeleted(int at, int n)
+{
+    if (!diffview.active) return;
+
+    for (int k = diffviewFirstEnding(at); k < diffview.count; k++)
+    {
+        struct diffHunk *h = &diffview.hunks[k];
+        int end = diffviewDeletedMap(h->b + h->blen, at, n);
+        h->b = diffviewDeletedMap(h->b, at, n);
+        h->blen = end - h->b;
+    }
+
+    if (diffview.dirty)
+    {
+        diffview.lo = diffviewDeletedMap(diffview.lo, at, n);
+        diffview.hi = diffviewDeletedMap(diffview.hi, at, n);
+    }
+    diffviewTouch(at, at);
+}
@@ -3,6 +3,10 @@
 #include "../lib/file_io.h"
 #include "../lib/input.h"
 #include "../lib/syntax.h"
+#include "../lib/output.h"
+#include "../lib/search.h"
+#include "../lib/latency.h"
+#include "../lib/undo.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -19,6 +23,97 @@ void editorInsertChar(int c)
     editor.cx++;
 }
 
+/**
+ * @brief Inserts a block of text at the cursor, such as a bracketed paste.
+ * @brief The text is split into lines for `editorInsertLines`.
+ * @param s (type `const char *`) Text to insert, lines separated by '\r\n', '\r' or '\n'.
+ * @param len (type `int`) Length of the text.
+*/
+void editorInsertText(const char *s, int len)
+{
+    if (len <= 0) return;
+
+    int linecap = 16;
+    int numlines = 0;
+    char **lines = malloc(sizeof(char *) * linecap);
+    size_t *lens = malloc(sizeof(size_t) * linecap);
+
+    const char *p = s;
+    const char *end = s + len;
+
+    while (1)
+    {
+        const char *eol = p;
+        while (eol < end && *eol != '\r' && *eol != '\n') eol++;
+
+        if (numlines == linecap)
+        {
+            linecap *= 2;
+            lines = realloc(lines, sizeof(char *) * linecap);
+            lens = realloc(lens, sizeof(size_t) * linecap);
+        }
+        lines[numlines] = (char *)p;
+        lens[numlines] = eol - p;
+        numlines++;
+
+        if (eol == end) break;
+
+        p = eol + 1;
+        if (*eol == '\r' && p < end && *p == '\n') p++;
+    }
+
+    editorInsertLines(lines, lens, numlines);
+
+    free(lines);
+    free(lens);
+}
+
+/**
+ * @brief Inserts lines at the cursor, the cursor ending up after the last one.
+ * @brief A single line goes through `editorRowInsertString`, multiple lines split the cursor row
+ * @brief once and the rest are added with one `editorInsertRows` call.
+ * @param lines (type `char **`) The `n` lines, the last one is replaced while inserting.
+ * @param lens (type `size_t *`) Their lengths.
+ * @param n (type `int`) Number of lines.
+*/
+void editorInsertLines(char **lines, size_t *lens, int n)
+{
+    if (n <= 0) return;
+    if (editor.cy == editor.numrows) editorInsertRow(editor.numrows, "", 0);
+
+    erow *row = &editor.row[editor.cy];
+
+    if (n == 1)
+    {
+        editorRowInsertString(row, editor.cx, lines[0], lens[0]);
+        editor.cx += lens[0];
+        return;
+    }
+
+    // text after the cursor moves to the end of the last inserted line
+    size_t lastLen = lens[n - 1];
+    size_t tailLen = row->size - editor.cx;
+    char *last = malloc(lastLen + tailLen);
+    memcpy(last, lines[n - 1], lastLen);
+    memcpy(&last[lastLen], &row->chars[editor.cx], tailLen);
+    lines[n - 1] = last;
+    lens[n - 1] = lastLen + tailLen;
+
+    editorUndoChange(editor.cy, editor.cx, &row->chars[editor.cx], tailLen, lines[0], lens[0]);
+    editorRowWritable(row);
+    row->chars = realloc(row->chars, editor.cx + lens[0] + 1);
+    memcpy(&row->chars[editor.cx], lines[0], lens[0]);
+    row->size = editor.cx + lens[0];
+    row->chars[row->size] = '\0';
+    editorUpdateRow(row);
+
+    editorInsertRows(editor.cy + 1, &lines[1], &lens[1], n - 1);
+
+    editor.cy += n - 1;
+    editor.cx = lastLen;
+    free(last);
+}
+
 /**
  * @brief Calls `editorRowDelChar` if `cx` is not at start of line, else appends string and deletes row.
 */
@@ -59,6 +154,8 @@ void editorInsertNewLine()
         erow *row = &editor.row[editor.cy];
         editorInsertRow(editor.cy + 1, &row->chars[editor.cx], row->size - editor.cx);
         row = &editor.row[editor.cy];
+        editorUndoChange(editor.cy, editor.cx, &row->chars[editor.cx], row->size - editor.cx, NULL, 0);
+        editorRowWritable(row);
         row->size = editor.cx;
         row->chars[row->size] = '\0';
         editorUpdateRow(row);
@@ -67,6 +164,54 @@ void editorInsertNewLine()
     editor.cx = 0;
 }
 
+/**
+ * @brief Prompt shown while searching, rewritten by `editorFindCallback` to include the match count.
+*/
+static char findPrompt[128] = "Search: %s (Ctrl-R regex/Ctrl-X/Arrows/Enter)";
+
+/**
+ * @brief Cursor position when the search prompt opened, the first match shown is the one after it.
+*/
+static int findOriginRow;
+static int findOriginCol;
+
+/**
+ * @brief Whether the query is a regular expression, toggled with Ctrl-R in the prompt.
+*/
+static int findRegex = 0;
+
+/**
+ * @brief Whether the prompt belongs to `editorReplace` rather than `editorFind`.
+*/
+static int findReplace = 0;
+
+/**
+ * @brief Rewrites `findPrompt` with the current mode and `status`, such as " [no matches]".
+*/
+static void editorFindSetPrompt(const char *status)
+{
+    const char *label = findReplace ? (findRegex ? "Replace regex" : "Replace") : (findRegex ? "Regex" : "Search");
+
+    snprintf(findPrompt, sizeof(findPrompt), "%s: %%s%s (Ctrl-R %s/Ctrl-X/Arrows/Enter)",
+        label, status, findRegex ? "literal" : "regex");
+}
+
+/**
+ * @brief Puts the cursor and view back where a prompt started. A reload from disk may have
+ * @brief rewritten the rows while the prompt waited for keys, so the cursor is kept within them.
+*/
+static void findRestore(int cx, int cy, int coloff, int rowoff)
+{
+    if (cy > editor.numrows) cy = editor.numrows;
+    if (cy == editor.numrows) cx = 0;
+    else if (cx > editor.row[cy].size) cx = editor.row[cy].size;
+
+    editor.cx = cx;
+    editor.cy = cy;
+    editor.coloff = coloff;
+    editor.rowoff = rowoff;
+}
+
 /**
  * @brief Enabled with Ctrl-F, it saves cursor position and calls `editorPrompt` to
  * @brief which passes `editorFindCallback` as its callback function for incremental search.
@@ -78,175 +223,268 @@ void editorFind()
     int saved_coloff = editor.coloff;
     int saved_rowoff = editor.rowoff;
 
-    char *query = editorPrompt("Search: %s (Ctrl-X/Arrows/Enter)", editorFindCallback);
+    findOriginRow = editor.cy;
+    findOriginCol = editor.cx;
+    findReplace = 0;
+    editorFindSetPrompt("");
+
+    // the buffer may have changed since the last search, never refine across prompts
+    editorSearchCancel();
+
+    char *query = editorPrompt(findPrompt, editorFindCallback);
     if (query) 
     {
         free(query);
     }
     else 
     {
-        editor.cx = saved_cx;
-        editor.cy = saved_cy;
-        editor.coloff = saved_coloff;
-        editor.rowoff = saved_rowoff;
+        findRestore(saved_cx, saved_cy, saved_coloff, saved_rowoff);
     }
 }
 
 /**
- * @brief Used in `editorFindCallback` to find previous match. Reverses a string.
- * @param str String to reverse.
+ * @brief Formats `n` with thousands separators, such as "4,203".
 */
-void reverse_string(char* str) {
-    if (str == NULL) return;
-    int len = strlen(str);
-    for (int i = 0; i < len / 2; i++) {
-        char temp = str[i];
-        str[i] = str[(len - 1) - i];
-        str[(len - 1) - i] = temp;
+static void formatCount(char *buf, int size, int n)
+{
+    char digits[16];
+    int len = snprintf(digits, sizeof(digits), "%d", n);
+    int j = 0;
+
+    for (int i = 0; i < len && j < size - 1; i++)
+    {
+        if (i > 0 && (len - i) % 3 == 0 && j < size - 2) buf[j++] = ',';
+        buf[j++] = digits[i];
     }
+    buf[j] = '\0';
 }
 
 /**
- * @brief Main function for finding a substring within the document. 
- * @brief Uses `strstr` to find an instance of substring within the line and saves
- * @brief previous match with `static` variables.
- * @param query Substring to be matched within document.
- * @param key Last key pressed.
+ * @brief Moves the cursor to match `idx` of the match table and shows its position in the prompt.
 */
-void editorFindCallback(char *query, int key)
+static void editorFindJump(int idx)
 {
-    static int last_match = -1; // index of the row last matched on, or -1 if no last match
-    static int direction = 1; // 1: search forward, -1: search backward
-    static int in_line_position = 0; // position within the current line
-    static int searching_inline = 0; // flag to indicate if we're searching within the same line
+    struct searchMatch *m = editorSearchMatchAt(idx);
+    if (m == NULL) return;
+
+    editor.cy = m->row;
+    editor.cx = m->col;
+    editor.rowoff = editor.numrows;
 
-    static int saved_hl_line;
-    static char* saved_hl = NULL;
+    char current[16], total[16], status[48];
+    formatCount(current, sizeof(current), idx + 1);
+    formatCount(total, sizeof(total), editorSearchTotal());
+    snprintf(status, sizeof(status), " [match %s/%s]", current, total);
+    editorFindSetPrompt(status);
+}
+
+/**
+ * @brief Called once the match table for the current query is complete.
+ * @brief Jumps to the first match after the cursor position the search started from.
+*/
+static void editorFindDone()
+{
+    int idx = editorSearchNext(findOriginRow, findOriginCol - 1, 1);
 
-    if (saved_hl)
+    if (editorSearchError())
     {
-        memcpy(editor.row[saved_hl_line].hl, saved_hl, editor.row[saved_hl_line].rsize);
-        free(saved_hl);
-        saved_hl = NULL;
+        char status[64];
+        snprintf(status, sizeof(status), " [bad regex: %s]", editorSearchError());
+        editorFindSetPrompt(status);
     }
+    else if (idx == -1)
+        editorFindSetPrompt(" [no matches]");
+    else
+        editorFindJump(idx);
+
+    // the prompt is not redrawn by `editorPrompt` when this runs from the event loop
+    editorSetStatusMessage(findPrompt, editorSearchQuery());
+}
 
+/**
+ * @brief Main function for finding a substring within the document. 
+ * @brief A changed query restarts the background search of the whole buffer, see `editorSearchStart`;
+ * @brief typing more characters only narrows the previous matches.
+ * @brief Ctrl-R switches between literal and regular expression queries.
+ * @brief Arrows move between entries of the resulting match table with a binary search.
+ * @param query Substring to be matched within document.
+ * @param key Last key pressed.
+*/
+void editorFindCallback(char *query, int key)
+{
     if (key == '\r' || key == CTRL_KEY('x')) 
     {
-        last_match = -1;
-        direction = 1;
-        in_line_position = 0;
-        searching_inline = 0;
+        editorSearchCancel();
         return;
     }
-    else if (key == ARROW_RIGHT || key == ARROW_DOWN)
-    {   
-        direction = 1;
-        searching_inline = 1;
-    }
-    else if (key == ARROW_LEFT || key == ARROW_UP)
+
+    if (key == ARROW_RIGHT || key == ARROW_DOWN || key == ARROW_LEFT || key == ARROW_UP)
     {
-        direction = -1;
-        searching_inline = 1;
+        if (editorSearchQuery() == NULL) return;
+
+        editorSearchWait();
+
+        int direction = (key == ARROW_RIGHT || key == ARROW_DOWN) ? 1 : -1;
+        int idx = editorSearchNext(editor.cy, editor.cx, direction);
+        if (idx != -1) editorFindJump(idx);
+        return;
     }
-    else // when pressing any key, such as when searching
+
+    // when pressing any key, such as when searching
+    const char *previous = editorSearchQuery();
+
+    if (key == CTRL_KEY('r'))
     {
-        last_match = -1;
-        direction = 1;
-        in_line_position = 0;
-        searching_inline = 0;
+        findRegex = !findRegex;
+        previous = NULL;
     }
+    if (previous && !strcmp(previous, query)) return;
 
-    if (last_match == -1) {
-        direction = 1;
-        in_line_position = 0;
-        searching_inline = 0;
+    int qlen = strlen(query);
+    if (qlen == 0)
+    {
+        editorSearchCancel();
+        editorFindSetPrompt("");
+        return;
     }
-    
-    int currentRow = last_match;
-    int i;
 
-    // Actual Search
-    for (i = 0; i < editor.numrows; i++)
+    editorFindSetPrompt(" [searching]");
+    editorSearchStart(query, qlen, findRegex, editorFindDone);
+}
+
+/**
+ * @brief Search callback for the first prompt of `editorReplace`. Enter keeps the match table.
+*/
+static void editorReplaceCallback(char *query, int key)
+{
+    if (key == '\r')
     {
-        if (!searching_inline) {
-            currentRow += direction;
-            
-            // Wrap around
-            if (currentRow == -1) 
-            {
-                currentRow = editor.numrows - 1;
-            }
-            else if (currentRow == editor.numrows) currentRow = 0;
-        }
+        editorSearchWait();
+        return;
+    }
+    editorFindCallback(query, key);
+}
 
-        erow *row = &editor.row[currentRow];
-        char *line_start = row->render;
-        char *match = line_start;
-
-        if (searching_inline) {
-            // If searching inline, adjust the starting position
-            if (direction == 1) {
-                match += in_line_position + 1;  // Start after the current match
-            } else {
-                // Backward search
-                char reversed_line[row->rsize + 1];
-                char reversed_query[strlen(query) + 1];
-
-                strcpy(reversed_line, line_start);
-                strcpy(reversed_query, query);
-
-                reverse_string(reversed_line);
-                reverse_string(reversed_query);
-
-                char *reverse_match = strstr(&reversed_line[row->rsize - in_line_position - 1], reversed_query);
-                
-                if (reverse_match) {
-                match = line_start + (row->rsize - (reverse_match - reversed_line) - strlen(query));
-                } 
-                else match = NULL;
-
-                if (match == NULL) {
-                    // If no match found before current position move to previous
-                    direction = -1;
-                    searching_inline = 0;
-                    continue;
-                }
-            }
-        }
+/**
+ * @brief Replaces every match in the completed match table with `with`.
+ * @note Each affected row is rebuilt once into a single new allocation. Renders are redone per
+ * @note row, then all rewritten rows are highlighted in one pass by `editorUpdateSyntaxRows`.
+ * @note Literal matches may overlap; a match starting inside the previous one is skipped.
+ * @param lines Set to the number of rows rewritten.
+ * @return Number of replacements.
+*/
+static int editorReplaceAll(const char *with, int wlen, int *lines)
+{
+    int total = editorSearchTotal();
+    int *rows = malloc(sizeof(int) * (total ? total : 1));
+    int numrows = 0;
+    int replaced = 0;
 
-        match = strstr(match, query);
+    for (int i = 0, next; i < total; i = next)
+    {
+        erow *row = &editor.row[editorSearchMatchAt(i)->row];
+        long size = row->size;
+        int end = 0;
 
-        if (match)
+        // the row's matches are [i, next), first measure the new row
+        for (next = i; next < total && editorSearchMatchAt(next)->row == row->idx; next++)
         {
-            last_match = currentRow;
-            editor.cy = currentRow;
+            struct searchMatch *m = editorSearchMatchAt(next);
+            if (m->col < end) continue;
 
-            // index of where first char is
-            editor.cx = editorRowRxToCx(row, match - line_start);
-            editor.rowoff = editor.numrows;
-            in_line_position = match - line_start;
-            searching_inline = 0;  // Reset for next search
+            size += wlen - m->len;
+            end = m->col + m->len;
+        }
 
-            saved_hl_line = currentRow;
-            saved_hl = malloc(row->rsize);
-            memcpy(saved_hl, row->hl, row->rsize);
-            memset(&row->hl[in_line_position], HL_MATCH, strlen(query));
+        char *chars = malloc(size + 1);
+        int from = 0, to = 0;
 
-            break;
-        }
-        else if (searching_inline)
+        for (int k = i; k < next; k++)
         {
-            // If searching inline and no match found, move to next/previous line
-            searching_inline = 0;
-            continue;
+            struct searchMatch *m = editorSearchMatchAt(k);
+            if (m->col < from) continue;
+
+            memcpy(&chars[to], &row->chars[from], m->col - from);
+            to += m->col - from;
+            memcpy(&chars[to], with, wlen);
+            to += wlen;
+            from = m->col + m->len;
+            replaced++;
         }
+        memcpy(&chars[to], &row->chars[from], row->size - from);
+        to += row->size - from;
+        chars[to] = '\0';
+
+        editorUndoChange(row->idx, 0, row->chars, row->size, chars, to);
+        editorRowFreeChars(row);
+        row->chars = chars;
+        row->size = to;
+        editorUpdateRender(row);
+
+        rows[numrows++] = row->idx;
     }
 
-    // If all rows are searched and found no match, reset
-    if (i == editor.numrows)
+    editorUpdateSyntaxRows(rows, numrows);
+    free(rows);
+
+    if (replaced) editor.unsaved++;
+    *lines = numrows;
+    return replaced;
+}
+
+/**
+ * @brief Enabled with Ctrl-R. Searches like `editorFind`, then asks for the replacement and
+ * @brief rewrites every match at once with `editorReplaceAll`.
+*/
+void editorReplace()
+{
+    int saved_cx = editor.cx;
+    int saved_cy = editor.cy;
+    int saved_coloff = editor.coloff;
+    int saved_rowoff = editor.rowoff;
+
+    findOriginRow = editor.cy;
+    findOriginCol = editor.cx;
+    findReplace = 1;
+    editorFindSetPrompt("");
+    editorSearchCancel();
+
+    char *query = editorPrompt(findPrompt, editorReplaceCallback);
+    findRestore(saved_cx, saved_cy, saved_coloff, saved_rowoff);
+
+    if (query == NULL) return;
+    free(query);
+
+    if (editorSearchError() || editorSearchTotal() == 0)
+    {
+        editorSetStatusMessage(editorSearchError() ? "Bad regex: %s" : "No matches", editorSearchError());
+        editorSearchCancel();
+        return;
+    }
+
+    char prompt[64];
+    char total[16];
+    formatCount(total, sizeof(total), editorSearchTotal());
+    snprintf(prompt, sizeof(prompt), "Replace %s matches with: %%s (Ctrl-X to cancel)", total);
+
+    char *with = editorPromptAllowEmpty(prompt, NULL);
+    if (with == NULL)
     {
-        last_match = -1;
-        in_line_position = 0;
-        searching_inline = 0;
+        editorSearchCancel();
+        return;
     }
+
+    uint64_t start = editorLatencyNow();
+    int lines;
+    int replaced = editorReplaceAll(with, strlen(with), &lines);
+    uint64_t elapsed = editorLatencyNow() - start;
+
+    free(with);
+    editorSearchCancel();
+
+    if (editor.cy < editor.numrows && editor.cx > editor.row[editor.cy].size) editor.cx = editor.row[editor.cy].size;
+
+    formatCount(total, sizeof(total), replaced);
+    editorSetStatusMessage("Replaced %s occurrences on %d lines in %llu ms", total, lines,
+        (unsigned long long)(elapsed / 1000000));
 }
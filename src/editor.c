@@ -1,6 +1,7 @@
 #include "../lib/editor.h"
 #include "../lib/terminal.h"
 #include "../lib/syntax.h"
+#include "../lib/headless.h"
 #include <stdlib.h>
 
 char *C_HL_extensions[] = {".c", ".h", ".cpp", NULL};
@@ -44,9 +45,12 @@ void initEditor()
     editor.fileName = NULL;
     editor.statusmsg[0] = '\0';
     editor.statusmsg_time = 0;
+    editor.statusmsg_keep = 0;
     editor.unsaved = 0;
     editor.syntax = NULL;
 
-    if (getWindowSize(&editor.screenRows, &editor.screenCols) == -1) die("getWindowSize");
+    if (editor.headless)
+        editorHeadlessWindowSize(&editor.screenRows, &editor.screenCols);
+    else if (getWindowSize(&editor.screenRows, &editor.screenCols) == -1) die("getWindowSize");
     editor.screenRows -= 2;
 }
\ No newline at end of file
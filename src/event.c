@@ -0,0 +1,304 @@
+#include "../lib/event.h"
+#include "../lib/editor.h"
+#include "../lib/terminal.h"
+#include "../lib/output.h"
+#include "../lib/window.h"
+#include "../lib/const.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+/**
+ * @brief A file descriptor watched by the event loop and the function handling it.
+*/
+struct eventSource
+{
+    int fd;
+    int isTimer; // expiration count is read before calling `callback`
+    editorEventCallback callback;
+    void *arg;
+};
+
+static int epfd = -1;
+static int sigfd = -1;
+static int redraw = 0;
+static int watchingInput = 0; // stdin is added on the first `editorEventWaitInput`
+static int busy = 0; // background work whose completion has not been dispatched yet
+
+static struct eventSource *sources = NULL;
+static int numsources = 0;
+
+/**
+ * @brief Finds the source registered for `fd`.
+ * @return Index into `sources`, or -1 if `fd` is not registered.
+*/
+static int eventFind(int fd)
+{
+    for (int i = 0; i < numsources; i++)
+        if (sources[i].fd == fd) return i;
+
+    return -1;
+}
+
+/**
+ * @brief Handles SIGWINCH by reading the new terminal size and redrawing.
+*/
+static void eventResize(int fd, void *arg)
+{
+    (void)arg;
+    struct signalfd_siginfo info;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info));
+
+    int rows, cols;
+    if (getWindowSize(&rows, &cols) == -1) return;
+
+    editorWindowResize(rows, cols);
+    editorEventRequestRedraw();
+}
+
+/**
+ * @brief Creates the epoll instance and the SIGWINCH signalfd. Safe to call more than once.
+ * @note Must run before any thread is started, so SIGWINCH stays blocked in all of them.
+*/
+void editorEventInit()
+{
+    if (epfd != -1) return;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1) die("epoll_create1");
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigfd != -1) editorEventAddFd(sigfd, eventResize, NULL);
+}
+
+/**
+ * @brief Registers `fd` so that `callback` runs on the main thread whenever it becomes readable.
+ * @return 0 on success, -1 on failure.
+*/
+int editorEventAddFd(int fd, editorEventCallback callback, void *arg)
+{
+    editorEventInit();
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) return -1;
+
+    sources = realloc(sources, sizeof(struct eventSource) * (numsources + 1));
+    sources[numsources].fd = fd;
+    sources[numsources].isTimer = 0;
+    sources[numsources].callback = callback;
+    sources[numsources].arg = arg;
+    numsources++;
+
+    return 0;
+}
+
+/**
+ * @brief Stops watching `fd`. Does not close it.
+*/
+void editorEventRemoveFd(int fd)
+{
+    int i = eventFind(fd);
+    if (i == -1) return;
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+
+    memmove(&sources[i], &sources[i + 1], sizeof(struct eventSource) * (numsources - i - 1));
+    numsources--;
+}
+
+/**
+ * @brief Creates a timerfd based timer. A `ms` of 0 creates it disarmed.
+ * @param ms Milliseconds until the first expiration.
+ * @param periodic If nonzero, the timer keeps firing every `ms` milliseconds.
+ * @return The timer's file descriptor, used to re-arm or remove it, or -1 on failure.
+*/
+int editorEventAddTimer(int ms, int periodic, editorEventCallback callback, void *arg)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) return -1;
+
+    if (editorEventAddFd(fd, callback, arg) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    sources[numsources - 1].isTimer = 1;
+
+    editorEventArmTimer(fd, ms, periodic);
+    return fd;
+}
+
+/**
+ * @brief Re-arms a timer from `editorEventAddTimer`, replacing any pending expiration.
+ * @note A `ms` of 0 disarms the timer.
+*/
+void editorEventArmTimer(int fd, int ms, int periodic)
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (long)(ms % 1000) * 1000000;
+    if (periodic) spec.it_interval = spec.it_value;
+
+    timerfd_settime(fd, 0, &spec, NULL);
+}
+
+/**
+ * @brief Removes and closes a timer from `editorEventAddTimer`.
+*/
+void editorEventRemoveTimer(int fd)
+{
+    editorEventRemoveFd(fd);
+    close(fd);
+}
+
+/**
+ * @brief Asks the event loop to redraw the screen once the current batch of events is handled.
+*/
+void editorEventRequestRedraw()
+{
+    redraw = 1;
+}
+
+/**
+ * @brief Marks background work as started (`delta` 1) or its completion as handled (`delta` -1).
+ * @note Lets `editorEventWaitIdle` know whether there is anything left to wait for.
+*/
+void editorEventBusy(int delta)
+{
+    busy += delta;
+}
+
+/**
+ * @brief Waits for one batch of events and runs their callbacks.
+ * @param timeout Milliseconds to wait, -1 waits forever.
+ * @return 1 if stdin is readable, 0 otherwise.
+*/
+static int eventDispatch(int timeout)
+{
+    struct epoll_event events[EVENT_BATCH];
+
+    while (1)
+    {
+        int n = epoll_wait(epfd, events, EVENT_BATCH, timeout);
+
+        if (n == -1)
+        {
+            if (errno == EINTR) continue;
+            die("epoll_wait");
+        }
+        if (n == 0) return 0;
+
+        int ready = 0;
+
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+
+            if (fd == STDIN_FILENO)
+            {
+                ready = 1;
+                continue;
+            }
+
+            // may have been removed by an earlier callback in this batch
+            int s = eventFind(fd);
+            if (s == -1) continue;
+
+            if (sources[s].isTimer)
+            {
+                uint64_t expirations;
+                if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+            }
+
+            sources[s].callback(fd, sources[s].arg);
+        }
+
+        if (redraw)
+        {
+            redraw = 0;
+            editorRefreshScreen();
+        }
+
+        return ready;
+    }
+}
+
+/**
+ * @brief Sleeps in `epoll_wait` until stdin is readable, dispatching every other source meanwhile.
+ * @param timeout Milliseconds to wait for input, -1 waits forever.
+ * @return 1 if stdin is readable, 0 if the timeout ran out.
+*/
+int editorEventWaitInput(int timeout)
+{
+    editorEventInit();
+
+    if (!watchingInput)
+    {
+        // stdin has no callback, it ends the wait
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = STDIN_FILENO };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == -1) die("epoll_ctl");
+        watchingInput = 1;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int remaining = timeout;
+
+    while (!eventDispatch(remaining))
+    {
+        if (timeout == -1) continue;
+
+        // other events woke us up, keep waiting for the rest of the timeout
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        remaining = timeout - elapsed;
+        if (remaining <= 0) return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Dispatches events until all background work marked with `editorEventBusy` has completed.
+ * @note Used where there is no user to wait for, such as headless runs and benchmarks.
+*/
+void editorEventWaitIdle()
+{
+    editorEventInit();
+
+    while (busy > 0) eventDispatch(-1);
+}
+
+/**
+ * @brief Dispatches events for `ms` milliseconds, for headless runs waiting on outside changes.
+*/
+void editorEventRunFor(int ms)
+{
+    editorEventInit();
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long elapsed = 0; elapsed < ms; )
+    {
+        eventDispatch(ms - elapsed);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    }
+}
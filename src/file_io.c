@@ -5,6 +5,16 @@
 #include "../lib/output.h"
 #include "../lib/input.h"
 #include "../lib/syntax.h"
+#include "../lib/trigram.h"
+#include "../lib/undo.h"
+#include "../lib/window.h"
+#include "../lib/event.h"
+#include "../lib/jobs.h"
+#include "../lib/clipboard.h"
+#include "../lib/follow.h"
+#include "../lib/reload.h"
+#include "../lib/diffview.h"
+#include "../lib/fold.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -12,6 +22,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <stdatomic.h>
 
 /**
  * @brief Manages file text opening by reading file and calling editorAppendRow, skipping any escape characters.
@@ -22,6 +33,9 @@ void editorOpen(char *fileName)
     free(editor.fileName);
     editor.fileName = strdup(fileName);
 
+    editorUndoReset();
+    editorUndoSuspend();
+
     editorSelectSyntaxHighlight();
 
     FILE *fp = fopen(fileName, "r");
@@ -41,6 +55,8 @@ void editorOpen(char *fileName)
     free(line);
     fclose(fp);
 
+    editorUndoResume();
+    editorUndoAttach(fileName);
     editor.unsaved = 0;
 }
 
@@ -69,10 +85,179 @@ void editorInsertRow(int at, char *s, size_t len)
     editor.row[at].render = NULL;
     editor.row[at].hl = NULL;
     editor.row[at].hl_open_comment = 0;
+    editor.row[at].snapshot = 0;
+    editor.row[at].yanked = 0;
+    editor.row[at].window = NULL;
+    editorTrigramRowAdded(&editor.row[at]);
     editorUpdateRow(&editor.row[at]);
 
     editor.numrows++;
     editor.unsaved++;
+    editorUndoRowsInserted(at, 1);
+    editorWindowRowsInserted(at, 1);
+    editorDiffViewRowsInserted(at, 1);
+    editorFoldRowsInserted(at, 1);
+}
+
+/**
+ * @brief Sets up a new row holding `len` bytes of `s`, rendered but not highlighted.
+*/
+static void rowInit(erow *row, int idx, const char *s, size_t len)
+{
+    row->idx = idx;
+
+    row->size = len;
+    row->chars = malloc(len + 1);
+    memcpy(row->chars, s, len);
+    row->chars[len] = '\0';
+
+    row->rsize = 0;
+    row->render = NULL;
+    row->hl = NULL;
+    row->hl_open_comment = 0;
+    row->snapshot = 0;
+    row->yanked = 0;
+    row->window = NULL;
+    editorTrigramRowAdded(row);
+    editorUpdateRender(row);
+}
+
+/**
+ * @brief Inserts `n` rows at once with a single reallocation of `editor.row` and a single `memmove`.
+ * @brief Each new row is rendered once, then all of them are highlighted in one top-down pass.
+ * @param at Index the first new row will have.
+ * @param s Array of `n` lines to be copied into the new rows.
+ * @param len Array of `n` line lengths.
+ * @param n Number of rows to insert.
+*/
+void editorInsertRows(int at, char **s, size_t *len, int n)
+{
+    if (at < 0 || at > editor.numrows || n <= 0) return;
+
+    editor.row = realloc(editor.row, sizeof(erow) * (editor.numrows + n));
+    memmove(&editor.row[at + n], &editor.row[at], sizeof(erow) * (editor.numrows - at));
+    for (int j = at + n; j < editor.numrows + n; j++) editor.row[j].idx += n;
+
+    for (int i = 0; i < n; i++) rowInit(&editor.row[at + i], at + i, s[i], len[i]);
+
+    editor.numrows += n;
+    editorUndoRowsInserted(at, n);
+    editorWindowRowsInserted(at, n);
+    editorDiffViewRowsInserted(at, n);
+    editorFoldRowsInserted(at, n);
+
+    // rows already reached by a spilling multiline comment have their `hl` set and are skipped
+    for (int i = 0; i < n; i++)
+    {
+        if (editor.row[at + i].hl == NULL) editorUpdateSyntax(&editor.row[at + i]);
+    }
+
+    editor.unsaved++;
+}
+
+/**
+ * @brief Replaces the rows of each hunk with its lines in one pass over `editor.row`, however
+ * @brief many hunks add or remove rows. Rows outside the hunks, and those inside that already
+ * @brief hold their line, keep their render and highlighting.
+ * @param hunks Rows `a`.. of the old rows to be replaced by `lines[b]`.., in order.
+*/
+void editorReplaceRows(const struct diffHunk *hunks, int count, char **lines, size_t *lens)
+{
+    int numrows = editor.numrows, maxStale = 1;
+    for (int k = 0; k < count; k++)
+    {
+        numrows += hunks[k].blen - hunks[k].alen;
+        maxStale += hunks[k].blen + 1;
+    }
+
+    // logged from the bottom up as separate edits would be, each one on rows the ones before left alone
+    for (int k = count - 1; k >= 0; k--)
+    {
+        const struct diffHunk *h = &hunks[k];
+        int same = h->alen < h->blen ? h->alen : h->blen;
+
+        if (h->alen > same) editorUndoRowsDeleted(h->a + same, h->alen - same);
+        else if (h->blen > same) editorUndoLinesInserted(h->a + same, &lines[h->b + same], &lens[h->b + same], h->blen - same);
+
+        for (int i = same - 1; i >= 0; i--)
+        {
+            erow *row = &editor.row[h->a + i];
+            editorUndoChange(h->a + i, 0, row->chars, row->size, lines[h->b + i], lens[h->b + i]);
+        }
+
+        if (h->alen > same)
+        {
+            editorWindowRowsDeleted(h->a + same, h->alen - same);
+            editorDiffViewRowsDeleted(h->a + same, h->alen - same);
+            editorFoldRowsDeleted(h->a + same, h->alen - same);
+        }
+        else if (h->blen > same)
+        {
+            editorWindowRowsInserted(h->a + same, h->blen - same);
+            editorDiffViewRowsInserted(h->a + same, h->blen - same);
+            editorFoldRowsInserted(h->a + same, h->blen - same);
+        }
+    }
+
+    erow *rows = malloc(sizeof(erow) * (numrows ? numrows : 1));
+    int *stale = malloc(sizeof(int) * maxStale); // rows to highlight again, in order
+    int numstale = 0, src = 0, dst = 0;
+
+    for (int k = 0; k <= count; k++)
+    {
+        int a = (k < count) ? hunks[k].a : editor.numrows;
+
+        if (a > src) memcpy(&rows[dst], &editor.row[src], sizeof(erow) * (a - src));
+        dst += a - src;
+        src = a;
+        if (k == count) break;
+
+        const struct diffHunk *h = &hunks[k];
+        int same = h->alen < h->blen ? h->alen : h->blen;
+
+        for (int i = 0; i < same; i++, src++, dst++)
+        {
+            erow *row = &rows[dst];
+            const char *s = lines[h->b + i];
+            size_t len = lens[h->b + i];
+
+            *row = editor.row[src];
+            row->idx = dst;
+            if ((size_t)row->size == len && memcmp(row->chars, s, len) == 0) continue;
+
+            editorRowFreeChars(row);
+            row->chars = malloc(len + 1);
+            memcpy(row->chars, s, len);
+            row->chars[len] = '\0';
+            row->size = len;
+            editorUpdateRender(row);
+            stale[numstale++] = dst;
+        }
+
+        for (; src < h->a + h->alen; src++)
+        {
+            editorTrigramRowRemoved(&editor.row[src]);
+            editorFreeRow(&editor.row[src]);
+        }
+        for (int i = same; i < h->blen; i++, dst++)
+        {
+            rowInit(&rows[dst], dst, lines[h->b + i], lens[h->b + i]);
+            stale[numstale++] = dst;
+        }
+
+        // the row after the hunk follows other rows than before, which may have opened or closed a comment
+        if (h->alen != h->blen && dst < numrows) stale[numstale++] = dst;
+    }
+
+    free(editor.row);
+    editor.row = rows;
+    editor.numrows = numrows;
+    for (int i = 0; i < numrows; i++) editor.row[i].idx = i;
+
+    editorUpdateSyntaxRows(stale, numstale);
+    free(stale);
+
+    editor.unsaved++;
 }
 
 /**
@@ -81,24 +266,57 @@ void editorInsertRow(int at, char *s, size_t len)
 */
 void editorUpdateRow(erow *row)
 {
+    editorUpdateRender(row);
+    editorUpdateSyntax(row);
+}
+
+/**
+ * @brief Expands `row->chars` into `row->render` without touching the highlighting.
+ * @param row The row to render.
+*/
+void editorUpdateRender(erow *row)
+{
+    // every change to `chars` ends up here
+    editorTrigramRowChanged(row);
+    editorDiffViewRowChanged(row->idx);
+    editorRenderRow(row);
+}
+
+/**
+ * @brief Expands `chars` from `from` into `render`: the whole row, or the window of a long row.
+*/
+static void rowRender(erow *row, int from)
+{
+    int to = row->size, rx = 0;
+
+    if (row->window)
+    {
+        if (from + LONG_ROW_WINDOW < row->size) to = from + LONG_ROW_WINDOW;
+        rx = editorRowCxToRx(row, from);
+
+        row->window->cstart = from;
+        row->window->cend = to;
+        row->window->rstart = rx;
+    }
+
     int tabs = 0;
 
     // count tabs in a row
-    for (int i = 0; i < row->size; i++)
+    for (int i = from; i < to; i++)
         if (row->chars[i] == '\t') tabs++;
     
     free(row->render);
-    row->render = malloc(row->size + tabs*(TAB_STOP - 1) + 1);
+    row->render = malloc(to - from + tabs*(TAB_STOP - 1) + 1);
 
     int idx = 0;
 
     // copy string
-    for (int j = 0; j < row->size; j++)
+    for (int j = from; j < to; j++)
     {  
         if (row->chars[j] == '\t')
         {
             row->render[idx++] = ' ';
-            while (idx % TAB_STOP != 0) row->render[idx++] = ' ';
+            while ((rx + idx) % TAB_STOP != 0) row->render[idx++] = ' ';
         }
         else 
         {
@@ -108,42 +326,91 @@ void editorUpdateRow(erow *row)
 
     row->render[idx] = '\0';
     row->rsize = idx;
+}
 
+/**
+ * @brief Rebuilds `row->render` from `row->chars`, for rows whose text did not change, such as
+ * @brief those of a buffer shown again after its caches were dropped.
+ * @note A row longer than `LONG_ROW_BYTES` only renders a window of `LONG_ROW_WINDOW` bytes, kept
+ * @note where it was so an edit in view costs the same as on a short row.
+ * @param row The row to render.
+*/
+void editorRenderRow(erow *row)
+{
+    if (row->size <= LONG_ROW_BYTES)
+    {
+        free(row->window);
+        row->window = NULL;
+        rowRender(row, 0);
+        return;
+    }
+
+    if (row->window == NULL) row->window = calloc(1, sizeof(struct erowWindow));
+    rowRender(row, row->window->cstart < row->size ? row->window->cstart : row->size);
+}
+
+/**
+ * @brief Moves the window of a long row so it holds render columns `rx` to `rx + width`, and
+ * @brief highlights it again. Windows start on `LONG_ROW_WINDOW / 4` byte boundaries, so
+ * @brief scrolling sideways only moves them now and then.
+*/
+void editorRenderWindow(erow *row, int rx, int width)
+{
+    struct erowWindow *w = row->window;
+    if (w->rstart <= rx && (rx + width <= w->rstart + row->rsize || w->cend == row->size)) return;
+
+    int cx = editorRowRxToCx(row, rx);
+    rowRender(row, cx - cx % (LONG_ROW_WINDOW / 4));
     editorUpdateSyntax(row);
 }
 
+/**
+ * @return Render width of the whole row, also for a long row holding a window.
+*/
+int editorRowWidth(erow *row)
+{
+    return row->window ? editorRowCxToRx(row, row->size) : row->rsize;
+}
+
 /**
  * @brief Handles cursor action with tabs.
 */
 int editorRowCxToRx(erow *row, int cx) // teleports to skip tabs
 {
-    int rx = 0;
-    
-    for (int j = 0; j < cx; j++)
+    int rx = 0, from = 0;
+    const char *tab;
+
+    // runs without tabs are one column per byte, so only tabs need looking at
+    while (from < cx && (tab = memchr(&row->chars[from], '\t', cx - from)) != NULL)
     {
-        if (row->chars[j] == '\t')
-            rx += (TAB_STOP-1) - (rx % TAB_STOP);
-        rx++;
+        rx += tab - &row->chars[from];
+        rx += TAB_STOP - (rx % TAB_STOP);
+        from = tab - row->chars + 1;
     }
 
-    return rx;
+    return rx + (cx - from);
 }
 
 int editorRowRxToCx(erow *row, int rx)
 {
-    int cur_rx = 0;
-    int cx;
+    int cur_rx = 0, from = 0;
 
-    for (cx = 0; cx < row->size; cx++)
+    while (from < row->size)
     {
-        if (row->chars[cx] == '\t')
-            cur_rx += (TAB_STOP - 1) - (cur_rx % TAB_STOP);
-        cur_rx++;
+        const char *tab = memchr(&row->chars[from], '\t', row->size - from);
+        int run = (tab ? tab - row->chars : row->size) - from;
 
-        if (cur_rx > rx) return cx;
+        if (rx < cur_rx + run) return from + (rx > cur_rx ? rx - cur_rx : 0);
+        if (tab == NULL) break;
+
+        cur_rx += run;
+        from += run;
+        cur_rx += TAB_STOP - (cur_rx % TAB_STOP);
+        if (cur_rx > rx) return from;
+        from++;
     }
 
-    return cx;
+    return row->size;
 }
 
 /**
@@ -156,6 +423,10 @@ void editorRowInsertChar(erow *row, int at, int c)
 {
     if (at < 0 || at > row->size) at = row->size;
 
+    char ch = c;
+    editorUndoChange(row->idx, at, NULL, 0, &ch, 1);
+    editorRowWritable(row);
+
     row->chars = realloc(row->chars, row->size + 2);
 
     memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
@@ -169,38 +440,170 @@ void editorRowInsertChar(erow *row, int at, int c)
 }
 
 /**
- * @brief Converts all of text rows into a singular string each separated by `\n`.
- * @param buflen (type `int *`) Points to the length of the entire file.
- * @returns `buf` - (type `char *`) All of the rows converted to string form.
+ * @brief Inserts a string into a row with a single reallocation and a single row update.
+ * @param row (type `erow *`) Pointer to the row being modified.
+ * @param at (type `int`) The index in `row->chars` to insert at.
+ * @param s (type `const char *`) The string to be inserted.
+ * @param len (type `size_t`) Length of the string.
 */
-char *editorRowsToString(int *buflen) 
+void editorRowInsertString(erow *row, int at, const char *s, size_t len)
 {
-    int totalLen = 0;
-    
-    for (int i = 0; i < editor.numrows; i++)
+    if (at < 0 || at > row->size) at = row->size;
+
+    editorUndoChange(row->idx, at, NULL, 0, s, len);
+    editorRowWritable(row);
+
+    row->chars = realloc(row->chars, row->size + len + 1);
+
+    memmove(&row->chars[at + len], &row->chars[at], row->size - at + 1);
+    memcpy(&row->chars[at], s, len);
+
+    row->size += len;
+
+    editorUpdateRow(row);
+    editor.unsaved++;
+}
+
+/*
+ * Saving writes a snapshot of the rows from a job, so editing carries on while a large file is
+ * written. The snapshot only copies the rows' `chars` pointers. A row still shared with it gets
+ * its own copy before its first change, and `chars` dropped meanwhile are kept until the write
+ * is done.
+*/
+
+struct saveRow
+{
+    const char *chars;
+    int size;
+};
+
+static struct
+{
+    struct editorJobToken *token; // NULL once the save is finished
+    int running;
+    unsigned int gen; // marks the rows shared with the snapshot, see `erow.snapshot`
+
+    struct saveRow *rows;
+    int numrows;
+    size_t total;
+    char *fileName;
+    int unsaved; // `editor.unsaved` when the snapshot was taken
+
+    atomic_size_t written;
+    int error;
+    uint64_t hash;
+    struct undoDiskWrite *history; // undo records written after the text
+
+    char **retired; // `chars` only the snapshot still uses
+    int numretired, retiredcap;
+    int timer;
+} save = { .timer = -1 };
+
+/**
+ * @brief Frees `chars` once the save in progress no longer reads them.
+*/
+static void saveRetire(char *chars)
+{
+    if (save.numretired == save.retiredcap)
     {
-        totalLen += editor.row[i].size + 1;
+        save.retiredcap = save.retiredcap ? save.retiredcap * 2 : 64;
+        save.retired = realloc(save.retired, sizeof(char *) * save.retiredcap);
     }
+    save.retired[save.numretired++] = chars;
+}
+
+/**
+ * @brief Hands `chars` dropped by a row to whoever still reads them: the save in progress, or
+ * @brief registers yanked from the row. The save goes first and passes them on when it is done.
+*/
+static void saveReleaseChars(char *chars, int snapshot, int yanked)
+{
+    if (snapshot) saveRetire(chars);
+    else if (!yanked || !editorClipTake(chars)) free(chars);
+}
+
+/**
+ * @brief Gives `row` its own copy of `chars` if the save in progress is still writing them or a
+ * @brief register holds them. Called before `chars` is changed in place or reallocated.
+*/
+void editorRowWritable(erow *row)
+{
+    int snapshot = save.running && row->snapshot == save.gen;
+    int yanked = row->yanked && editorClipHolds(row->chars);
+
+    row->yanked = 0;
+    if (!snapshot && !yanked) return;
 
-    *buflen = totalLen;
+    char *chars = malloc(row->size + 1);
+    memcpy(chars, row->chars, row->size + 1);
+    saveReleaseChars(row->chars, snapshot, yanked);
 
-    char *buf = (char *)malloc(totalLen * sizeof(char));
-    char *p = buf;
+    row->chars = chars;
+    row->snapshot = 0;
+}
+
+/**
+ * @brief Frees `row->chars`, or leaves them to the save in progress or the registers.
+*/
+void editorRowFreeChars(erow *row)
+{
+    saveReleaseChars(row->chars, save.running && row->snapshot == save.gen, row->yanked);
+
+    row->chars = NULL;
+    row->snapshot = 0;
+    row->yanked = 0;
+}
 
-    // MODIFY CODE: String appending.
-    for (int j = 0; j < editor.numrows; j++)
+/**
+ * @brief Gathers the snapshot into chunks for `write`, hashing them on the way.
+*/
+struct saveWriter
+{
+    int fd;
+    char *chunk;
+    size_t used;
+    struct undoHashState hash;
+};
+
+static int saveFlush(struct saveWriter *w)
+{
+    editorUndoHashUpdate(&w->hash, w->chunk, w->used);
+
+    size_t done = 0;
+    while (done < w->used)
     {
-        memcpy(p, editor.row[j].chars, editor.row[j].size);
-        p += editor.row[j].size;
-        *p = '\n';
-        p++;
+        ssize_t n = write(w->fd, &w->chunk[done], w->used - done);
+        if (n == -1)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += n;
+        atomic_fetch_add(&save.written, n);
     }
 
-    return buf;
+    w->used = 0;
+    return 0;
+}
+
+static int saveAppend(struct saveWriter *w, const char *s, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n = SAVE_CHUNK - w->used;
+        if (n > len) n = len;
+        memcpy(&w->chunk[w->used], s, n);
+        w->used += n;
+        s += n;
+        len -= n;
+
+        if (w->used == SAVE_CHUNK && saveFlush(w) == -1) return -1;
+    }
+    return 0;
 }
 
 /**
- * @brief Gets the string from `editorRowsToString` and saves it into a file.
+ * @brief Job writing the snapshot to `save.fileName`.
  * @note The normal way of truncating a file would be to add a `O_TRUNC` flag to `open()`
  * @note However, the approach of using `ftruncate` would be safer, since it simply "crops" out
  * @note additional data (if previous file size is larger than length) or adds more bytes 
@@ -208,8 +611,111 @@ char *editorRowsToString(int *buflen)
  * @note flag, the whole file is erased first before writing. This is dangerous if the `write`
  * @note call fails, you'd end up with an empty file.
 */
+static void saveWrite(void *arg, struct editorJobToken *token)
+{
+    (void)arg;
+    (void)token;
+
+    // `O_CREAT` tells `open()` to create a new file if file does not exist.
+    // `O_RDWR` opens the file for reading and writing.
+    // `0644` are the permissions for the text file. Owner gets read and write, everyone else read only.
+    struct saveWriter w = { .fd = open(save.fileName, O_RDWR | O_CREAT, 0644) };
+    if (w.fd == -1)
+    {
+        save.error = errno;
+        return;
+    }
+
+    w.chunk = malloc(SAVE_CHUNK);
+    editorUndoHashInit(&w.hash, save.total);
+
+    // Set the file size of `fd` to `total`
+    int ok = ftruncate(w.fd, save.total) != -1;
+
+    for (int i = 0; ok && i < save.numrows; i++)
+    {
+        ok = saveAppend(&w, save.rows[i].chars, save.rows[i].size) != -1 &&
+            saveAppend(&w, "\n", 1) != -1;
+    }
+    if (ok && w.used) ok = saveFlush(&w) != -1;
+
+    if (!ok) save.error = errno;
+    if (close(w.fd) == -1 && ok) save.error = errno;
+    free(w.chunk);
+
+    save.hash = editorUndoHashFinal(&w.hash);
+    if (!save.error) editorUndoSaveWrite(save.history, save.hash);
+}
+
+/**
+ * @brief Takes the result of a written snapshot in, on the main thread.
+*/
+static void saveFinish()
+{
+    editorJobTokenRelease(save.token);
+    save.token = NULL;
+    save.running = 0;
+    editorEventArmTimer(save.timer, 0, 0);
+
+    for (int i = 0; i < save.numretired; i++) saveReleaseChars(save.retired[i], 0, 1);
+    save.numretired = 0;
+    free(save.rows);
+    save.rows = NULL;
+
+    editorEventRequestRedraw();
+
+    if (save.error)
+    {
+        // the rows are untouched and stay modified
+        free(save.fileName);
+        save.fileName = NULL;
+        editorUndoSaveFailed(save.history);
+        save.history = NULL;
+        editorSetStatusMessage("Save failed. I/O error: %s", strerror(save.error));
+        return;
+    }
+
+    editorFollowSaved(save.fileName, save.total);
+    editorReloadSaved(save.fileName);
+    free(save.fileName);
+    save.fileName = NULL;
+
+    editorUndoSaved(save.history);
+    save.history = NULL;
+
+    // edits made during the save are not on disk
+    if (editor.unsaved == save.unsaved) editor.unsaved = 0;
+    editorSetStatusMessage("\x1b[32;1mSave success.\x1b[m \x1b[1m%zu bytes\x1b[m written to disk.", save.total);
+}
+
+static void saveDone(void *arg, struct editorJobToken *token)
+{
+    (void)arg;
+
+    // already finished by `editorSaveWait`
+    if (token != save.token) return;
+    saveFinish();
+}
+
+/**
+ * @brief Timer callback redrawing the progress shown in the status bar.
+*/
+static void saveProgress(int fd, void *arg)
+{
+    (void)fd;
+    (void)arg;
+    editorEventRequestRedraw();
+}
+
+/**
+ * @brief Snapshots the rows and writes them to the file from a job. The status bar shows the
+ * @brief progress and the message bar the outcome, see `saveFinish`.
+*/
 void editorSave()
 {
+    // one save at a time
+    editorSaveWait();
+
     if (editor.fileName == NULL) 
     {
         editor.fileName = editorPrompt("Save as (Ctrl-X to cancel): %s", NULL);
@@ -219,36 +725,73 @@ void editorSave()
             return;
         }
         editorSelectSyntaxHighlight();
+        editorReloadTrack(editor.fileName);
     }
 
-    int len;
-    char *buf = editorRowsToString(&len);
+    // the file was changed elsewhere since it was read
+    if (!editorReloadConfirmSave())
+    {
+        editorSetStatusMessage("Save aborted.");
+        return;
+    }
 
-    // `O_CREAT` tells `open()` to create a new file if file does not exist.
-    // `O_RDWR` opens the file for reading and writing.
-    // `0644` are the permissions for the text file. Owner gets read and write, everyone else read only.
-    int fd = open(editor.fileName, O_RDWR | O_CREAT, 0644);
+    // a history file kept from an earlier session is checked against the old text
+    save.history = editorUndoBeforeSave();
 
-    if (fd != -1)
+    save.gen++;
+    save.rows = malloc(sizeof(struct saveRow) * (editor.numrows ? editor.numrows : 1));
+    save.numrows = editor.numrows;
+    save.total = 0;
+
+    for (int i = 0; i < editor.numrows; i++)
     {
-    // Set the file size of `fd` to `len`
-        if (ftruncate(fd, len) != -1)
-        {
-            if (write(fd, buf, len) == len)
-            {
-                close(fd);
-                free(buf);
-
-                editor.unsaved = 0;
-                editorSetStatusMessage("\x1b[32;1mSave success.\x1b[m \x1b[1m%d bytes\x1b[m written to disk.", len);
-                return;
-            }
-        }
-        close(fd);
+        erow *row = &editor.row[i];
+        save.rows[i].chars = row->chars;
+        save.rows[i].size = row->size;
+        row->snapshot = save.gen;
+        save.total += row->size + 1;
     }
 
-    free(buf);
-    editorSetStatusMessage("Save failed. I/O error: %s", strerror(errno));
+    save.fileName = strdup(editor.fileName);
+    save.unsaved = editor.unsaved;
+    save.error = 0;
+    atomic_store(&save.written, 0);
+    save.running = 1;
+    save.token = editorJobTokenNew();
+
+    if (save.timer == -1) save.timer = editorEventAddTimer(SAVE_PROGRESS_MS, 1, saveProgress, NULL);
+    else editorEventArmTimer(save.timer, SAVE_PROGRESS_MS, 1);
+
+    editorJobSubmit(save.token, saveWrite, saveDone, NULL);
+}
+
+/**
+ * @brief Blocks until the save in progress, if any, is written and finished. Called before the
+ * @brief rows are handed to another buffer and before quitting.
+*/
+void editorSaveWait()
+{
+    if (!save.running) return;
+
+    editorJobWait(save.token);
+    saveFinish();
+}
+
+int editorSaveRunning()
+{
+    return save.running;
+}
+
+/**
+ * @brief Writes the progress of the save in progress for the status bar.
+ * @return Length written, 0 if no save is running.
+*/
+int editorSaveStatus(char *buf, int size)
+{
+    if (!save.running) return 0;
+
+    size_t written = atomic_load(&save.written);
+    return snprintf(buf, size, "saving %d%%", save.total ? (int)(written * 100 / save.total) : 100);
 }
 
 /**
@@ -259,7 +802,9 @@ void editorSave()
 void editorRowDelChar(erow *row, int at)
 {
     if (at < 0 || at >= row->size) return;
-    
+
+    editorUndoChange(row->idx, at, &row->chars[at], 1, NULL, 0);
+    editorRowWritable(row);
     memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
 
     row->size--;
@@ -270,13 +815,14 @@ void editorRowDelChar(erow *row, int at)
 }
 
 /**
- * @brief Frees `row->render` and `row->chars`.
+ * @brief Frees `row->render`, `row->chars` and `row->hl`.
  * @param row (type `erow *`) Pointer to the row to be freed.
 */
 void editorFreeRow(erow *row)
 {
     free(row->render);
-    free(row->chars);
+    free(row->window);
+    editorRowFreeChars(row);
     free(row->hl);
 }
 
@@ -287,6 +833,11 @@ void editorFreeRow(erow *row)
 void editorDelRow(int at)
 {
     if (at < 0 || at >= editor.numrows) return;
+    editorUndoRowsDeleted(at, 1);
+    editorWindowRowsDeleted(at, 1);
+    editorDiffViewRowsDeleted(at, 1);
+    editorFoldRowsDeleted(at, 1);
+    editorTrigramRowRemoved(&editor.row[at]);
     editorFreeRow(&editor.row[at]);
 
     memmove(&editor.row[at], &editor.row[at + 1], sizeof(erow) * (editor.numrows - at - 1));
@@ -296,6 +847,35 @@ void editorDelRow(int at)
     editor.unsaved++;
 }
 
+/**
+ * @brief Deletes `n` rows starting at `at` with a single `memmove`, the counterpart of `editorInsertRows`.
+ * @param at (type `int`) Index of the first row to be deleted.
+ * @param n (type `int`) Number of rows to be deleted.
+*/
+void editorDelRows(int at, int n)
+{
+    if (at < 0 || n <= 0 || at + n > editor.numrows) return;
+    editorUndoRowsDeleted(at, n);
+    editorWindowRowsDeleted(at, n);
+    editorDiffViewRowsDeleted(at, n);
+    editorFoldRowsDeleted(at, n);
+
+    for (int i = at; i < at + n; i++)
+    {
+        editorTrigramRowRemoved(&editor.row[i]);
+        editorFreeRow(&editor.row[i]);
+    }
+
+    memmove(&editor.row[at], &editor.row[at + n], sizeof(erow) * (editor.numrows - at - n));
+    for (int j = at; j < editor.numrows - n; j++) editor.row[j].idx -= n;
+
+    editor.numrows -= n;
+    editor.unsaved++;
+
+    // a multiline comment opened or closed by the deleted rows changes the rows below
+    if (at < editor.numrows) editorUpdateSyntax(&editor.row[at]);
+}
+
 /**
  * @brief Reallocates `row->chars` and appends string to the row.
  * @param row (type `erow *`) The row to be appended on.
@@ -304,6 +884,9 @@ void editorDelRow(int at)
 */
 void editorRowAppendString(erow *row, char *s, size_t len)
 {
+    editorUndoChange(row->idx, row->size, NULL, 0, s, len);
+    editorRowWritable(row);
+
     row->chars = realloc(row->chars, row->size + len + 1);
     memcpy(&row->chars[row->size], s, len);
 
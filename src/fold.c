@@ -0,0 +1,460 @@
+#include "../lib/fold.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/output.h"
+#include <stdlib.h>
+
+/*
+ * Closed folds hide the rows after a header row, down to its matching brace or, without one, the
+ * last row indented deeper than it. They are kept in a treap in row order where each node only
+ * knows the rows since the previous fold and the rows it hides, summed over its subtree. Finding
+ * a row, translating between rows and screen lines and shifting every fold below an edit all
+ * walk one path, O(log n) in the number of folds. Rows inserted into a fold, or deleting its
+ * header or hidden rows, open it.
+*/
+
+struct foldNode
+{
+    struct foldNode *left, *right;
+    unsigned prio;
+    int gap; // rows from the end of the previous fold to this one's first hidden row, its header included
+    int len; // rows hidden
+    int span, hidden; // `gap + len` and `len` summed over the subtree
+};
+
+static struct
+{
+    struct foldNode *root;
+    unsigned seed;
+} folds = { .seed = 2463534242u };
+
+static int foldSpan(const struct foldNode *t)
+{
+    return t ? t->span : 0;
+}
+
+static int foldHidden(const struct foldNode *t)
+{
+    return t ? t->hidden : 0;
+}
+
+static void foldPull(struct foldNode *t)
+{
+    t->span = foldSpan(t->left) + t->gap + t->len + foldSpan(t->right);
+    t->hidden = foldHidden(t->left) + t->len + foldHidden(t->right);
+}
+
+static struct foldNode *foldMerge(struct foldNode *a, struct foldNode *b)
+{
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+
+    if (a->prio > b->prio)
+    {
+        a->right = foldMerge(a->right, b);
+        foldPull(a);
+        return a;
+    }
+    b->left = foldMerge(a, b->left);
+    foldPull(b);
+    return b;
+}
+
+/**
+ * @brief Splits `t`, whose rows start at `base`, into the folds starting (or with `byEnd`,
+ * @brief ending) before `row` and the rest. Gaps stay relative to the fold before, so merging
+ * @brief the two back in order gives `t` again.
+*/
+static void foldSplit(struct foldNode *t, int base, int row, int byEnd, struct foldNode **l, struct foldNode **r)
+{
+    if (t == NULL)
+    {
+        *l = *r = NULL;
+        return;
+    }
+
+    int start = base + foldSpan(t->left) + t->gap;
+    int key = byEnd ? start + t->len - 1 : start;
+
+    if (key < row)
+    {
+        foldSplit(t->right, start + t->len, row, byEnd, &t->right, r);
+        *l = t;
+    }
+    else
+    {
+        foldSplit(t->left, base, row, byEnd, l, &t->left);
+        *r = t;
+    }
+    foldPull(t);
+}
+
+/**
+ * @brief Adds `n` rows to the gap before the first fold of `t`, moving all of them.
+*/
+static void foldShiftFirst(struct foldNode *t, int n)
+{
+    if (t == NULL) return;
+
+    if (t->left) foldShiftFirst(t->left, n);
+    else t->gap += n;
+    foldPull(t);
+}
+
+/**
+ * @brief Frees a tree of folds, such as one set aside by `editorFoldDetach`.
+*/
+void editorFoldFree(struct foldNode *t)
+{
+    if (t == NULL) return;
+    editorFoldFree(t->left);
+    editorFoldFree(t->right);
+    free(t);
+}
+
+/**
+ * @brief Finds the fold hiding `row`.
+ * @return 1 and its first hidden row and length, or 0 if the row is shown.
+*/
+static int foldFind(int row, int *start, int *len)
+{
+    struct foldNode *t = folds.root;
+    int base = 0;
+
+    while (t)
+    {
+        int s = base + foldSpan(t->left) + t->gap;
+        if (row < s)
+        {
+            t = t->left;
+        }
+        else if (row < s + t->len)
+        {
+            *start = s;
+            *len = t->len;
+            return 1;
+        }
+        else
+        {
+            base = s + t->len;
+            t = t->right;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the fold whose first hidden row is `start`, its rows join the gap of the next one.
+*/
+static void foldOpen(int start)
+{
+    struct foldNode *a, *m, *c;
+    foldSplit(folds.root, 0, start, 0, &a, &m);
+    foldSplit(m, foldSpan(a), start + 1, 0, &m, &c);
+
+    if (m) foldShiftFirst(c, m->span);
+    editorFoldFree(m);
+    folds.root = foldMerge(a, c);
+}
+
+/**
+ * @brief Hides rows `start`..`end`, along with the closed folds overlapping them.
+*/
+static void foldClose(int start, int end)
+{
+    struct foldNode *a, *m, *c;
+    foldSplit(folds.root, 0, start, 1, &a, &m);
+    int base = foldSpan(a);
+    foldSplit(m, base, end + 1, 0, &m, &c);
+
+    if (m)
+    {
+        struct foldNode *first = m;
+        while (first->left) first = first->left;
+
+        if (base + first->gap < start) start = base + first->gap;
+        if (base + m->span - 1 > end) end = base + m->span - 1;
+    }
+
+    struct foldNode *f = malloc(sizeof(struct foldNode));
+    folds.seed ^= folds.seed << 13;
+    folds.seed ^= folds.seed >> 17;
+    folds.seed ^= folds.seed << 5;
+
+    f->left = f->right = NULL;
+    f->prio = folds.seed;
+    f->gap = start - base;
+    f->len = end - start + 1;
+    foldPull(f);
+
+    foldShiftFirst(c, foldSpan(m) - f->gap - f->len);
+    editorFoldFree(m);
+    folds.root = foldMerge(foldMerge(a, f), c);
+}
+
+/**
+ * @brief Screen line of shown row `row`, counted from the first row.
+*/
+int editorFoldToScreen(int row)
+{
+    struct foldNode *t = folds.root;
+    int base = 0, hidden = 0;
+
+    while (t)
+    {
+        int s = base + foldSpan(t->left) + t->gap;
+        if (row < s)
+        {
+            t = t->left;
+            continue;
+        }
+        hidden += foldHidden(t->left) + (row - s < t->len ? row - s : t->len);
+        base = s + t->len;
+        t = t->right;
+    }
+    return row - hidden;
+}
+
+/**
+ * @brief Row shown on screen line `line`, counted from the first row.
+*/
+int editorFoldToFile(int line)
+{
+    struct foldNode *t = folds.root;
+    int base = 0, hidden = 0;
+
+    while (t)
+    {
+        int s = base + foldSpan(t->left) + t->gap;
+        if (line < s - hidden - foldHidden(t->left))
+        {
+            t = t->left;
+            continue;
+        }
+        hidden += foldHidden(t->left) + t->len;
+        base = s + t->len;
+        t = t->right;
+    }
+    return line + hidden;
+}
+
+/**
+ * @brief The shown row nearest to `row`: itself, the header of its fold (`dir` < 0) or the row
+ * @brief after the fold.
+*/
+int editorFoldSkip(int row, int dir)
+{
+    int start, len;
+
+    // a fold's header may be the last row of the fold before
+    while (foldFind(row, &start, &len)) row = dir < 0 ? start - 1 : start + len;
+    return row;
+}
+
+/**
+ * @brief Rows hidden under `row` if it is the header of a closed fold, else 0.
+*/
+int editorFoldLength(int row)
+{
+    int start, len;
+    return foldFind(row + 1, &start, &len) && start == row + 1 ? len : 0;
+}
+
+/**
+ * @brief Opens the folds hiding `row`, so a jump to it shows it.
+*/
+void editorFoldReveal(int row)
+{
+    int start, len;
+    while (foldFind(row, &start, &len)) foldOpen(start);
+}
+
+/**
+ * @brief Leading whitespace of a row in columns, -1 for a blank row.
+*/
+static int foldIndent(const erow *row)
+{
+    int width = 0;
+
+    for (int i = 0; i < row->size; i++)
+    {
+        if (row->chars[i] == ' ') width++;
+        else if (row->chars[i] == '\t') width += TAB_STOP - (width % TAB_STOP);
+        else return width;
+    }
+    return -1;
+}
+
+/**
+ * @brief Adds the braces of a row to `depth`, leaving out strings and `//` comments.
+ * @return 1 if a closing brace brought `depth` back to 0, the rest of the row is then skipped
+ * @return unless `whole`.
+*/
+static int foldBraces(const erow *row, int *depth, int whole)
+{
+    char quote = 0;
+
+    for (int i = 0; i < row->size; i++)
+    {
+        char c = row->chars[i];
+
+        if (quote)
+        {
+            if (c == '\\') i++;
+            else if (c == quote) quote = 0;
+        }
+        else if (c == '"' || c == '\'') quote = c;
+        else if (c == '/' && i + 1 < row->size && row->chars[i + 1] == '/') break;
+        else if (c == '{') (*depth)++;
+        else if (c == '}' && *depth > 0 && --(*depth) == 0 && !whole) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Last row of the fold `header` starts: where the brace it leaves open closes, or the last
+ * @brief row indented deeper than it.
+ * @return The row, or -1 if `header` starts no fold.
+*/
+static int foldEnd(int header)
+{
+    erow *row = editor.row;
+    int depth = 0;
+
+    // braces the header closes, as in `} else {`, do not count
+    foldBraces(&row[header], &depth, 1);
+
+    if (depth > 0)
+    {
+        for (int y = header + 1; y < editor.numrows; y++)
+        {
+            if (foldBraces(&row[y], &depth, 0)) return y;
+        }
+        return -1;
+    }
+
+    int indent = foldIndent(&row[header]), end = -1;
+    if (indent < 0) return -1;
+
+    for (int y = header + 1; y < editor.numrows; y++)
+    {
+        int i = foldIndent(&row[y]);
+        if (i < 0) continue;
+        if (i <= indent) break;
+        end = y;
+    }
+    return end;
+}
+
+/**
+ * @brief Closes the fold started by the cursor's row or, failing that, the innermost one around
+ * @brief it. On the header of a closed fold, opens it.
+*/
+void editorFoldToggle()
+{
+    if (editor.cy >= editor.numrows)
+    {
+        editorSetStatusMessage("Nothing to fold here.");
+        return;
+    }
+
+    int len = editorFoldLength(editor.cy);
+    if (len)
+    {
+        foldOpen(editor.cy + 1);
+        editorSetStatusMessage("Unfolded %d lines.", len);
+        return;
+    }
+
+    int header = editor.cy, end = foldEnd(header);
+    int found = end > editor.cy;
+
+    // the headers around the row are indented less, the nearest one first
+    int indent = foldIndent(&editor.row[header]);
+    for (int y = header - 1; !found && y >= 0 && indent != 0; y--)
+    {
+        int i = foldIndent(&editor.row[y]);
+        if (i < 0 || (indent > 0 && i >= indent)) continue;
+
+        indent = i;
+        header = y;
+        end = foldEnd(y);
+        found = end >= editor.cy;
+    }
+
+    if (!found)
+    {
+        editorSetStatusMessage("Nothing to fold here.");
+        return;
+    }
+
+    foldClose(header + 1, end);
+    editor.cy = header;
+    editor.cx = 0;
+    editorSetStatusMessage("Folded %d lines. Ctrl-] on the header unfolds them, Ctrl-\\ unfolds all.",
+        editorFoldLength(header));
+}
+
+/**
+ * @brief Opens every fold.
+*/
+void editorFoldOpenAll()
+{
+    editorFoldFree(folds.root);
+    folds.root = NULL;
+    editorSetStatusMessage("Unfolded everything.");
+}
+
+/**
+ * @brief Called when `n` rows are inserted at `at`: a fold they land in opens, the ones below move
+ * @brief down.
+*/
+void editorFoldRowsInserted(int at, int n)
+{
+    if (folds.root == NULL) return;
+
+    struct foldNode *a, *m, *c;
+    foldSplit(folds.root, 0, at, 1, &a, &c);
+    foldSplit(c, foldSpan(a), at + 1, 0, &m, &c);
+
+    foldShiftFirst(c, n + foldSpan(m));
+    editorFoldFree(m);
+    folds.root = foldMerge(a, c);
+}
+
+/**
+ * @brief Called when `n` rows are deleted at `at`: folds losing their header or hidden rows open,
+ * @brief the ones below move up.
+*/
+void editorFoldRowsDeleted(int at, int n)
+{
+    if (folds.root == NULL) return;
+
+    struct foldNode *a, *m, *c;
+    foldSplit(folds.root, 0, at, 1, &a, &c);
+    foldSplit(c, foldSpan(a), at + n + 1, 0, &m, &c);
+
+    foldShiftFirst(c, foldSpan(m) - n);
+    editorFoldFree(m);
+    folds.root = foldMerge(a, c);
+}
+
+/**
+ * @brief Sets the folds of the buffer being switched away from aside.
+ * @return The folds to hand back to `editorFoldRestore` when the buffer is shown again.
+*/
+struct foldNode *editorFoldDetach()
+{
+    struct foldNode *t = folds.root;
+    folds.root = NULL;
+    return t;
+}
+
+/**
+ * @brief Drops the current folds for ones set aside by `editorFoldDetach`, NULL for none.
+*/
+void editorFoldRestore(struct foldNode *t)
+{
+    editorFoldFree(folds.root);
+    folds.root = t;
+}
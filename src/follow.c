@@ -0,0 +1,205 @@
+#include "../lib/follow.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/event.h"
+#include "../lib/file_io.h"
+#include "../lib/output.h"
+#include "../lib/search.h"
+#include "../lib/undo.h"
+#include "../lib/watch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ * Follow mode (-f), like `tail -f`: bytes appended to the file are read from where the last read
+ * stopped and added as rows at the end, so only the new rows are rendered and highlighted. The
+ * rows come from the file rather than from editing, so they are not undone and do not mark the
+ * buffer modified.
+*/
+
+static struct
+{
+    char *path; // NULL unless following
+    off_t offset; // bytes of the file already in the rows
+    ino_t ino;
+    int partial; // the last row is a line the file has not ended yet
+    int timer; // continues a catch-up longer than `FOLLOW_READ_BYTES`, -1 until needed
+    char *buf;
+} follow = { .timer = -1 };
+
+/**
+ * @brief Adds `len` bytes read from the file to the end of the rows, completing a partial last
+ * @brief row first. Keeps the cursor at the end if it was there.
+*/
+static void followAppend(char *s, size_t len)
+{
+    int atEnd = editor.cy >= editor.numrows - 1;
+    int pastEnd = editor.cy == editor.numrows;
+    int unsaved = editor.unsaved;
+    size_t i = 0;
+
+    // search workers read the rows, even while the find prompt waits for keys
+    editorSearchCancel();
+    editorUndoSuspend();
+
+    if (follow.partial && editor.numrows)
+    {
+        erow *row = &editor.row[editor.numrows - 1];
+        char *nl = memchr(s, '\n', len);
+        size_t piece = nl ? (size_t)(nl - s) : len;
+
+        if (piece) editorRowAppendString(row, s, piece);
+        if (nl)
+        {
+            while (row->size > 0 && row->chars[row->size - 1] == '\r') editorRowDelChar(row, row->size - 1);
+            follow.partial = 0;
+        }
+        i = nl ? piece + 1 : len;
+    }
+
+    // one `editorInsertRows` for the lot, a line without its line break yet included
+    int n = 0, cap = 0;
+    char **lines = NULL;
+    size_t *lens = NULL;
+
+    while (i < len)
+    {
+        char *nl = memchr(&s[i], '\n', len - i);
+        size_t end = nl ? (size_t)(nl - s) : len;
+        size_t linelen = end - i;
+
+        if (nl) while (linelen > 0 && s[i + linelen - 1] == '\r') linelen--;
+        else follow.partial = 1;
+
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 256;
+            lines = realloc(lines, sizeof(char *) * cap);
+            lens = realloc(lens, sizeof(size_t) * cap);
+        }
+        lines[n] = &s[i];
+        lens[n++] = linelen;
+        i = end + 1;
+    }
+    editorInsertRows(editor.numrows, lines, lens, n);
+    free(lines);
+    free(lens);
+
+    editorUndoResume();
+    editor.unsaved = unsaved;
+
+    if (atEnd)
+    {
+        editor.cy = pastEnd ? editor.numrows : editor.numrows - 1;
+        editor.cx = 0;
+    }
+}
+
+static void followContinue(int fd, void *arg)
+{
+    (void)fd;
+    (void)arg;
+    editorFollowCheck();
+    editorEventRequestRedraw();
+}
+
+static void followChanged(const char *path, void *arg)
+{
+    (void)path;
+    (void)arg;
+    editorFollowCheck();
+}
+
+/**
+ * @brief Reads what was appended to the followed file since the last read, up to
+ * @brief `FOLLOW_READ_BYTES` per event loop turn. A file that was truncated or replaced, as when
+ * @brief logs rotate, is followed again from its start.
+ * @note Does nothing while another buffer is shown, the rows are caught up once it is back. Nor
+ * @note while a save is writing, which would read as appended bytes.
+*/
+void editorFollowCheck()
+{
+    if (follow.path == NULL || editor.fileName == NULL || strcmp(editor.fileName, follow.path)) return;
+    if (editorSaveRunning()) return;
+
+    int fd = open(follow.path, O_RDONLY);
+    if (fd == -1) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return;
+    }
+
+    if (st.st_ino != follow.ino || st.st_size < follow.offset)
+    {
+        editorSetStatusMessage("%.20s was %s, following it from the start.", follow.path,
+            st.st_ino != follow.ino ? "replaced" : "truncated");
+        follow.ino = st.st_ino;
+        follow.offset = 0;
+        follow.partial = 0;
+    }
+
+    size_t want = st.st_size - follow.offset;
+    if (want > FOLLOW_READ_BYTES) want = FOLLOW_READ_BYTES;
+
+    ssize_t n = want ? pread(fd, follow.buf, want, follow.offset) : 0;
+    close(fd);
+    if (n <= 0) return;
+
+    follow.offset += n;
+    followAppend(follow.buf, n);
+
+    // the rest on the next turns, so keys are still read in between
+    if (st.st_size > follow.offset)
+    {
+        if (follow.timer == -1) follow.timer = editorEventAddTimer(FOLLOW_SLICE_MS, 0, followContinue, NULL);
+        else editorEventArmTimer(follow.timer, FOLLOW_SLICE_MS, 0);
+    }
+}
+
+/**
+ * @brief Follows `fileName`, already opened with `editorOpen`, from its current end.
+*/
+void editorFollowStart(const char *fileName)
+{
+    struct stat st;
+    if (stat(fileName, &st) == -1) st.st_size = 0;
+
+    follow.path = strdup(fileName);
+    follow.offset = st.st_size;
+    follow.ino = st.st_ino;
+    follow.buf = malloc(FOLLOW_READ_BYTES);
+
+    // `editorOpen` made a row of an unterminated last line as well
+    char last = '\n';
+    int fd = open(fileName, O_RDONLY);
+    if (fd != -1)
+    {
+        if (st.st_size > 0 && pread(fd, &last, 1, st.st_size - 1) != 1) last = '\n';
+        close(fd);
+    }
+    follow.partial = last != '\n';
+
+    if (editorWatchAdd(fileName, followChanged, NULL) == -1)
+        editorSetStatusMessage("Can't follow %.20s: no inotify watch.", fileName);
+}
+
+/**
+ * @brief Called once a save is written: the file now holds the rows, `size` bytes of them, plus
+ * @brief whatever was appended meanwhile.
+*/
+void editorFollowSaved(const char *fileName, size_t size)
+{
+    if (follow.path == NULL || strcmp(fileName, follow.path)) return;
+
+    struct stat st;
+    if (stat(fileName, &st) == 0) follow.ino = st.st_ino;
+    follow.offset = size;
+    follow.partial = 0;
+    editorFollowCheck();
+}
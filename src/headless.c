@@ -0,0 +1,386 @@
+#include "../lib/headless.h"
+#include "../lib/editor.h"
+#include "../lib/buffer.h"
+#include "../lib/const.h"
+#include "../lib/terminal.h"
+#include "../lib/output.h"
+#include "../lib/event.h"
+#include "../lib/window.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+/**
+ * @brief State of a headless run: the script being played and the virtual screen frames are drawn into.
+*/
+static struct
+{
+    FILE *script;
+    int lineno;
+    struct abuf pending; // key bytes from the script not yet handed to the decoder
+    int pendingStart;
+
+    int rows, cols;
+    char *screen; // rows * cols cells
+    int cy, cx; // virtual cursor
+
+    FILE *dump;
+    int frames; // frames drawn
+    int dumps; // frames dumped
+} headless;
+
+static const struct
+{
+    const char *name;
+    const char *seq;
+} namedKeys[] = {
+    {"ENTER", "\r"}, {"TAB", "\t"}, {"BACKSPACE", "\x7f"}, {"ESC", "\x1b"},
+    {"UP", "\x1b[A"}, {"DOWN", "\x1b[B"}, {"RIGHT", "\x1b[C"}, {"LEFT", "\x1b[D"},
+    {"HOME", "\x1b[H"}, {"END", "\x1b[F"}, {"DEL", "\x1b[3~"},
+    {"PAGEUP", "\x1b[5~"}, {"PAGEDOWN", "\x1b[6~"},
+};
+
+/**
+ * @brief Prints a script error with its line number and exits.
+*/
+static void headlessError(const char *msg, const char *arg)
+{
+    fprintf(stderr, "script line %d: %s '%s'\n", headless.lineno, msg, arg);
+    exit(1);
+}
+
+/**
+ * @brief Appends `s` to the pending key bytes, expanding `\n`, `\r`, `\t`, `\e`, `\\` and `\xHH`.
+ * @note `\n` becomes '\r', which is what the Enter key sends in raw mode.
+*/
+static void headlessQueueEscaped(const char *s)
+{
+    for (; *s; s++)
+    {
+        char c = *s;
+
+        if (c == '\\' && s[1])
+        {
+            s++;
+            switch (*s)
+            {
+                case 'n': c = '\r'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'e': c = '\x1b'; break;
+                case 'x':
+                    if (isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2]))
+                    {
+                        char hex[3] = {s[1], s[2], '\0'};
+                        c = (char)strtol(hex, NULL, 16);
+                        s += 2;
+                    }
+                    break;
+                default: c = *s; break;
+            }
+        }
+
+        abAppend(&headless.pending, &c, 1);
+    }
+}
+
+/**
+ * @brief Queues the bytes of a named key such as `DOWN` or `CTRL-F`.
+*/
+static void headlessQueueKey(const char *name)
+{
+    if (!strncasecmp(name, "CTRL-", 5) && name[5] && !name[6])
+    {
+        char c = CTRL_KEY(name[5]);
+        abAppend(&headless.pending, &c, 1);
+        return;
+    }
+
+    for (unsigned int i = 0; i < sizeof(namedKeys) / sizeof(namedKeys[0]); i++)
+    {
+        if (!strcasecmp(name, namedKeys[i].name))
+        {
+            abAppend(&headless.pending, namedKeys[i].seq, strlen(namedKeys[i].seq));
+            return;
+        }
+    }
+
+    headlessError("unknown key", name);
+}
+
+/**
+ * @brief Parses `<cols>x<rows>` into the virtual screen size.
+ * @return 0 on success, -1 if malformed.
+*/
+static int headlessGeometry(const char *geometry, int *rows, int *cols)
+{
+    if (sscanf(geometry, "%dx%d", cols, rows) != 2 || *cols < 10 || *rows < 3) return -1;
+    return 0;
+}
+
+/**
+ * @brief (Re)allocates a blank virtual screen of `rows` x `cols`.
+*/
+static void headlessResize(int rows, int cols)
+{
+    headless.rows = rows;
+    headless.cols = cols;
+    headless.screen = realloc(headless.screen, rows * cols);
+    memset(headless.screen, ' ', rows * cols);
+    headless.cy = headless.cx = 0;
+
+    editorWindowResize(rows, cols);
+}
+
+/**
+ * @brief Prints the final frame if dumping and exits, called when the script runs out.
+*/
+static void headlessFinish()
+{
+    if (headless.dump)
+    {
+        editorRefreshScreen();
+        editorHeadlessDump();
+        fclose(headless.dump);
+    }
+    fclose(headless.script);
+    exit(0);
+}
+
+/**
+ * @brief Runs one script line. Key commands queue bytes, the rest act immediately.
+ * @note Commands: `type <text>`, `raw <bytes>`, `paste <text>`, `key <NAME> [count]`,
+ * @note `repeat <count> <command>`, `resize <cols>x<rows>`, `dump`, `save`, `wait <ms>`, `quit`, `# comment`.
+*/
+static void headlessCommand(char *line)
+{
+    while (isspace((unsigned char)*line)) line++;
+    if (*line == '\0' || *line == '#') return;
+
+    char *arg = line;
+    while (*arg && !isspace((unsigned char)*arg)) arg++;
+    if (*arg) *arg++ = '\0';
+
+    if (!strcmp(line, "type") || !strcmp(line, "raw"))
+    {
+        headlessQueueEscaped(arg);
+    }
+    else if (!strcmp(line, "paste"))
+    {
+        abAppend(&headless.pending, "\x1b[200~", 6);
+        headlessQueueEscaped(arg);
+        abAppend(&headless.pending, "\x1b[201~", 6);
+    }
+    else if (!strcmp(line, "key"))
+    {
+        char name[32];
+        int count = 1;
+        if (sscanf(arg, "%31s %d", name, &count) < 1) headlessError("missing key", arg);
+        while (count-- > 0) headlessQueueKey(name);
+    }
+    else if (!strcmp(line, "repeat"))
+    {
+        char *rest;
+        long count = strtol(arg, &rest, 10);
+        int restLen = strlen(rest);
+
+        // `headlessCommand` modifies its argument
+        char *copy = malloc(restLen + 1);
+        while (count-- > 0)
+        {
+            memcpy(copy, rest, restLen + 1);
+            headlessCommand(copy);
+        }
+        free(copy);
+    }
+    else if (!strcmp(line, "resize"))
+    {
+        int rows, cols;
+        if (headlessGeometry(arg, &rows, &cols) == -1) headlessError("bad geometry", arg);
+        headlessResize(rows, cols);
+    }
+    else if (!strcmp(line, "dump"))
+    {
+        editorHeadlessDump();
+    }
+    else if (!strcmp(line, "save"))
+    {
+        char c = CTRL_KEY('s');
+        abAppend(&headless.pending, &c, 1);
+    }
+    else if (!strcmp(line, "wait"))
+    {
+        editorEventRunFor(atoi(arg));
+    }
+    else if (!strcmp(line, "quit"))
+    {
+        headlessFinish();
+    }
+    else
+    {
+        headlessError("unknown command", line);
+    }
+}
+
+/**
+ * @brief Sets up a headless run: no terminal is touched, keys come from `script` and
+ * @brief frames are drawn into a virtual screen.
+ * @param script Path of the script to play.
+ * @param geometry Screen size as `<cols>x<rows>`, NULL for 80x24.
+ * @param dumpPath File to append frame dumps to, NULL for no dumps.
+ * @return 0 on success, -1 on failure.
+*/
+int editorHeadlessInit(const char *script, const char *geometry, const char *dumpPath)
+{
+    int rows = 24, cols = 80;
+    if (geometry && headlessGeometry(geometry, &rows, &cols) == -1) return -1;
+
+    headless.script = fopen(script, "r");
+    if (!headless.script) return -1;
+
+    if (dumpPath)
+    {
+        headless.dump = fopen(dumpPath, "w");
+        if (!headless.dump) return -1;
+    }
+
+    headless.rows = rows;
+    headless.cols = cols;
+    editor.headless = 1;
+    editorSetFrameSink(editorHeadlessFrame);
+
+    return 0;
+}
+
+/**
+ * @brief Window size for `initEditor` in headless mode, also allocates the virtual screen.
+*/
+void editorHeadlessWindowSize(int *rows, int *cols)
+{
+    headlessResize(headless.rows, headless.cols);
+    *rows = headless.rows;
+    *cols = headless.cols;
+}
+
+/**
+ * @brief Input source replacing the terminal. Hands out pending key bytes, reading further
+ * @brief script lines only when the decoder is waiting for a new key.
+ * @param timeout -1 when a new key is wanted, otherwise the decoder only wants the rest of a sequence.
+ * @return Number of bytes copied to `buf`, 0 if none.
+*/
+int editorHeadlessInput(char *buf, int size, int timeout)
+{
+    char *line = NULL;
+    size_t linecap = 0;
+
+    // background work finishes before the next key, so runs are reproducible
+    if (timeout == -1) editorEventWaitIdle();
+
+    while (headless.pendingStart == headless.pending.len && timeout == -1)
+    {
+        headless.pending.len = 0;
+        headless.pendingStart = 0;
+
+        ssize_t linelen = getline(&line, &linecap, headless.script);
+        if (linelen == -1)
+        {
+            free(line);
+            headlessFinish();
+        }
+        headless.lineno++;
+
+        while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+            line[--linelen] = '\0';
+
+        headlessCommand(line);
+    }
+    free(line);
+
+    int n = headless.pending.len - headless.pendingStart;
+    if (n > size) n = size;
+
+    memcpy(buf, &headless.pending.b[headless.pendingStart], n);
+    headless.pendingStart += n;
+
+    return n;
+}
+
+/**
+ * @brief Frame sink interpreting the escape sequences `editorRefreshScreen` emits
+ * @brief (cursor moves, erase line and screen) into the virtual screen. Colors are dropped.
+*/
+void editorHeadlessFrame(const char *s, int len)
+{
+    headless.frames++;
+
+    for (int i = 0; i < len; i++)
+    {
+        char c = s[i];
+
+        if (c == '\x1b' && i + 1 < len && s[i + 1] == '[')
+        {
+            int params[2] = {0, 0};
+            int np = 0;
+
+            i += 2;
+            if (i < len && s[i] == '?') i++;
+
+            for (; i < len; i++)
+            {
+                if (isdigit((unsigned char)s[i]))
+                {
+                    if (np < 2) params[np] = params[np] * 10 + (s[i] - '0');
+                }
+                else if (s[i] == ';') np++;
+                else break;
+            }
+            if (i == len) break;
+
+            switch (s[i])
+            {
+                case 'H':
+                    headless.cy = params[0] ? params[0] - 1 : 0;
+                    headless.cx = params[1] ? params[1] - 1 : 0;
+                    break;
+                case 'K':
+                    if (headless.cy < headless.rows && headless.cx < headless.cols)
+                        memset(&headless.screen[headless.cy * headless.cols + headless.cx], ' ', headless.cols - headless.cx);
+                    break;
+                case 'J':
+                    if (params[0] == 2) memset(headless.screen, ' ', headless.rows * headless.cols);
+                    break;
+            }
+        }
+        else if (c == '\r') headless.cx = 0;
+        else if (c == '\n') headless.cy++;
+        else if (c != '\0')
+        {
+            if (headless.cy < headless.rows && headless.cx < headless.cols)
+                headless.screen[headless.cy * headless.cols + headless.cx] = c;
+            headless.cx++;
+        }
+    }
+}
+
+/**
+ * @brief Appends the virtual screen to the dump file, trailing blanks trimmed.
+*/
+void editorHeadlessDump()
+{
+    if (!headless.dump) return;
+
+    fprintf(headless.dump, "--- frame %d (dump %d) cursor %d,%d ---\n", headless.frames, ++headless.dumps, headless.cy + 1, headless.cx + 1);
+
+    for (int y = 0; y < headless.rows; y++)
+    {
+        char *line = &headless.screen[y * headless.cols];
+        int linelen = headless.cols;
+        while (linelen > 0 && line[linelen - 1] == ' ') linelen--;
+
+        fwrite(line, 1, linelen, headless.dump);
+        fputc('\n', headless.dump);
+    }
+    fflush(headless.dump);
+}
@@ -5,6 +5,15 @@
 #include "../lib/file_io.h"
 #include "../lib/edit_op.h"
 #include "../lib/output.h"
+#include "../lib/latency.h"
+#include "../lib/undo.h"
+#include "../lib/buflist.h"
+#include "../lib/window.h"
+#include "../lib/cursors.h"
+#include "../lib/clipboard.h"
+#include "../lib/pager.h"
+#include "../lib/diffview.h"
+#include "../lib/fold.h"
 #include <stdlib.h>
 #include <ctype.h>
 
@@ -17,6 +26,25 @@ void editorProcessKeypress()
 
     int c = editorReadKey();
 
+    editorLatencyBegin(LAT_EDIT);
+    editorUndoBoundary();
+
+    // the read-only pager takes every key but quitting and the latency overlay
+    if (editorPagerKey(c))
+    {
+        editorLatencyEnd(LAT_EDIT);
+        return;
+    }
+
+    // with several cursors the key goes to all of them, or drops the extra ones; keys other than
+    // movement drop the selection
+    if (editorCursorKey(c) || editorSelectKey(c))
+    {
+        editorLatencyEnd(LAT_EDIT);
+        quitConfirmation = QUIT_CONFIRMATION;
+        return;
+    }
+
     switch (c)
     {
         // Enter Key
@@ -26,24 +54,132 @@ void editorProcessKeypress()
 
         // Exit Key 'Ctrl + Q'
         case CTRL_KEY('q'):
-            if (editor.unsaved && quitConfirmation > 0)
+            if (editorBufferUnsaved() && quitConfirmation > 0)
             {
-                editorSetStatusMessage("Warning! File has unsaved changes."
-                "Press Ctrl-Q %d more times to quit.", quitConfirmation);
+                if (editorBufferUnsaved() == 1 && editor.unsaved)
+                    editorSetStatusMessage("Warning! File has unsaved changes."
+                    "Press Ctrl-Q %d more times to quit.", quitConfirmation);
+                else
+                    editorSetStatusMessage("Warning! %d files have unsaved changes."
+                    "Press Ctrl-Q %d more times to quit.", editorBufferUnsaved(), quitConfirmation);
                 quitConfirmation--;
+                editorLatencyEnd(LAT_EDIT);
                 return;
             }
+            editorSaveWait();
             system("clear");
             exit(0);
             break;
         
+        // Bracketed paste, inserted as one block
+        case PASTE_KEY:
+            {
+                int len;
+                const char *text = editorReadPaste(&len);
+                editorInsertText(text, len);
+            }
+            break;
+
         // Save
         case CTRL_KEY('s'):
             editorSave();
             break;
         
+        // Latency overlay
+        case CTRL_KEY('t'):
+            editorLatencyToggleOverlay();
+            break;
+
         case CTRL_KEY('f'):
             editorFind();
+            break;
+
+        case CTRL_KEY('r'):
+            editorReplace();
+            break;
+
+        case CTRL_KEY('g'):
+            editorGoToLine();
+            break;
+
+        // Buffers: open a file, next and previous
+        case CTRL_KEY('o'):
+            editorBufferPrompt();
+            break;
+
+        case CTRL_KEY('n'):
+            editorBufferSwitch(1);
+            break;
+
+        case CTRL_KEY('p'):
+            editorBufferSwitch(-1);
+            break;
+
+        // Windows, Ctrl-W then a command key; Ctrl-W gets its frame before the wait, so the
+        // command key is a sample of its own
+        case CTRL_KEY('w'):
+            editorLatencyEnd(LAT_EDIT);
+            editorRefreshScreen();
+            c = editorReadKey();
+            editorLatencyBegin(LAT_EDIT);
+            editorWindowCommand(c);
+            break;
+
+        // Multiple cursors: at the next match of the word, or on each line down to another
+        case CTRL_KEY('d'):
+            editorCursorAddNext();
+            break;
+
+        case CTRL_KEY('e'):
+            editorCursorAddLines();
+            break;
+
+        // Selection: linear or block mark, copy, cut, paste the newest register or a numbered one
+        case CTRL_KEY('@'):
+        case CTRL_KEY('b'):
+            editorSelectStart(c == CTRL_KEY('b'));
+            break;
+
+        case CTRL_KEY('c'):
+        case CTRL_KEY('x'):
+            editorClipCopy(c == CTRL_KEY('x'));
+            break;
+
+        case CTRL_KEY('v'):
+            editorClipPaste(0);
+            break;
+
+        case CTRL_KEY('a'):
+            editorClipPastePrompt();
+            break;
+
+        // Diff against the file on disk, then the next and previous hunk
+        case CTRL_KEY('k'):
+            editorDiffViewToggle();
+            break;
+
+        case CTRL_KEY('j'):
+        case CTRL_KEY('u'):
+            editorDiffViewJump(c == CTRL_KEY('j') ? 1 : -1);
+            break;
+
+        // Folds: close the one at the cursor or open it, open all
+        case CTRL_KEY(']'):
+            editorFoldToggle();
+            break;
+
+        case CTRL_KEY('\\'):
+            editorFoldOpenAll();
+            break;
+
+        // Undo and redo
+        case CTRL_KEY('z'):
+            if (!editorUndo()) editorSetStatusMessage("Nothing to undo.");
+            break;
+
+        case CTRL_KEY('y'):
+            if (!editorRedo()) editorSetStatusMessage("Nothing to redo.");
+            break;
 
         // Movement Keys
         case ARROW_UP:
@@ -83,18 +219,21 @@ void editorProcessKeypress()
                 }
                 else if (c == PAGE_DOWN)
                 {
-                    editor.cy = editor.rowoff + editor.screenRows - 1;
+                    editor.cy = editorFoldToFile(editorFoldToScreen(editor.rowoff) + editor.screenRows - 1);
                     if (editor.cy > editor.numrows) editor.cy = editor.numrows;
                 }
                 int times = editor.screenRows;
                 while (times--)
                     editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
             }
+            break;
         
         default:
             editorInsertChar(c);
     }
 
+    editorLatencyEnd(LAT_EDIT);
+
     quitConfirmation = QUIT_CONFIRMATION;
 }
 
@@ -106,6 +245,7 @@ void editorMoveCursor(int key)
 {
     // point row to the row in the file where the cursor is, unless cursor is beyond file, then NULL
     erow *row = (editor.cy >= editor.numrows) ? NULL : &editor.row[editor.cy];
+    int from = editor.cy;
     // this disables us to move when empty file
 
     switch (key) {
@@ -147,15 +287,62 @@ void editorMoveCursor(int key)
             break;
     }
 
+    // closed folds are stepped over, onto their header going up
+    if (editor.cy != from)
+    {
+        editor.cy = editorFoldSkip(editor.cy, editor.cy > from ? 1 : -1);
+        if (editor.cy > editor.numrows) editor.cy = editor.numrows;
+    }
+
     row = (editor.cy >= editor.numrows) ? NULL : &editor.row[editor.cy];
     int rowlen = row ? row->size : 0; // if row exists, rowlen = rowsize, otherwise 0
     if (editor.cx > rowlen) editor.cx = rowlen; // correct x position if cursor is beyond line
 }
 
+/**
+ * @brief Asks for a line number and moves the cursor to the start of that line.
+*/
+void editorGoToLine()
+{
+    char *answer = editorPrompt("Go to line: %s (Ctrl-X to cancel)", NULL);
+    if (answer == NULL) return;
+
+    int line = atoi(answer);
+    free(answer);
+
+    if (line > editor.numrows) line = editor.numrows;
+    if (line < 1) line = 1;
+
+    editor.cy = editor.numrows ? line - 1 : 0;
+    editor.cx = 0;
+}
+
+static char *editorPromptInput(char *prompt, void (*callback)(char *, int), int allowEmpty);
+
 /**
  * @brief Prompt function displayed in status message b ar.
 */
 char *editorPrompt(char *prompt, void (*callback)(char *, int))
+{
+    return editorPromptInput(prompt, callback, 0);
+}
+
+/**
+ * @brief Like `editorPrompt`, but Enter also accepts an empty answer.
+*/
+char *editorPromptAllowEmpty(char *prompt, void (*callback)(char *, int))
+{
+    return editorPromptInput(prompt, callback, 1);
+}
+
+/**
+ * @brief Reads a line of input in the message bar, calling `callback` after every key.
+ * @param allowEmpty Whether Enter returns an empty string, otherwise it is ignored.
+ * @return The answer, NULL if cancelled with Ctrl-X.
+ * @note Every key read here is its own edit phase; the one ending the prompt is left open for
+ * @note the caller to end, so the time spent typing never lands in a single sample.
+*/
+static char *editorPromptInput(char *prompt, void (*callback)(char *, int), int allowEmpty)
 {
     size_t bufsize = 128;
     char *buf = malloc(bufsize);
@@ -163,6 +350,9 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
     size_t buflen = 0;
 
     buf[0] = '\0';
+
+    editor.statusmsg_keep = 1;
+    editorLatencyEnd(LAT_EDIT);
     
     while (1)
     {
@@ -170,6 +360,7 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
         editorRefreshScreen();
 
         int c = editorReadKey();
+        editorLatencyBegin(LAT_EDIT);
 
         // Allow for backspacing
         if ( c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE)
@@ -179,6 +370,7 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
         // Ctrl-X, cancel save as
         else if (c == CTRL_KEY('x'))
         {
+            editor.statusmsg_keep = 0;
             editorSetStatusMessage("");
             if (callback) callback(buf, c);
             free(buf);
@@ -187,13 +379,33 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
         // Enter Key, save as file name
         else if (c == '\r')
         {
-            if (buflen != 0)
+            if (buflen != 0 || allowEmpty)
             {
+                editor.statusmsg_keep = 0;
                 editorSetStatusMessage("");
                 if (callback) callback(buf, c);
                 return buf;
             }
         }
+        // Pasted text, up to the first line break
+        else if (c == PASTE_KEY)
+        {
+            int len;
+            const char *text = editorReadPaste(&len);
+
+            for (int i = 0; i < len && text[i] != '\r' && text[i] != '\n'; i++)
+            {
+                if (iscntrl(text[i])) continue;
+
+                if (buflen == bufsize - 1)
+                {
+                    bufsize *= 2;
+                    buf = realloc(buf, bufsize);
+                }
+                buf[buflen++] = text[i];
+            }
+            buf[buflen] = '\0';
+        }
         // Normal character keys
         else if (!iscntrl(c) && c < 128)
         {
@@ -209,5 +421,6 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
         
         // Incremental Search
         if (callback) callback(buf, c);
+        editorLatencyEnd(LAT_EDIT);
     }
 }
\ No newline at end of file
@@ -0,0 +1,333 @@
+#include "../lib/jobs.h"
+#include "../lib/const.h"
+#include "../lib/event.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+/*
+ * A fixed pool of worker threads, started on first use. Each worker has its own deque of jobs:
+ * the main thread deals new jobs to the deques in turn, a worker takes the newest job of its own
+ * deque and, when that is empty, steals the oldest one of another. Finished jobs are pushed onto
+ * a lock-free multi-producer, single-consumer queue and the main thread is woken through an
+ * eventfd to run their `done` callbacks, so those never race with editing.
+ *
+ * Jobs are submitted from the main thread only.
+*/
+
+struct editorJob
+{
+    struct editorJob *prev, *next; // place in a deque
+    _Atomic(struct editorJob *) finished; // next in the completion queue
+    editorJobRun run;
+    editorJobDone done;
+    void *arg;
+    struct editorJobToken *token;
+};
+
+struct editorJobToken
+{
+    atomic_int cancelled;
+    atomic_int running; // submitted jobs whose `run` has not returned
+    atomic_int refs; // the owner, plus each job until its `done` has run
+};
+
+struct jobDeque
+{
+    pthread_mutex_t lock;
+    struct editorJob *head, *tail; // thieves take the head, the owner takes the tail
+};
+
+static struct
+{
+    int threads; // 0 until started
+    struct jobDeque deques[JOB_MAX_THREADS];
+    unsigned next; // deque receiving the next job
+
+    pthread_mutex_t lock; // guards `queued` for sleeping workers, and `finished` waiters
+    pthread_cond_t work;
+    pthread_cond_t finished;
+    int queued; // jobs sitting in deques
+
+    // completion queue: workers exchange `head`, the main thread pops from `tail`
+    _Atomic(struct editorJob *) head;
+    struct editorJob *tail;
+    struct editorJob stub;
+    int efd;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER,
+    .efd = -1
+};
+
+static __thread int jobSelf = -1; // deque of the calling worker
+
+static void dequePush(struct jobDeque *d, struct editorJob *j)
+{
+    pthread_mutex_lock(&d->lock);
+    j->next = NULL;
+    j->prev = d->tail;
+    if (d->tail) d->tail->next = j;
+    else d->head = j;
+    d->tail = j;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static void dequeUnlink(struct jobDeque *d, struct editorJob *j)
+{
+    if (j->prev) j->prev->next = j->next;
+    else d->head = j->next;
+    if (j->next) j->next->prev = j->prev;
+    else d->tail = j->prev;
+}
+
+/**
+ * @brief Takes the newest job (`own`) or the oldest one, or the oldest one of `token` if not NULL.
+*/
+static struct editorJob *dequeTake(struct jobDeque *d, int own, struct editorJobToken *token)
+{
+    pthread_mutex_lock(&d->lock);
+
+    struct editorJob *j = own ? d->tail : d->head;
+    while (j && token && j->token != token) j = j->next;
+    if (j) dequeUnlink(d, j);
+
+    pthread_mutex_unlock(&d->lock);
+    return j;
+}
+
+/**
+ * @brief Finds a queued job, looking in deque `self` first.
+*/
+static struct editorJob *jobTake(int self, struct editorJobToken *token)
+{
+    for (int i = 0; i < pool.threads; i++)
+    {
+        struct editorJob *j = dequeTake(&pool.deques[(self + i) % pool.threads], i == 0 && !token, token);
+        if (j == NULL) continue;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.queued--;
+        pthread_mutex_unlock(&pool.lock);
+        return j;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Pushes a finished job onto the completion queue (Vyukov's intrusive MPSC queue).
+*/
+static void completionPush(struct editorJob *j)
+{
+    atomic_store(&j->finished, NULL);
+    struct editorJob *prev = atomic_exchange(&pool.head, j);
+    atomic_store(&prev->finished, j);
+}
+
+/**
+ * @brief Pops the oldest finished job on the main thread. NULL can also mean that a push is
+ * @brief halfway done, its eventfd write then follows.
+*/
+static struct editorJob *completionPop()
+{
+    struct editorJob *tail = pool.tail;
+    struct editorJob *next = atomic_load(&tail->finished);
+
+    if (tail == &pool.stub)
+    {
+        if (next == NULL) return NULL;
+        pool.tail = tail = next;
+        next = atomic_load(&next->finished);
+    }
+    if (next)
+    {
+        pool.tail = next;
+        return tail;
+    }
+
+    if (tail != atomic_load(&pool.head)) return NULL;
+
+    completionPush(&pool.stub);
+    next = atomic_load(&tail->finished);
+    if (next == NULL) return NULL;
+
+    pool.tail = next;
+    return tail;
+}
+
+static void jobRun(struct editorJob *j)
+{
+    j->run(j->arg, j->token);
+    atomic_fetch_sub(&j->token->running, 1);
+
+    pthread_mutex_lock(&pool.lock);
+    pthread_cond_broadcast(&pool.finished);
+    pthread_mutex_unlock(&pool.lock);
+
+    completionPush(j);
+
+    uint64_t one = 1;
+    write(pool.efd, &one, sizeof(one));
+}
+
+static void *jobWorker(void *arg)
+{
+    jobSelf = (int)(intptr_t)arg;
+
+    for (;;)
+    {
+        struct editorJob *j = jobTake(jobSelf, NULL);
+        if (j)
+        {
+            jobRun(j);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        while (pool.queued == 0) pthread_cond_wait(&pool.work, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Event loop callback for the eventfd, runs the `done` callbacks of finished jobs.
+*/
+static void jobsFinished(int fd, void *arg)
+{
+    (void)arg;
+    uint64_t value;
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) return;
+
+    struct editorJob *j;
+    while ((j = completionPop()) != NULL)
+    {
+        if (j->done) j->done(j->arg, j->token);
+        editorJobTokenRelease(j->token);
+        free(j);
+        editorEventBusy(-1);
+    }
+}
+
+/**
+ * @brief Starts one worker per processor, up to `JOB_MAX_THREADS`.
+*/
+static void jobStart()
+{
+    if (pool.threads) return;
+
+    atomic_store(&pool.head, &pool.stub);
+    pool.tail = &pool.stub;
+
+    // registering first also sets up the signal mask the workers inherit
+    pool.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    editorEventAddFd(pool.efd, jobsFinished, NULL);
+
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > JOB_MAX_THREADS) threads = JOB_MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    for (int i = 0; i < threads; i++) pthread_mutex_init(&pool.deques[i].lock, NULL);
+    pool.threads = threads;
+
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_t thread;
+        pthread_create(&thread, NULL, jobWorker, (void *)(intptr_t)i);
+        pthread_detach(thread);
+    }
+}
+
+/**
+ * @return Number of worker threads, for callers splitting work into one job per worker.
+*/
+int editorJobThreads()
+{
+    jobStart();
+    return pool.threads;
+}
+
+/**
+ * @brief Creates a token for a group of jobs, release it with `editorJobTokenRelease`.
+*/
+struct editorJobToken *editorJobTokenNew()
+{
+    struct editorJobToken *token = calloc(1, sizeof(struct editorJobToken));
+    atomic_store(&token->refs, 1);
+    return token;
+}
+
+/**
+ * @brief Drops the caller's hold on `token`. It is freed once its jobs are done as well.
+*/
+void editorJobTokenRelease(struct editorJobToken *token)
+{
+    if (token && atomic_fetch_sub(&token->refs, 1) == 1) free(token);
+}
+
+/**
+ * @brief Asks the jobs of `token` to stop. Jobs not started still run and see the flag at once.
+*/
+void editorJobCancel(struct editorJobToken *token)
+{
+    atomic_store(&token->cancelled, 1);
+}
+
+int editorJobCancelled(struct editorJobToken *token)
+{
+    return atomic_load(&token->cancelled);
+}
+
+/**
+ * @brief Queues `run(arg, token)` on the pool. Afterwards `done(arg, token)`, if not NULL, runs
+ * @brief on the main thread from the event loop, whether or not the job was cancelled.
+ * @note Counts as background work for `editorEventWaitIdle` until `done` has run.
+*/
+void editorJobSubmit(struct editorJobToken *token, editorJobRun run, editorJobDone done, void *arg)
+{
+    jobStart();
+
+    struct editorJob *j = calloc(1, sizeof(struct editorJob));
+    j->run = run;
+    j->done = done;
+    j->arg = arg;
+    j->token = token;
+
+    atomic_fetch_add(&token->refs, 1);
+    atomic_fetch_add(&token->running, 1);
+    editorEventBusy(1);
+
+    dequePush(&pool.deques[pool.next++ % pool.threads], j);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.queued++;
+    pthread_cond_signal(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief Blocks until every job of `token` has returned from `run`. Jobs of `token` still queued
+ * @brief are run on the calling thread rather than waited for. Their `done` callbacks still
+ * @brief come later from the event loop.
+*/
+void editorJobWait(struct editorJobToken *token)
+{
+    while (atomic_load(&token->running) > 0)
+    {
+        struct editorJob *j = jobTake(0, token);
+        if (j)
+        {
+            jobRun(j);
+            continue;
+        }
+
+        // none queued, so the rest are running and each one broadcasts when it returns
+        pthread_mutex_lock(&pool.lock);
+        if (atomic_load(&token->running) > 0) pthread_cond_wait(&pool.finished, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
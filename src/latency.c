@@ -0,0 +1,222 @@
+#include "../lib/latency.h"
+#include "../lib/const.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *phaseNames[LAT_PHASES] = {"edit", "highlight", "build", "write", "total"};
+
+static struct latencyHistogram histograms[LAT_PHASES];
+
+static uint64_t keyTime = 0; // when the oldest key not yet on screen was decoded, 0 if none
+static uint64_t phaseStart[LAT_PHASES];
+static uint64_t phaseAccum[LAT_PHASES]; // time spent in each phase since `keyTime`
+
+static int overlay = 0;
+static char *dumpPath = NULL;
+
+/**
+ * @brief Monotonic clock in nanoseconds.
+*/
+uint64_t editorLatencyNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Maps a value to its bucket. Values below `LAT_SUB` get exact buckets, above that
+ * @brief every power of two is split into `LAT_SUB` equal sub-buckets.
+*/
+static int latencyBucket(uint64_t v)
+{
+    if (v < LAT_SUB) return (int)v;
+
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - LAT_SUB_BITS;
+
+    if (shift >= LAT_MAGNITUDES) return LAT_BUCKETS - 1;
+
+    return (shift + 1) * LAT_SUB + (int)((v >> shift) - LAT_SUB);
+}
+
+/**
+ * @brief Highest value that falls into bucket `b`.
+*/
+static uint64_t latencyBucketMax(int b)
+{
+    if (b < LAT_SUB) return b;
+
+    int shift = b / LAT_SUB - 1;
+    uint64_t low = (uint64_t)(LAT_SUB + b % LAT_SUB) << shift;
+
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+/**
+ * @brief Adds a sample in nanoseconds to a histogram.
+*/
+void editorLatencyRecord(struct latencyHistogram *h, uint64_t ns)
+{
+    h->counts[latencyBucket(ns)]++;
+    if (h->count == 0 || ns < h->min) h->min = ns;
+    if (ns > h->max) h->max = ns;
+    h->count++;
+    h->sum += ns;
+}
+
+/**
+ * @brief Value below which `p` percent of the samples fall, accurate to the bucket width.
+*/
+uint64_t editorLatencyPercentile(struct latencyHistogram *h, double p)
+{
+    if (h->count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++)
+    {
+        seen += h->counts[b];
+        if (seen >= rank)
+        {
+            uint64_t v = latencyBucketMax(b);
+            return v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
+
+struct latencyHistogram *editorLatencyHistogram(int phase)
+{
+    return &histograms[phase];
+}
+
+const char *editorLatencyPhaseName(int phase)
+{
+    return phaseNames[phase];
+}
+
+/**
+ * @brief Called when a key is decoded. Starts a sample unless an earlier key is still waiting for a frame.
+*/
+void editorLatencyKey()
+{
+    if (keyTime) return;
+
+    keyTime = editorLatencyNow();
+    memset(phaseAccum, 0, sizeof(phaseAccum));
+}
+
+void editorLatencyBegin(int phase)
+{
+    phaseStart[phase] = editorLatencyNow();
+}
+
+void editorLatencyEnd(int phase)
+{
+    phaseAccum[phase] += editorLatencyNow() - phaseStart[phase];
+}
+
+/**
+ * @brief Called once a frame has been written. Records every phase of the pending key, if there is one.
+ * @note Highlighting happens inside the edit phase and is subtracted from it.
+*/
+void editorLatencyFrame()
+{
+    if (!keyTime) return;
+
+    uint64_t edit = phaseAccum[LAT_EDIT];
+    edit = edit > phaseAccum[LAT_HIGHLIGHT] ? edit - phaseAccum[LAT_HIGHLIGHT] : 0;
+
+    editorLatencyRecord(&histograms[LAT_EDIT], edit);
+    editorLatencyRecord(&histograms[LAT_HIGHLIGHT], phaseAccum[LAT_HIGHLIGHT]);
+    editorLatencyRecord(&histograms[LAT_BUILD], phaseAccum[LAT_BUILD]);
+    editorLatencyRecord(&histograms[LAT_WRITE], phaseAccum[LAT_WRITE]);
+    editorLatencyRecord(&histograms[LAT_TOTAL], editorLatencyNow() - keyTime);
+
+    keyTime = 0;
+}
+
+void editorLatencyToggleOverlay()
+{
+    overlay = !overlay;
+}
+
+/**
+ * @brief Formats the p50/p99 of every phase for the message bar.
+ * @return Length written to `buf`, 0 if the overlay is off.
+*/
+int editorLatencyOverlay(char *buf, int size)
+{
+    if (!overlay) return 0;
+
+    int len = snprintf(buf, size, "LAT p50/p99 us (n=%llu)", (unsigned long long)histograms[LAT_TOTAL].count);
+
+    for (int i = 0; i < LAT_PHASES && len < size; i++)
+    {
+        len += snprintf(&buf[len], size - len, " %s %.0f/%.0f", phaseNames[i],
+            editorLatencyPercentile(&histograms[i], 50.0) / 1000.0,
+            editorLatencyPercentile(&histograms[i], 99.0) / 1000.0);
+    }
+
+    return len < size ? len : size - 1;
+}
+
+/**
+ * @brief Writes a summary line per phase, followed by the non-empty buckets, to `path`.
+ * @return 0 on success, -1 if the file could not be written.
+*/
+int editorLatencyDump(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) return -1;
+
+    fprintf(fp, "# phase count min_ns p50_ns p90_ns p99_ns p999_ns max_ns mean_ns\n");
+    for (int i = 0; i < LAT_PHASES; i++)
+    {
+        struct latencyHistogram *h = &histograms[i];
+        fprintf(fp, "%s %llu %llu %llu %llu %llu %llu %llu %llu\n", phaseNames[i],
+            (unsigned long long)h->count,
+            (unsigned long long)h->min,
+            (unsigned long long)editorLatencyPercentile(h, 50.0),
+            (unsigned long long)editorLatencyPercentile(h, 90.0),
+            (unsigned long long)editorLatencyPercentile(h, 99.0),
+            (unsigned long long)editorLatencyPercentile(h, 99.9),
+            (unsigned long long)h->max,
+            (unsigned long long)(h->count ? h->sum / h->count : 0));
+    }
+
+    fprintf(fp, "# phase bucket_max_ns count\n");
+    for (int i = 0; i < LAT_PHASES; i++)
+    {
+        for (int b = 0; b < LAT_BUCKETS; b++)
+        {
+            if (histograms[i].counts[b] == 0) continue;
+            fprintf(fp, "%s %llu %llu\n", phaseNames[i],
+                (unsigned long long)latencyBucketMax(b),
+                (unsigned long long)histograms[i].counts[b]);
+        }
+    }
+
+    return fclose(fp);
+}
+
+static void latencyDumpAtExit()
+{
+    editorLatencyDump(dumpPath);
+}
+
+/**
+ * @brief Registers `path` to receive `editorLatencyDump` output when the editor exits.
+*/
+void editorLatencyDumpOnExit(const char *path)
+{
+    if (dumpPath == NULL) atexit(latencyDumpAtExit);
+
+    free(dumpPath);
+    dumpPath = strdup(path);
+}
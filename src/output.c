@@ -4,6 +4,17 @@
 #include "../lib/editor.h"
 #include "../lib/file_io.h"
 #include "../lib/syntax.h"
+#include "../lib/event.h"
+#include "../lib/latency.h"
+#include "../lib/search.h"
+#include "../lib/trigram.h"
+#include "../lib/buflist.h"
+#include "../lib/window.h"
+#include "../lib/cursors.h"
+#include "../lib/clipboard.h"
+#include "../lib/pager.h"
+#include "../lib/diffview.h"
+#include "../lib/fold.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -11,6 +22,24 @@
 #include <stdarg.h>
 #include <ctype.h>
 
+static void (*frameSink)(const char *s, int len) = NULL;
+
+// where `editorDrawRows` and `editorDrawStatusBar` draw while the screen is split
+static struct
+{
+    int windowed;
+    int top, left;
+} origin;
+
+/**
+ * @brief Redirects finished frames to `sink` instead of stdout, NULL restores stdout.
+ * @param sink Function receiving each frame's bytes, such as the headless virtual screen.
+*/
+void editorSetFrameSink(void (*sink)(const char *s, int len))
+{
+    frameSink = sink;
+}
+
 /**
  * @brief Uses escape sequences to refresh screen.
  * @param None
@@ -18,6 +47,12 @@
 */
 void editorRefreshScreen()
 {
+    editorLatencyBegin(LAT_BUILD);
+
+    editorDiffViewRefresh();
+
+    // a jump into a closed fold opens it
+    editorFoldReveal(editor.cy);
     editorScroll();
     
     struct abuf ab = ABUF_INIT;
@@ -28,26 +63,170 @@ void editorRefreshScreen()
     // Move cursor to top left
     abAppend(&ab, "\x1b[H", 3);
 
-    editorDrawRows(&ab);
-    editorDrawStatusBar(&ab);
+    if (editorWindowCount() > 1)
+    {
+        editorWindowDraw(&ab);
+    }
+    else
+    {
+        editorDrawRows(&ab);
+        editorDrawStatusBar(&ab);
+    }
     editorDrawMessageBar(&ab);
 
     char buf[32];
+    int top, left;
+    editorWindowOrigin(&top, &left);
 
     // if file exists, offset cursor to make space for line numbers
-    if (editor.numrows) 
-        snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (editor.cy - editor.rowoff) + 1, (editor.rx - editor.coloff) + 1 + LN_OFFSET);
+    int y = editorFoldToScreen(editor.cy) - editorFoldToScreen(editor.rowoff);
+    if (editor.numrows || (editorPagerActive() && editorPagerLines())) 
+        snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1 + top, (editor.rx - editor.coloff) + 1 + LN_OFFSET + left);
     else
-        snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (editor.cy - editor.rowoff) + 1, (editor.rx - editor.coloff) + 1);
+        snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1 + top, (editor.rx - editor.coloff) + 1 + left);
 
     abAppend(&ab, buf, strlen(buf));
 
     // Show cursor
     abAppend(&ab, "\x1b[?25h", 6);
 
+    editorLatencyEnd(LAT_BUILD);
+
     // Executes command
-    write(STDOUT_FILENO, ab.b, ab.len);
+    editorLatencyBegin(LAT_WRITE);
+    if (frameSink)
+        frameSink(ab.b, ab.len);
+    else
+        write(STDOUT_FILENO, ab.b, ab.len);
+    editorLatencyEnd(LAT_WRITE);
     abFree(&ab);
+
+    editorLatencyFrame();
+}
+
+/**
+ * @brief Copy of a row's `hl` with every search match painted as `HL_MATCH`, the row itself is untouched.
+ * @param row The row being drawn.
+ * @param first Index of the row's first match in the match table.
+ * @param n Number of matches on the row.
+ * @return Pointer to the painted copy, valid until the next call.
+*/
+static unsigned char *editorMatchOverlay(erow *row, int first, int n)
+{
+    static unsigned char *overlay = NULL;
+    static int overlaycap = 0;
+
+    if (row->rsize > overlaycap)
+    {
+        overlaycap = row->rsize * 2;
+        overlay = realloc(overlay, overlaycap);
+    }
+    memcpy(overlay, row->hl, row->rsize);
+
+    int cx = 0, rx = 0, base = 0, end = row->size;
+
+    // a long row only holds its window, matches outside of it are not drawn
+    if (row->window)
+    {
+        cx = row->window->cstart;
+        rx = base = row->window->rstart;
+        end = row->window->cend;
+    }
+
+    // matches are sorted by column, so one walk over `chars` converts them all to render positions
+    for (int i = first; i < first + n; i++)
+    {
+        struct searchMatch *m = editorSearchMatchAt(i);
+        int col = m->col;
+
+        for (; cx < col + m->len && cx < end; cx++)
+        {
+            int width = row->chars[cx] == '\t' ? TAB_STOP - (rx % TAB_STOP) : 1;
+            if (cx >= col) memset(&overlay[rx - base], HL_MATCH, width);
+            rx += width;
+        }
+    }
+
+    return overlay;
+}
+
+/**
+ * @brief Render columns of the extra cursors on a row.
+ * @param row The row being drawn.
+ * @param first Index of the row's first extra cursor, see `editorCursorAt`.
+ * @param n Number of extra cursors on the row.
+ * @return Pointer to `n` columns in order, valid until the next call.
+*/
+static int *editorCursorColumns(erow *row, int first, int n)
+{
+    static int *cols = NULL;
+    static int colcap = 0;
+
+    if (n > colcap)
+    {
+        colcap = n * 2;
+        cols = realloc(cols, sizeof(int) * colcap);
+    }
+
+    int cx = 0, rx = 0, end = row->size;
+
+    // on a long row, cursors outside of the window are out of view and only need to stay in order
+    if (row->window)
+    {
+        cx = row->window->cstart;
+        rx = row->window->rstart;
+        end = row->window->cend;
+    }
+
+    // cursors are sorted by column as well, one walk over `chars` places them all
+    for (int i = 0; i < n; i++)
+    {
+        int col = editorCursorAt(first + i)->cx;
+
+        if (col < cx) cols[i] = -1;
+        else if (col > end) cols[i] = rx + (col - cx);
+        else
+        {
+            for (; cx < col; cx++)
+                rx += row->chars[cx] == '\t' ? TAB_STOP - (rx % TAB_STOP) : 1;
+            cols[i] = rx;
+        }
+    }
+
+    return cols;
+}
+
+/**
+ * @brief Draws the viewport in `editor` as a window whose text area starts at `top`, `left`.
+ * @param ab Append buffer to update the stream
+ * @param top Screen row of the window, 0-based.
+ * @param left Screen column of the window, 0-based. Windows not at the left edge get a separator.
+*/
+void editorDrawWindow(struct abuf *ab, int top, int left)
+{
+    origin.windowed = 1;
+    origin.top = top;
+    origin.left = left;
+
+    editorDrawRows(ab);
+    editorDrawStatusBar(ab);
+
+    origin.windowed = 0;
+}
+
+/**
+ * @brief Moves to the start of screen line `y` of the window being drawn.
+*/
+static void editorWindowLine(struct abuf *ab, int y)
+{
+    char buf[32];
+    int len;
+
+    if (origin.left)
+        len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH\x1b[1;92m|\x1b[m", origin.top + y + 1, origin.left);
+    else
+        len = snprintf(buf, sizeof(buf), "\x1b[%d;1H", origin.top + y + 1);
+    abAppend(ab, buf, len);
 }
 
 /**
@@ -57,13 +236,26 @@ void editorRefreshScreen()
 */
 void editorDrawRows(struct abuf *ab)
 {
+    static const char *diffMarks[] = {
+        [DIFF_MARK_NONE] = " ",
+        [DIFF_MARK_ADDED] = "\x1b[1;32m+\x1b[m",
+        [DIFF_MARK_CHANGED] = "\x1b[1;33m~\x1b[m",
+        [DIFF_MARK_DELETED] = "\x1b[1;31m-\x1b[m",
+    };
+
+    int numrows = editorPagerActive() ? editorPagerLines() : editor.numrows;
+    int top = editorFoldToScreen(editor.rowoff);
+
     for (int y = 0; y < editor.screenRows; y++)
     {
-        int fileRow = y + editor.rowoff;
-        if (fileRow >= editor.numrows)
+        if (origin.windowed) editorWindowLine(ab, y);
+
+        // rows hidden by closed folds take no screen lines
+        int fileRow = editorFoldToFile(top + y);
+        if (fileRow >= numrows)
         {
             // NO FILE INPUT
-            if (editor.numrows == 0 && y == (editor.screenRows / 3))
+            if (numrows == 0 && y == (editor.screenRows / 3))
             {
             // VERSION TEXT
                 char welcome[50];
@@ -71,33 +263,75 @@ void editorDrawRows(struct abuf *ab)
                 editorCenteredText(welcome, ab);
             } 
             // AUTHOR TEXT
-            else if (editor.numrows == 0 && y == (editor.screenRows / 3) + 1)
+            else if (numrows == 0 && y == (editor.screenRows / 3) + 1)
             {
                 editorCenteredText("github.com/erratical", ab);
             } 
             else
             {
-            abAppend(ab, "\x1b[1;92m~\x1b[m", 12);
+            abAppend(ab, "\x1b[1;92m~\x1b[m", 11);
             }
         }
         else 
         {   
-            int fileLineLen = snprintf(NULL, 0, "\x1b[1;32m[%.3d]\x1b[m ", fileRow);
+            int fileLineLen = snprintf(NULL, 0, "\x1b[1;32m[%.3d]\x1b[m", fileRow);
             char fileLine[fileLineLen + 1];
-            snprintf(fileLine, sizeof(fileLine), "\x1b[1;32m[%.3d]\x1b[m ", fileRow);
+            snprintf(fileLine, sizeof(fileLine), "\x1b[1;32m[%.3d]\x1b[m", fileRow);
+
+            abAppend(ab, fileLine, fileLineLen);
+
+            // the diff view marks rows that differ from the file on disk after the line number
+            int mark = editorPagerActive() ? DIFF_MARK_NONE : editorDiffViewMark(fileRow);
+            abAppend(ab, diffMarks[mark], strlen(diffMarks[mark]));
+
+            int lineLen;
+            char *line;
+            unsigned char *hl;
+            int firstCursor, nextCursor = 0, numCursors = 0;
+            int *cursorCols = NULL;
+            int selFrom = 0, selTo = 0;
 
-            abAppend(ab, fileLine, fileLineLen + 6);
+            if (editorPagerActive())
+            {
+                // read-only pager, the line comes straight from the mapped file
+                lineLen = editorPagerRender(fileRow, editor.coloff, editor.screenCols - LN_OFFSET, &line, &hl);
+            }
+            else
+            {
+                // a long row only holds the columns around the view
+                erow *row = &editor.row[fileRow];
+                if (row->window) editorRenderWindow(row, editor.coloff, editor.screenCols - LN_OFFSET);
+                int start = row->window ? row->window->rstart : 0;
 
-            int lineLen = editor.row[fileRow].rsize - editor.coloff;
+                lineLen = start + row->rsize - editor.coloff;
 
-            char *line = &editor.row[fileRow].render[editor.coloff];
-            unsigned char *hl = &editor.row[fileRow].hl[editor.coloff];
+                line = &row->render[editor.coloff - start];
+                hl = &row->hl[editor.coloff - start];
+
+                int firstMatch;
+                int numMatches = editorSearchRowMatches(fileRow, &firstMatch);
+                if (numMatches) hl = &editorMatchOverlay(row, firstMatch, numMatches)[editor.coloff - start];
+
+                // extra cursors are drawn inverted, those left of the view are skipped
+                numCursors = editorCursorsOnRow(fileRow, &firstCursor);
+                cursorCols = numCursors ? editorCursorColumns(row, firstCursor, numCursors) : NULL;
+                while (nextCursor < numCursors && cursorCols[nextCursor] < editor.coloff) nextCursor++;
+
+                // so is the selection
+                editorSelectSpan(fileRow, &selFrom, &selTo);
+            }
             int currentColor = -1;
 
-            if (lineLen + fileLineLen > editor.screenCols) lineLen = editor.screenCols - fileLineLen + LN_OFFSET + 4;
+            if (lineLen > editor.screenCols - LN_OFFSET) lineLen = editor.screenCols - LN_OFFSET;
 
             for (int ch = 0; ch < lineLen; ch++)
             {
+                int cursor = nextCursor < numCursors && cursorCols[nextCursor] == editor.coloff + ch;
+                if (cursor) nextCursor++;
+
+                int inverted = cursor || (editor.coloff + ch >= selFrom && editor.coloff + ch < selTo);
+                if (inverted) abAppend(ab, "\x1b[7m", 4);
+
                 if (iscntrl(line[ch]))
                 {
                     char sym = (line[ch] <= 26) ? '@' + line[ch] : '?';
@@ -135,12 +369,34 @@ void editorDrawRows(struct abuf *ab)
                     }
                     abAppend(ab, &line[ch], 1);
                 }
+
+                if (inverted) abAppend(ab, "\x1b[27m", 5);
             }
+
+            // a cursor at the end of the line, or a selected line break
+            int atEnd = (lineLen < 0 ? 0 : lineLen) + editor.coloff;
+            if (lineLen < editor.screenCols - LN_OFFSET &&
+                ((nextCursor < numCursors && cursorCols[nextCursor] == atEnd) || (atEnd >= selFrom && atEnd < selTo)))
+                abAppend(ab, "\x1b[7m \x1b[27m", 10);
+
+            // a closed fold's header tells how many rows it hides, if there is room
+            int folded = editorPagerActive() ? 0 : editorFoldLength(fileRow);
+            if (folded)
+            {
+                char label[32];
+                int labelLen = snprintf(label, sizeof(label), "[+%d lines]", folded);
+                if (labelLen + 2 <= editor.screenCols - LN_OFFSET - (lineLen < 0 ? 0 : lineLen))
+                {
+                    abAppend(ab, " \x1b[1;36m", 8);
+                    abAppend(ab, label, labelLen);
+                }
+            }
+
             abAppend(ab, "\x1b[m", 3);
         }
-        // Clear line to the right of cursor
+        // Clear line to the right of cursor, windows further right are drawn after this one
         abAppend(ab, "\x1b[K", 3);
-        abAppend(ab, "\r\n", 2);
+        if (!origin.windowed) abAppend(ab, "\r\n", 2);
     }
 }
 
@@ -160,7 +416,7 @@ void editorCenteredText(const char* s, struct abuf *ab)
 
     if (padding)
     {
-        abAppend(ab, "\x1b[1;92m~\x1b[m", 12);
+        abAppend(ab, "\x1b[1;92m~\x1b[m", 11);
         padding--;
     }
     while (padding--) abAppend(ab, " ", 1);
@@ -177,9 +433,22 @@ void editorCenteredText(const char* s, struct abuf *ab)
 */
 void editorScroll()
 {
+    // rows in closed folds are not shown, another window may have closed one around the cursor
+    int cy = editorFoldSkip(editor.cy, -1);
+    if (cy != editor.cy)
+    {
+        editor.cy = cy;
+        if (editor.cx > editor.row[cy].size) editor.cx = editor.row[cy].size;
+    }
+    editor.rowoff = editorFoldSkip(editor.rowoff, -1);
+
     editor.rx = 0;
 
-    if (editor.cy < editor.numrows)
+    if (editorPagerActive())
+    {
+        editor.rx = editorPagerCxToRx(editor.cy, editor.cx);
+    }
+    else if (editor.cy < editor.numrows)
     {
         editor.rx = editorRowCxToRx(&editor.row[editor.cy], editor.cx);
     }
@@ -190,11 +459,12 @@ void editorScroll()
         editor.rowoff = editor.cy;
     }
 
-    // Scrolling down
-    if (editor.cy >= editor.rowoff + editor.screenRows)
+    // Scrolling down, counted in screen lines
+    int line = editorFoldToScreen(editor.cy);
+    if (line >= editorFoldToScreen(editor.rowoff) + editor.screenRows)
     {
         // How much distance cursor y is from the maximum rendered screen rows
-        editor.rowoff = editor.cy - editor.screenRows + 1;
+        editor.rowoff = editorFoldToFile(line - editor.screenRows + 1);
     }
 
     if (editor.rx < editor.coloff)
@@ -218,26 +488,43 @@ void editorScroll()
 */
 void editorDrawStatusBar(struct abuf *ab)
 {
+    if (origin.windowed) editorWindowLine(ab, editor.screenRows);
+
     // '^[7m' switches to inverted colors
     abAppend(ab, "\x1b[7m", 4); 
 
-    char status[80], rstatus[80];
+    char status[80], rstatus[192]; // `rstatus` holds `index` below and the position after it
 
     abAppend(ab, "\x1b[1m", 4); 
 
+    char tag[24] = "OPN";
+    if (editorPagerActive()) strcpy(tag, "RO");
+    else if (editorBufferCount() > 1) snprintf(tag, sizeof(tag), "%d/%d", editorBufferCurrent() + 1, editorBufferCount());
+
+    int numrows = editorPagerActive() ? editorPagerLines() : editor.numrows;
+
     int len = snprintf(
         status, sizeof(status),
-        "[OPN] %.20s - %d lines %s",
+        "[%s] %.20s - %d lines %s",
+        tag,
         editor.fileName ? editor.fileName : "NO FILE",
-        editor.numrows,
+        numrows,
         editor.unsaved ? "(modified)" : ""
     );
 
-    int rlen = (editor.cy + 1) <= editor.numrows ? 
-        snprintf(rstatus, sizeof(rstatus), "%s | %d/%d", (editor.syntax ? editor.syntax->fileType : "no ft"), editor.cy + 1, editor.numrows) : 
+    char index[136] = "", part[24]; // five parts and their separators
+    if (editorPagerStatus(part, sizeof(part))) strcat(strcat(index, part), " | ");
+    if (editorSelectStatus(part, sizeof(part))) strcat(strcat(index, part), " | ");
+    if (editorCursorStatus(part, sizeof(part))) strcat(strcat(index, part), " | ");
+    if (editorSaveStatus(part, sizeof(part))) strcat(strcat(index, part), " | ");
+    if (editorTrigramStatus(part, sizeof(part))) strcat(strcat(index, part), " | ");
+
+    int rlen = (editor.cy + 1) <= numrows ? 
+        snprintf(rstatus, sizeof(rstatus), "%s%s | %d/%d", index, (editor.syntax ? editor.syntax->fileType : "no ft"), editor.cy + 1, numrows) : 
         //snprintf(rstatus, sizeof(rstatus), "CX: %d, CY: %d", editor.cx, editor.cy) : 
         snprintf(rstatus, sizeof(rstatus), "END OF FILE");
 
+    if (rlen >= (int)sizeof(rstatus)) rlen = sizeof(rstatus) - 1;
     if (rlen > editor.screenCols) rlen = editor.screenCols;
     if (len > editor.screenCols) len = editor.screenCols;
     abAppend(ab, status, len);
@@ -257,7 +544,17 @@ void editorDrawStatusBar(struct abuf *ab)
         }
     }
     abAppend(ab,"\x1b[m", 3);
-    abAppend(ab, "\r\n", 2);
+    if (!origin.windowed) abAppend(ab, "\r\n", 2);
+}
+
+/**
+ * @brief Timer callback redrawing the screen once the status message has timed out.
+*/
+static void editorStatusExpired(int fd, void *arg)
+{
+    (void)fd;
+    (void)arg;
+    editorEventRequestRedraw();
 }
 
 /**
@@ -266,6 +563,8 @@ void editorDrawStatusBar(struct abuf *ab)
 */
 void editorSetStatusMessage(const char* fmt, ...)
 {
+    static int statusTimer = -1;
+
     va_list ap;
     va_start(ap, fmt);
     vsnprintf(editor.statusmsg, sizeof(editor.statusmsg), fmt, ap);
@@ -273,6 +572,12 @@ void editorSetStatusMessage(const char* fmt, ...)
 
     // stores CURRENT time to statusmsg_time => time(NULL)
     editor.statusmsg_time = time(NULL);
+
+    // wake up when the message expires instead of waiting for the next keypress
+    if (statusTimer == -1)
+        statusTimer = editorEventAddTimer(STATUS_TIMEOUT * 1000, 0, editorStatusExpired, NULL);
+    else
+        editorEventArmTimer(statusTimer, STATUS_TIMEOUT * 1000, 0);
 }
 
 /**
@@ -281,11 +586,25 @@ void editorSetStatusMessage(const char* fmt, ...)
 void editorDrawMessageBar(struct abuf *ab)
 {
     abAppend(ab, "\x1b[K", 3);
+
+    // spans the whole screen, not just the active window
+    int cols = editorWindowScreenCols();
+
+    // latency overlay takes the bar unless a prompt is using it
+    char lat[256];
+    int latlen = editor.statusmsg_keep ? 0 : editorLatencyOverlay(lat, sizeof(lat));
+    if (latlen)
+    {
+        if (latlen > cols) latlen = cols;
+        abAppend(ab, lat, latlen);
+        return;
+    }
+
     int msglen = strlen(editor.statusmsg);
 
-    if (msglen > editor.screenCols) msglen = editor.screenCols;
+    if (msglen > cols) msglen = cols;
 
-    if (msglen && time(NULL) - editor.statusmsg_time < 5)
+    if (msglen && (editor.statusmsg_keep || time(NULL) - editor.statusmsg_time < STATUS_TIMEOUT))
     {
         abAppend(ab, editor.statusmsg, msglen);
     }
@@ -0,0 +1,687 @@
+#include "../lib/pager.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/event.h"
+#include "../lib/input.h"
+#include "../lib/jobs.h"
+#include "../lib/output.h"
+#include "../lib/regex.h"
+#include "../lib/search.h"
+#include "../lib/syntax.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Read-only viewing of files too big to hold as rows (-R). The file is mapped and never copied:
+ * all that is kept per line is where it starts, as 4 bytes relative to its segment. Segments are
+ * `PAGER_SEGMENT_BYTES` slices of the file, each indexed by one job, so a multi-GB file is
+ * indexed on every worker while its first lines are already shown. `editorDrawRows` gets lines
+ * rendered straight from the mapping, one screen width at a time.
+*/
+
+#define PAGER_NONE ((size_t)-1)
+
+struct pagerSegment
+{
+    size_t from, to; // bytes of the file
+    uint32_t *starts; // lines starting in [from, to), relative to `from`
+    int count;
+    int first; // line number of `starts[0]`, set once the segments before are ready
+    atomic_int ready; // set by the job once `starts` is complete
+};
+
+static struct
+{
+    int active;
+    const char *map;
+    size_t size;
+
+    struct pagerSegment *segs;
+    int numsegs;
+    int ready; // leading segments indexed, so their lines are numbered
+    int lines; // lines in those segments
+    struct editorJobToken *token;
+
+    // last query, kept for n and N
+    struct searchPattern *pattern;
+    struct regex *re;
+    struct regexMatcher *matcher;
+    int regex; // toggled with Ctrl-R in the prompt
+    size_t matchAt, matchLen; // the match jumped to, drawn until Esc
+} pager;
+
+/**
+ * @brief Indexing job: records where the lines of one segment start.
+*/
+static void pagerIndex(void *arg, struct editorJobToken *token)
+{
+    (void)token;
+    struct pagerSegment *seg = arg;
+    const char *s = &pager.map[seg->from];
+    int cap = 1024;
+
+    seg->starts = malloc(sizeof(uint32_t) * cap);
+    if (seg->from == 0 || pager.map[seg->from - 1] == '\n') seg->starts[seg->count++] = 0;
+
+    // a line break on the last byte starts a line of the next segment
+    const char *p = s, *end = &pager.map[seg->to - 1];
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL)
+    {
+        if (seg->count == cap)
+        {
+            cap *= 2;
+            seg->starts = realloc(seg->starts, sizeof(uint32_t) * cap);
+        }
+        seg->starts[seg->count++] = ++p - s;
+    }
+
+    seg->starts = realloc(seg->starts, sizeof(uint32_t) * (seg->count ? seg->count : 1));
+    atomic_store(&seg->ready, 1);
+}
+
+static void pagerIndexed(void *arg, struct editorJobToken *token)
+{
+    (void)arg;
+    (void)token;
+    editorEventRequestRedraw();
+}
+
+/**
+ * @brief Numbers the lines of segments that became ready, as long as all before them are.
+*/
+static void pagerAdvance()
+{
+    while (pager.ready < pager.numsegs && atomic_load(&pager.segs[pager.ready].ready))
+    {
+        struct pagerSegment *seg = &pager.segs[pager.ready++];
+        seg->first = pager.lines;
+        pager.lines += seg->count;
+    }
+}
+
+/**
+ * @brief Makes sure segment `k` and the ones before it are numbered, indexing the rest here if needed.
+*/
+static void pagerWait(int k)
+{
+    pagerAdvance();
+    if (pager.ready > k) return;
+
+    editorJobWait(pager.token);
+    pagerAdvance();
+}
+
+/**
+ * @return Offset in the file of numbered line `line`.
+*/
+static size_t pagerLineStart(int line)
+{
+    // the last segment whose first line is at or before `line`, which has that line
+    int lo = 0, hi = pager.ready - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (pager.segs[mid].first <= line) lo = mid;
+        else hi = mid - 1;
+    }
+
+    struct pagerSegment *seg = &pager.segs[lo];
+    return seg->from + seg->starts[line - seg->first];
+}
+
+/**
+ * @brief Text of numbered line `line`, without its line break, straight from the mapping.
+*/
+static const char *pagerLine(int line, size_t *len)
+{
+    size_t start = pagerLineStart(line);
+    const char *s = &pager.map[start];
+    const char *nl = memchr(s, '\n', pager.size - start);
+
+    *len = nl ? (size_t)(nl - s) : pager.size - start;
+    while (*len > 0 && s[*len - 1] == '\r') (*len)--;
+    if (*len > INT_MAX) *len = INT_MAX;
+    return s;
+}
+
+/**
+ * @return Number of the line holding file offset `at`, waiting for indexing to get there.
+*/
+static int pagerLineOf(size_t at)
+{
+    int k = at / PAGER_SEGMENT_BYTES;
+    pagerWait(k);
+
+    // the last line start in the segment at or before `at`, none means a line from before it
+    struct pagerSegment *seg = &pager.segs[k];
+    uint32_t rel = at - seg->from;
+    int lo = 0, hi = seg->count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (seg->starts[mid] <= rel) lo = mid + 1;
+        else hi = mid;
+    }
+    return seg->first + lo - 1;
+}
+
+/**
+ * @brief Maps `fileName` read-only and starts indexing its lines in the background.
+ * @return 0, or -1 with `errno` set if it can't be opened or mapped.
+*/
+int editorPagerOpen(const char *fileName)
+{
+    int fd = open(fileName, O_RDONLY);
+    if (fd == -1) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    pager.size = st.st_size;
+    if (pager.size)
+    {
+        void *map = mmap(NULL, pager.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+        pager.map = map;
+    }
+    close(fd);
+
+    free(editor.fileName);
+    editor.fileName = strdup(fileName);
+    pager.active = 1;
+
+    pager.numsegs = (pager.size + PAGER_SEGMENT_BYTES - 1) / PAGER_SEGMENT_BYTES;
+    pager.segs = calloc(pager.numsegs ? pager.numsegs : 1, sizeof(struct pagerSegment));
+    pager.token = editorJobTokenNew();
+
+    for (int k = 0; k < pager.numsegs; k++)
+    {
+        pager.segs[k].from = (size_t)k * PAGER_SEGMENT_BYTES;
+        pager.segs[k].to = pager.segs[k].from + PAGER_SEGMENT_BYTES;
+        if (pager.segs[k].to > pager.size) pager.segs[k].to = pager.size;
+        editorJobSubmit(pager.token, pagerIndex, pagerIndexed, &pager.segs[k]);
+    }
+    return 0;
+}
+
+int editorPagerActive()
+{
+    return pager.active;
+}
+
+/**
+ * @return Lines numbered so far, all of them once indexing is done.
+*/
+int editorPagerLines()
+{
+    pagerAdvance();
+    return pager.lines;
+}
+
+/**
+ * @brief Render column of byte `cx` of line `line`, tabs expanded.
+*/
+int editorPagerCxToRx(int line, int cx)
+{
+    if (line >= editorPagerLines()) return 0;
+
+    size_t len;
+    const char *s = pagerLine(line, &len);
+    if ((size_t)cx > len) cx = len;
+
+    int rx = 0;
+    for (int i = 0; i < cx; )
+    {
+        const char *tab = memchr(&s[i], '\t', cx - i);
+        int run = (tab ? tab - s : cx) - i;
+
+        rx += run;
+        i += run;
+        if (i < cx)
+        {
+            rx += TAB_STOP - (rx % TAB_STOP);
+            i++;
+        }
+    }
+    return rx;
+}
+
+/**
+ * @brief Renders render columns [coloff, coloff + cols) of line `line` from the mapping, with
+ * @brief matches of the last literal query and the match jumped to marked `HL_MATCH`.
+ * @param render Set to the rendered columns, valid until the next call.
+ * @param hl Set to their highlight, likewise.
+ * @return Number of columns rendered, 0 if the line ends left of `coloff`.
+*/
+int editorPagerRender(int line, int coloff, int cols, char **render, unsigned char **hl)
+{
+    static char *cells = NULL;
+    static unsigned char *cellhl = NULL;
+    static int cap = 0;
+
+    if (cols > cap)
+    {
+        cap = cols;
+        cells = realloc(cells, cap);
+        cellhl = realloc(cellhl, cap);
+    }
+    *render = cells;
+    *hl = cellhl;
+    if (cols <= 0) return 0;
+
+    size_t len;
+    const char *s = pagerLine(line, &len);
+    size_t start = s - pager.map;
+    size_t i = 0;
+    int rx = 0;
+
+    // skip what is left of the view, a tab across its edge is drawn in part
+    while (i < len && rx < coloff)
+    {
+        if (s[i] == '\t')
+        {
+            int width = TAB_STOP - (rx % TAB_STOP);
+            if (rx + width > coloff) break;
+            rx += width;
+            i++;
+            continue;
+        }
+
+        const char *tab = memchr(&s[i], '\t', len - i);
+        size_t run = (tab ? (size_t)(tab - s) : len) - i;
+        if (run > (size_t)(coloff - rx)) run = coloff - rx;
+        i += run;
+        rx += run;
+    }
+
+    // every byte takes a column at least, so literal matches are only looked for around the view
+    const struct searchPattern *p = pager.regex ? NULL : pager.pattern;
+    size_t lo = 0, hi = 0, matchEnd = 0;
+    int next = -1;
+    if (p)
+    {
+        lo = i > (size_t)p->len ? i - p->len : 0;
+        hi = i + cols + p->len < len ? i + cols + p->len : len;
+        next = editorSearchForward(p, &s[lo], hi - lo, 0);
+    }
+
+    while (i < len && rx < coloff + cols)
+    {
+        // `matchEnd` is the end of the matches started so far
+        while (next != -1 && lo + next <= i)
+        {
+            if (lo + next + p->len > matchEnd) matchEnd = lo + next + p->len;
+            next = editorSearchForward(p, &s[lo], hi - lo, next + 1);
+        }
+        int matched = i < matchEnd || (start + i >= pager.matchAt && start + i < pager.matchAt + pager.matchLen);
+        unsigned char color = matched ? HL_MATCH : HL_NORMAL;
+
+        if (s[i] == '\t')
+        {
+            int width = TAB_STOP - (rx % TAB_STOP);
+            for (int col = rx; col < rx + width; col++)
+            {
+                if (col < coloff || col >= coloff + cols) continue;
+                cells[col - coloff] = ' ';
+                cellhl[col - coloff] = color;
+            }
+            rx += width;
+        }
+        else
+        {
+            cells[rx - coloff] = s[i];
+            cellhl[rx - coloff] = color;
+            rx++;
+        }
+        i++;
+    }
+
+    if (rx <= coloff) return 0;
+    return rx - coloff < cols ? rx - coloff : cols;
+}
+
+/**
+ * @return Length of `editorPagerStatus`'s part, 0 once indexing is done.
+*/
+int editorPagerStatus(char *buf, int size)
+{
+    if (!pager.active) return 0;
+
+    pagerAdvance();
+    if (pager.ready == pager.numsegs) return 0;
+
+    size_t done = pager.ready ? pager.segs[pager.ready - 1].to : 0;
+    return snprintf(buf, size, "lines %d%%", (int)(done * 100 / pager.size));
+}
+
+/**
+ * @brief Literal search over the mapping, a segment's worth at a time since lengths are `int`.
+ * @param from First start considered going forward, or last one going backward.
+*/
+static size_t pagerFindLiteral(size_t from, int direction)
+{
+    const struct searchPattern *p = pager.pattern;
+    size_t span = PAGER_SEGMENT_BYTES + p->len - 1;
+
+    if (direction > 0)
+    {
+        for (size_t at = from; at < pager.size; at += PAGER_SEGMENT_BYTES)
+        {
+            size_t len = pager.size - at < span ? pager.size - at : span;
+            int i = editorSearchForward(p, &pager.map[at], len, 0);
+            if (i != -1) return at + i;
+        }
+        return PAGER_NONE;
+    }
+
+    size_t end = from + p->len < pager.size ? from + p->len : pager.size;
+    for (;;)
+    {
+        size_t start = end > span ? end - span : 0;
+        int i = editorSearchBackward(p, &pager.map[start], end - start, (int)(end - start) - p->len);
+        if (i != -1) return start + i;
+        if (start == 0) return PAGER_NONE;
+        end = start + p->len - 1;
+    }
+}
+
+/**
+ * @brief Regex search over the mapping, line by line as rows are searched when editing.
+*/
+static size_t pagerFindRegex(size_t from, int direction, size_t *mlen)
+{
+    if (from >= pager.size)
+    {
+        if (direction > 0) return PAGER_NONE;
+        from = pager.size - 1;
+    }
+
+    const char *ls = memrchr(pager.map, '\n', from);
+    size_t start = ls ? (size_t)(ls - pager.map) + 1 : 0;
+
+    for (;;)
+    {
+        const char *s = &pager.map[start];
+        const char *nl = memchr(s, '\n', pager.size - start);
+        size_t len = nl ? (size_t)(nl - s) : pager.size - start;
+        while (len > 0 && s[len - 1] == '\r') len--;
+
+        size_t found = PAGER_NONE;
+        int at, n;
+        editorRegexScan(pager.matcher, s, len > INT_MAX / 2 ? INT_MAX / 2 : len);
+        while (editorRegexNext(pager.matcher, &at, &n))
+        {
+            if (direction > 0 && start + at < from) continue;
+            if (direction < 0 && start + at > from) break;
+
+            found = start + at;
+            *mlen = n;
+            if (direction > 0) break;
+        }
+        if (found != PAGER_NONE) return found;
+
+        if (direction > 0)
+        {
+            if (nl == NULL) return PAGER_NONE;
+            start = nl - pager.map + 1;
+        }
+        else
+        {
+            if (start == 0) return PAGER_NONE;
+            ls = start > 1 ? memrchr(pager.map, '\n', start - 1) : NULL;
+            start = ls ? (size_t)(ls - pager.map) + 1 : 0;
+        }
+    }
+}
+
+static size_t pagerFindFrom(size_t from, int direction, size_t *mlen)
+{
+    if (pager.re) return pagerFindRegex(from, direction, mlen);
+
+    *mlen = pager.pattern->len;
+    return pagerFindLiteral(from, direction);
+}
+
+/**
+ * @return File offset of the cursor.
+*/
+static size_t pagerCursor()
+{
+    if (editor.cy >= editorPagerLines()) return 0;
+    return pagerLineStart(editor.cy) + editor.cx;
+}
+
+/**
+ * @brief Jumps to the next match of the last query from the cursor, wrapping around the file.
+ * @param skip Whether a match at the cursor itself is passed over, as with n and N.
+*/
+static void pagerFindNext(int direction, int skip)
+{
+    if (pager.pattern == NULL && pager.re == NULL)
+    {
+        editorSetStatusMessage("No previous search - Ctrl-F to find.");
+        return;
+    }
+
+    size_t cursor = pagerCursor();
+    size_t from = cursor;
+    if (skip && direction > 0) from++;
+    if (skip && direction < 0)
+    {
+        if (cursor == 0) from = pager.size;
+        else from--;
+    }
+
+    size_t mlen;
+    size_t at = pagerFindFrom(from, direction, &mlen);
+    int wrapped = 0;
+    if (at == PAGER_NONE && pager.size)
+    {
+        at = pagerFindFrom(direction > 0 ? 0 : pager.size - 1, direction, &mlen);
+        wrapped = 1;
+    }
+
+    if (at == PAGER_NONE)
+    {
+        pager.matchLen = 0;
+        editorSetStatusMessage("No matches");
+        return;
+    }
+
+    editor.cy = pagerLineOf(at);
+    editor.cx = at - pagerLineStart(editor.cy);
+    editor.rowoff = editor.cy;
+    pager.matchAt = at;
+    pager.matchLen = mlen;
+
+    if (wrapped) editorSetStatusMessage(direction > 0 ? "Search wrapped to the top" : "Search wrapped to the bottom");
+}
+
+static char pagerFindPrompt[80];
+
+static void pagerFindSetPrompt()
+{
+    snprintf(pagerFindPrompt, sizeof(pagerFindPrompt), "%s: %%s (Ctrl-R %s/Ctrl-X/Enter)",
+        pager.regex ? "Regex" : "Search", pager.regex ? "literal" : "regex");
+}
+
+static void pagerFindCallback(char *query, int key)
+{
+    (void)query;
+    if (key != CTRL_KEY('r')) return;
+
+    pager.regex = !pager.regex;
+    pagerFindSetPrompt();
+}
+
+/**
+ * @brief Asks for a query and jumps to its first match at or after the cursor.
+*/
+static void pagerFind()
+{
+    pagerFindSetPrompt();
+    char *query = editorPrompt(pagerFindPrompt, pagerFindCallback);
+    if (query == NULL) return;
+
+    editorSearchFree(pager.pattern);
+    editorRegexMatcherFree(pager.matcher);
+    editorRegexFree(pager.re);
+    pager.pattern = NULL;
+    pager.matcher = NULL;
+    pager.re = NULL;
+
+    if (pager.regex)
+    {
+        const char *error = NULL;
+        pager.re = editorRegexCompile(query, strlen(query), &error);
+        if (pager.re == NULL)
+        {
+            editorSetStatusMessage("Bad regex: %s", error);
+            free(query);
+            return;
+        }
+        pager.matcher = editorRegexMatcher(pager.re);
+    }
+    else
+    {
+        pager.pattern = editorSearchCompile(query, strlen(query));
+    }
+    free(query);
+
+    pagerFindNext(1, 0);
+}
+
+/**
+ * @brief Asks for a line number and moves there, waiting for indexing to reach it.
+*/
+static void pagerGoToLine()
+{
+    char *answer = editorPrompt("Go to line: %s (Ctrl-X to cancel)", NULL);
+    if (answer == NULL) return;
+
+    int line = atoi(answer);
+    free(answer);
+
+    if (line > editorPagerLines()) pagerWait(pager.numsegs - 1);
+    if (line > pager.lines) line = pager.lines;
+    if (line < 1) line = 1;
+
+    editor.cy = line - 1;
+    editor.cx = 0;
+}
+
+/**
+ * @brief Keeps the cursor on a line and within it.
+*/
+static void pagerClamp()
+{
+    int lines = editorPagerLines();
+    if (editor.cy > lines - 1) editor.cy = lines - 1;
+    if (editor.cy < 0) editor.cy = 0;
+
+    size_t len = 0;
+    if (lines) pagerLine(editor.cy, &len);
+    if ((size_t)editor.cx > len) editor.cx = len;
+}
+
+/**
+ * @brief Handles a key in the pager: movement, Ctrl-F, n and N, Ctrl-G. Keys that would edit are
+ * @brief refused.
+ * @return 1 if the key was handled, 0 if not in the pager or for Ctrl-Q and Ctrl-T, which work
+ * @return as usual.
+*/
+int editorPagerKey(int c)
+{
+    if (!pager.active) return 0;
+
+    size_t len = 0;
+    if (editor.cy < editorPagerLines()) pagerLine(editor.cy, &len);
+
+    switch (c)
+    {
+        case CTRL_KEY('q'):
+        case CTRL_KEY('t'):
+            return 0;
+
+        case ARROW_UP:
+            if (editor.cy > 0) editor.cy--;
+            break;
+
+        case ARROW_DOWN:
+            editor.cy++;
+            break;
+
+        case ARROW_LEFT:
+            if (editor.cx > 0) editor.cx--;
+            else if (editor.cy > 0)
+            {
+                editor.cy--;
+                editor.cx = INT_MAX;
+            }
+            break;
+
+        case ARROW_RIGHT:
+            if ((size_t)editor.cx < len) editor.cx++;
+            else if (editor.cy < pager.lines - 1)
+            {
+                editor.cy++;
+                editor.cx = 0;
+            }
+            break;
+
+        case HOME_KEY:
+            editor.cx = 0;
+            break;
+
+        case END_KEY:
+            editor.cx = len;
+            break;
+
+        case PAGE_UP:
+            editor.cy = editor.rowoff - editor.screenRows;
+            break;
+
+        case PAGE_DOWN:
+            editor.cy = editor.rowoff + 2 * editor.screenRows - 1;
+            break;
+
+        case CTRL_KEY('f'):
+            pagerFind();
+            break;
+
+        case 'n':
+        case 'N':
+            pagerFindNext(c == 'n' ? 1 : -1, 1);
+            break;
+
+        case CTRL_KEY('g'):
+            pagerGoToLine();
+            break;
+
+        case '\x1b':
+            pager.matchLen = 0;
+            break;
+
+        default:
+            editorSetStatusMessage("Read-only: Ctrl-F find, n/N next/previous, Ctrl-G go to line, Ctrl-Q quit");
+    }
+
+    pagerClamp();
+    return 1;
+}
@@ -0,0 +1,851 @@
+#include "../lib/regex.h"
+#include "../lib/const.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+/*
+ * Patterns are parsed into a tree, then compiled twice into Thompson NFAs: once as written and
+ * once reversed. Matching never walks the NFAs directly; each matcher turns them into DFAs one
+ * state at a time, the first time a (state, byte) pair is seen, so running time is linear in
+ * the text whatever the pattern.
+ *
+ * Supported: literals, `.`, `[...]`/`[^...]` with ranges, `\d \w \s \D \W \S \t \n \r`,
+ * `^`, `$`, `(...)`, `(?:...)`, `|`, `*`, `+`, `?`, `{m}`, `{m,}`, `{m,n}`.
+ * Matches are leftmost-longest, as in POSIX.
+*/
+
+enum regexAstType
+{
+    AST_EMPTY = 0,
+    AST_CLASS,
+    AST_CAT,
+    AST_ALT,
+    AST_REPEAT,
+    AST_BOL,
+    AST_EOL
+};
+
+struct regexAst
+{
+    int type;
+    int left, right; // children, indices into the parser's node array
+    int min, max; // AST_REPEAT bounds, `max` is -1 when unbounded
+    unsigned char cls[32]; // AST_CLASS bitmap of accepted bytes
+};
+
+struct regexParser
+{
+    const unsigned char *pat;
+    int len, pos;
+    struct regexAst *nodes;
+    int count, cap;
+    const char *error;
+};
+
+enum regexNodeType
+{
+    NFA_CLASS = 0,
+    NFA_SPLIT,
+    NFA_BOL, // passes only where the scan begins
+    NFA_EOL, // passes only where the scan ends
+    NFA_MATCH
+};
+
+struct regexNode
+{
+    unsigned char type;
+    int out, out1;
+    unsigned char cls[32];
+};
+
+struct regexProgram
+{
+    struct regexNode *nodes;
+    int count, cap;
+    int start;
+};
+
+struct regex
+{
+    struct regexProgram fwd; // anchored at the match start, finds the longest end
+    struct regexProgram rev; // runs right to left over the row, marks where matches start
+};
+
+struct dfaState
+{
+    struct dfaState *next[256]; // NULL until the transition is first taken
+    int match; // a match ends here
+    int matchAtEnd; // a match ends here if this is also the end of the text
+    int n;
+    int set[]; // sorted NFA nodes
+};
+
+struct dfa
+{
+    const struct regexProgram *prog;
+    int unanchored; // a new match may begin at every byte
+    struct dfaState **table; // open addressing on the NFA node set
+    int count;
+    int generation; // bumped when the cache is flushed
+    struct dfaState *start[2]; // indexed by whether the scan begins here
+};
+
+struct regexMatcher
+{
+    struct dfa fwd, rev;
+
+    int *mark; // closure bookkeeping, nodes with `mark == stamp` are already in the set
+    int stamp;
+    int *stack;
+    int *buf;
+    int *tmp;
+
+    const char *text;
+    int len;
+    int pos;
+    unsigned char *starts; // 1 where a match starts, from the reverse scan
+    int startscap;
+};
+
+static void classSet(unsigned char *cls, int c)
+{
+    cls[c >> 3] |= 1 << (c & 7);
+}
+
+static int classHas(const unsigned char *cls, int c)
+{
+    return cls[c >> 3] & (1 << (c & 7));
+}
+
+static void classRange(unsigned char *cls, int lo, int hi)
+{
+    for (int c = lo; c <= hi; c++) classSet(cls, c);
+}
+
+static void classInvert(unsigned char *cls)
+{
+    for (int i = 0; i < 32; i++) cls[i] = ~cls[i];
+}
+
+/*** parser ***/
+
+static int astNew(struct regexParser *ps, int type)
+{
+    if (ps->count == ps->cap)
+    {
+        ps->cap = ps->cap ? ps->cap * 2 : 32;
+        ps->nodes = realloc(ps->nodes, sizeof(struct regexAst) * ps->cap);
+    }
+
+    struct regexAst *a = &ps->nodes[ps->count];
+    memset(a, 0, sizeof(struct regexAst));
+    a->type = type;
+    a->left = a->right = -1;
+
+    return ps->count++;
+}
+
+static int astPair(struct regexParser *ps, int type, int left, int right)
+{
+    int a = astNew(ps, type);
+    ps->nodes[a].left = left;
+    ps->nodes[a].right = right;
+    return a;
+}
+
+static int astByte(struct regexParser *ps, int c)
+{
+    int a = astNew(ps, AST_CLASS);
+    classSet(ps->nodes[a].cls, c);
+    return a;
+}
+
+/**
+ * @brief Parses the escape after a backslash.
+ * @param cls Filled with the bytes of a class escape such as `\d`.
+ * @return The literal byte, or -1 if the escape was a class.
+*/
+static int parseEscape(struct regexParser *ps, unsigned char *cls)
+{
+    if (ps->pos >= ps->len)
+    {
+        ps->error = "trailing \\";
+        return -1;
+    }
+
+    int c = ps->pat[ps->pos++];
+
+    switch (c)
+    {
+        case 'd':
+        case 'D':
+            classRange(cls, '0', '9');
+            break;
+        case 'w':
+        case 'W':
+            classRange(cls, 'a', 'z');
+            classRange(cls, 'A', 'Z');
+            classRange(cls, '0', '9');
+            classSet(cls, '_');
+            break;
+        case 's':
+        case 'S':
+            for (const char *s = " \t\n\r\f\v"; *s; s++) classSet(cls, *s);
+            break;
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        default: return c;
+    }
+
+    if (c == 'D' || c == 'W' || c == 'S') classInvert(cls);
+    return -1;
+}
+
+/**
+ * @brief Parses a bracket expression, the opening `[` is already consumed.
+*/
+static int parseClass(struct regexParser *ps)
+{
+    unsigned char cls[32] = {0};
+    int negate = 0;
+    int first = 1;
+
+    if (ps->pos < ps->len && ps->pat[ps->pos] == '^')
+    {
+        negate = 1;
+        ps->pos++;
+    }
+
+    while (!ps->error)
+    {
+        if (ps->pos >= ps->len)
+        {
+            ps->error = "missing ]";
+            break;
+        }
+
+        int c = ps->pat[ps->pos++];
+        if (c == ']' && !first) break;
+        first = 0;
+
+        int lo = c;
+        if (c == '\\')
+        {
+            unsigned char esc[32] = {0};
+            lo = parseEscape(ps, esc);
+            if (lo == -1)
+            {
+                for (int i = 0; i < 32; i++) cls[i] |= esc[i];
+                continue;
+            }
+        }
+
+        // a range, unless the '-' is the last character before ']'
+        if (ps->pos + 1 < ps->len && ps->pat[ps->pos] == '-' && ps->pat[ps->pos + 1] != ']')
+        {
+            ps->pos++;
+            int hi = ps->pat[ps->pos++];
+
+            if (hi == '\\')
+            {
+                unsigned char esc[32] = {0};
+                hi = parseEscape(ps, esc);
+            }
+            if (hi < lo)
+            {
+                ps->error = "bad class range";
+                break;
+            }
+            classRange(cls, lo, hi);
+        }
+        else classSet(cls, lo);
+    }
+
+    if (negate) classInvert(cls);
+
+    int a = astNew(ps, AST_CLASS);
+    memcpy(ps->nodes[a].cls, cls, 32);
+    return a;
+}
+
+/**
+ * @brief Parses `{m}`, `{m,}` or `{m,n}` at the current position.
+ * @return 1 if a bound was consumed, 0 if the `{` is a literal.
+*/
+static int parseBounds(struct regexParser *ps, int *min, int *max)
+{
+    int pos = ps->pos + 1;
+    int lo = 0, hi, digits = 0;
+
+    // counts are clamped just above the limit so that long digit strings cannot overflow
+    while (pos < ps->len && ps->pat[pos] >= '0' && ps->pat[pos] <= '9')
+    {
+        if (lo <= REGEX_MAX_REPEAT) lo = lo * 10 + (ps->pat[pos] - '0');
+        pos++;
+        digits++;
+    }
+    if (digits == 0) return 0;
+
+    hi = lo;
+    if (pos < ps->len && ps->pat[pos] == ',')
+    {
+        pos++;
+        hi = -1;
+        if (pos < ps->len && ps->pat[pos] >= '0' && ps->pat[pos] <= '9')
+        {
+            hi = 0;
+            while (pos < ps->len && ps->pat[pos] >= '0' && ps->pat[pos] <= '9')
+            {
+                if (hi <= REGEX_MAX_REPEAT) hi = hi * 10 + (ps->pat[pos] - '0');
+                pos++;
+            }
+        }
+    }
+    if (pos >= ps->len || ps->pat[pos] != '}') return 0;
+
+    if (lo > REGEX_MAX_REPEAT || hi > REGEX_MAX_REPEAT) ps->error = "repeat count too large";
+    else if (hi != -1 && hi < lo) ps->error = "bad repeat range";
+
+    ps->pos = pos + 1;
+    *min = lo;
+    *max = hi;
+    return 1;
+}
+
+static int parseAlt(struct regexParser *ps);
+
+static int parseAtom(struct regexParser *ps)
+{
+    int c = ps->pat[ps->pos++];
+    int a;
+
+    switch (c)
+    {
+        case '(':
+            if (ps->pos + 1 < ps->len && ps->pat[ps->pos] == '?' && ps->pat[ps->pos + 1] == ':') ps->pos += 2;
+
+            a = parseAlt(ps);
+            if (!ps->error && (ps->pos >= ps->len || ps->pat[ps->pos] != ')')) ps->error = "missing )";
+            ps->pos++;
+            return a;
+
+        case '[':
+            return parseClass(ps);
+
+        case '.':
+            a = astNew(ps, AST_CLASS);
+            memset(ps->nodes[a].cls, 0xff, 32);
+            return a;
+
+        case '^':
+            return astNew(ps, AST_BOL);
+
+        case '$':
+            return astNew(ps, AST_EOL);
+
+        case '*':
+        case '+':
+        case '?':
+            ps->error = "nothing to repeat";
+            return astNew(ps, AST_EMPTY);
+
+        case '\\':
+        {
+            unsigned char esc[32] = {0};
+            int lit = parseEscape(ps, esc);
+            if (lit != -1) return astByte(ps, lit);
+
+            a = astNew(ps, AST_CLASS);
+            memcpy(ps->nodes[a].cls, esc, 32);
+            return a;
+        }
+
+        default:
+            return astByte(ps, c);
+    }
+}
+
+static int parseRepeat(struct regexParser *ps)
+{
+    int a = parseAtom(ps);
+
+    while (!ps->error && ps->pos < ps->len)
+    {
+        int c = ps->pat[ps->pos];
+        int min, max;
+
+        if (c == '*') min = 0, max = -1;
+        else if (c == '+') min = 1, max = -1;
+        else if (c == '?') min = 0, max = 1;
+        else if (c != '{' || !parseBounds(ps, &min, &max)) break;
+
+        if (c != '{') ps->pos++;
+
+        int r = astPair(ps, AST_REPEAT, a, -1);
+        ps->nodes[r].min = min;
+        ps->nodes[r].max = max;
+        a = r;
+    }
+    return a;
+}
+
+static int parseCat(struct regexParser *ps)
+{
+    int left = -1;
+
+    while (!ps->error && ps->pos < ps->len && ps->pat[ps->pos] != '|' && ps->pat[ps->pos] != ')')
+    {
+        int right = parseRepeat(ps);
+        left = (left == -1) ? right : astPair(ps, AST_CAT, left, right);
+    }
+    return (left == -1) ? astNew(ps, AST_EMPTY) : left;
+}
+
+static int parseAlt(struct regexParser *ps)
+{
+    int left = parseCat(ps);
+
+    while (!ps->error && ps->pos < ps->len && ps->pat[ps->pos] == '|')
+    {
+        ps->pos++;
+        int right = parseCat(ps);
+        left = astPair(ps, AST_ALT, left, right);
+    }
+    return left;
+}
+
+/*** compiler ***/
+
+struct regexCompiler
+{
+    const struct regexAst *ast;
+    struct regexProgram *prog;
+    int reverse;
+    const char *error;
+};
+
+static int progNode(struct regexProgram *p, int type, int out, int out1)
+{
+    if (p->count == p->cap)
+    {
+        p->cap = p->cap ? p->cap * 2 : 64;
+        p->nodes = realloc(p->nodes, sizeof(struct regexNode) * p->cap);
+    }
+
+    struct regexNode *node = &p->nodes[p->count];
+    memset(node, 0, sizeof(struct regexNode));
+    node->type = type;
+    node->out = out;
+    node->out1 = out1;
+
+    return p->count++;
+}
+
+/**
+ * @brief Emits the NFA for tree node `a`, continuing to NFA node `next` once it has matched.
+ * @note Built back to front, so every fragment knows its continuation and nothing needs patching.
+ * @return The fragment's entry node.
+*/
+static int emit(struct regexCompiler *cc, int a, int next)
+{
+    struct regexProgram *p = cc->prog;
+
+    if (cc->error) return next;
+    if (p->count >= REGEX_MAX_NODES)
+    {
+        cc->error = "pattern too large";
+        return next;
+    }
+
+    const struct regexAst *node = &cc->ast[a];
+    int n, cur;
+
+    switch (node->type)
+    {
+        case AST_CLASS:
+            n = progNode(p, NFA_CLASS, next, -1);
+            memcpy(p->nodes[n].cls, node->cls, 32);
+            return n;
+
+        case AST_BOL:
+            return progNode(p, cc->reverse ? NFA_EOL : NFA_BOL, next, -1);
+
+        case AST_EOL:
+            return progNode(p, cc->reverse ? NFA_BOL : NFA_EOL, next, -1);
+
+        case AST_CAT:
+            if (cc->reverse) return emit(cc, node->right, emit(cc, node->left, next));
+            return emit(cc, node->left, emit(cc, node->right, next));
+
+        case AST_ALT:
+            n = emit(cc, node->left, next);
+            return progNode(p, NFA_SPLIT, n, emit(cc, node->right, next));
+
+        case AST_REPEAT:
+            cur = next;
+            if (node->max == -1)
+            {
+                n = progNode(p, NFA_SPLIT, -1, next);
+                int body = emit(cc, node->left, n);
+                p->nodes[n].out = body;
+                cur = n;
+            }
+            else
+            {
+                // x{0,k} is (x(x(...)?)?)?, every optional copy may skip to `next`
+                for (int k = 0; k < node->max - node->min; k++)
+                    cur = progNode(p, NFA_SPLIT, emit(cc, node->left, cur), next);
+            }
+            for (int k = 0; k < node->min; k++) cur = emit(cc, node->left, cur);
+            return cur;
+
+        default:
+            return next;
+    }
+}
+
+static const char *compileProgram(struct regexProgram *p, const struct regexAst *ast, int root, int reverse)
+{
+    struct regexCompiler cc = { ast, p, reverse, NULL };
+
+    int match = progNode(p, NFA_MATCH, -1, -1);
+    p->start = emit(&cc, root, match);
+
+    return cc.error;
+}
+
+/**
+ * @brief Compiles `pat` into forward and reversed programs.
+ * @param error Set to a short message when the pattern is invalid.
+ * @return The compiled pattern, NULL on error. Free with `editorRegexFree`.
+*/
+struct regex *editorRegexCompile(const char *pat, int len, const char **error)
+{
+    struct regexParser ps = { (const unsigned char *)pat, len, 0, NULL, 0, 0, NULL };
+
+    int root = parseAlt(&ps);
+    if (!ps.error && ps.pos < ps.len) ps.error = "unmatched )";
+
+    struct regex *re = calloc(1, sizeof(struct regex));
+
+    if (!ps.error) ps.error = compileProgram(&re->fwd, ps.nodes, root, 0);
+    if (!ps.error) ps.error = compileProgram(&re->rev, ps.nodes, root, 1);
+
+    free(ps.nodes);
+
+    if (ps.error)
+    {
+        if (error) *error = ps.error;
+        editorRegexFree(re);
+        return NULL;
+    }
+    return re;
+}
+
+void editorRegexFree(struct regex *re)
+{
+    if (re == NULL) return;
+    free(re->fwd.nodes);
+    free(re->rev.nodes);
+    free(re);
+}
+
+/*** lazy DFA ***/
+
+/**
+ * @brief Adds NFA node `s` and everything reachable from it without consuming a byte.
+ * @note `^` and `$` nodes pass only where the scan begins or ends; a `$` that cannot pass yet
+ * @note stays in the set, so `matchAtEnd` can be decided once the state exists.
+*/
+static void closureAdd(struct regexMatcher *m, const struct regexProgram *p, int s, int atBegin, int atEnd, int *out, int *n)
+{
+    int top = 0;
+
+    if (m->mark[s] == m->stamp) return;
+    m->mark[s] = m->stamp;
+    m->stack[top++] = s;
+
+    while (top)
+    {
+        int x = m->stack[--top];
+        const struct regexNode *node = &p->nodes[x];
+        int follow[2] = { -1, -1 };
+
+        switch (node->type)
+        {
+            case NFA_SPLIT:
+                follow[0] = node->out;
+                follow[1] = node->out1;
+                break;
+            case NFA_BOL:
+                if (atBegin) follow[0] = node->out;
+                break;
+            case NFA_EOL:
+                if (atEnd) follow[0] = node->out;
+                else out[(*n)++] = x;
+                break;
+            default:
+                out[(*n)++] = x;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (follow[i] != -1 && m->mark[follow[i]] != m->stamp)
+            {
+                m->mark[follow[i]] = m->stamp;
+                m->stack[top++] = follow[i];
+            }
+        }
+    }
+}
+
+static void newStamp(struct regexMatcher *m, int size)
+{
+    if (++m->stamp == INT_MAX)
+    {
+        memset(m->mark, 0, sizeof(int) * size);
+        m->stamp = 1;
+    }
+}
+
+static int cmpInt(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static uint32_t setHash(const int *set, int n)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < n; i++) h = (h ^ (uint32_t)set[i]) * 16777619u;
+    return h;
+}
+
+static void dfaFlush(struct dfa *d)
+{
+    for (int i = 0; i < REGEX_DFA_STATES * 2; i++)
+    {
+        free(d->table[i]);
+        d->table[i] = NULL;
+    }
+    d->count = 0;
+    d->start[0] = d->start[1] = NULL;
+    d->generation++;
+}
+
+/**
+ * @brief Finds or creates the DFA state for an NFA node set. A full cache is flushed first.
+*/
+static struct dfaState *dfaLookup(struct regexMatcher *m, struct dfa *d, int *set, int n)
+{
+    const struct regexProgram *p = d->prog;
+    unsigned mask = REGEX_DFA_STATES * 2 - 1;
+
+    qsort(set, n, sizeof(int), cmpInt);
+    uint32_t h = setHash(set, n);
+    unsigned i;
+
+    for (i = h & mask; d->table[i]; i = (i + 1) & mask)
+    {
+        struct dfaState *s = d->table[i];
+        if (s->n == n && !memcmp(s->set, set, sizeof(int) * n)) return s;
+    }
+
+    if (d->count >= REGEX_DFA_STATES)
+    {
+        dfaFlush(d);
+        i = h & mask;
+    }
+
+    struct dfaState *s = calloc(1, sizeof(struct dfaState) + sizeof(int) * n);
+    s->n = n;
+    memcpy(s->set, set, sizeof(int) * n);
+
+    int pendingEol = 0;
+    for (int k = 0; k < n; k++)
+    {
+        if (p->nodes[set[k]].type == NFA_MATCH) s->match = 1;
+        if (p->nodes[set[k]].type == NFA_EOL) pendingEol = 1;
+    }
+
+    s->matchAtEnd = s->match;
+    if (pendingEol && !s->match)
+    {
+        int count = 0;
+        newStamp(m, p->count);
+        for (int k = 0; k < n; k++)
+        {
+            if (p->nodes[set[k]].type == NFA_EOL) closureAdd(m, p, set[k], 0, 1, m->tmp, &count);
+        }
+        for (int k = 0; k < count; k++)
+        {
+            if (p->nodes[m->tmp[k]].type == NFA_MATCH) s->matchAtEnd = 1;
+        }
+    }
+
+    d->table[i] = s;
+    d->count++;
+    return s;
+}
+
+static struct dfaState *dfaStart(struct regexMatcher *m, struct dfa *d, int atBegin)
+{
+    if (d->start[atBegin]) return d->start[atBegin];
+
+    int n = 0;
+    newStamp(m, d->prog->count);
+    closureAdd(m, d->prog, d->prog->start, atBegin, 0, m->buf, &n);
+
+    struct dfaState *s = dfaLookup(m, d, m->buf, n);
+    d->start[atBegin] = s;
+    return s;
+}
+
+/**
+ * @brief Computes the transition of `s` on byte `c` and caches it in `s->next`.
+*/
+static struct dfaState *dfaStep(struct regexMatcher *m, struct dfa *d, struct dfaState *s, unsigned char c)
+{
+    const struct regexProgram *p = d->prog;
+    int n = 0;
+
+    newStamp(m, p->count);
+    for (int i = 0; i < s->n; i++)
+    {
+        const struct regexNode *node = &p->nodes[s->set[i]];
+        if (node->type == NFA_CLASS && classHas(node->cls, c))
+            closureAdd(m, p, node->out, 0, 0, m->buf, &n);
+    }
+    if (d->unanchored) closureAdd(m, p, p->start, 0, 0, m->buf, &n);
+
+    int generation = d->generation;
+    struct dfaState *next = dfaLookup(m, d, m->buf, n);
+
+    // a flush has freed `s`
+    if (generation == d->generation) s->next[c] = next;
+    return next;
+}
+
+static void dfaInit(struct dfa *d, const struct regexProgram *p, int unanchored)
+{
+    memset(d, 0, sizeof(struct dfa));
+    d->prog = p;
+    d->unanchored = unanchored;
+    d->table = calloc(REGEX_DFA_STATES * 2, sizeof(struct dfaState *));
+}
+
+/**
+ * @brief Creates a matcher for `re`. Matchers are not thread safe, use one per thread.
+*/
+struct regexMatcher *editorRegexMatcher(const struct regex *re)
+{
+    struct regexMatcher *m = calloc(1, sizeof(struct regexMatcher));
+    int size = re->fwd.count > re->rev.count ? re->fwd.count : re->rev.count;
+
+    dfaInit(&m->fwd, &re->fwd, 0);
+    dfaInit(&m->rev, &re->rev, 1);
+
+    m->mark = calloc(size, sizeof(int));
+    m->stack = malloc(sizeof(int) * size);
+    m->buf = malloc(sizeof(int) * size);
+    m->tmp = malloc(sizeof(int) * size);
+
+    return m;
+}
+
+void editorRegexMatcherFree(struct regexMatcher *m)
+{
+    if (m == NULL) return;
+
+    dfaFlush(&m->fwd);
+    dfaFlush(&m->rev);
+    free(m->fwd.table);
+    free(m->rev.table);
+    free(m->mark);
+    free(m->stack);
+    free(m->buf);
+    free(m->tmp);
+    free(m->starts);
+    free(m);
+}
+
+/**
+ * @brief Prepares to list the matches in `text` with `editorRegexNext`.
+ * @note One right-to-left pass of the reversed, unanchored DFA marks every byte where some
+ * @note match starts, so finding the leftmost match never needs to try each start in turn.
+*/
+void editorRegexScan(struct regexMatcher *m, const char *text, int len)
+{
+    if (len > m->startscap)
+    {
+        m->startscap = len * 2;
+        m->starts = realloc(m->starts, m->startscap);
+    }
+
+    m->text = text;
+    m->len = len;
+    m->pos = 0;
+
+    struct dfaState *s = dfaStart(m, &m->rev, 1);
+
+    for (int i = len - 1; i >= 0; i--)
+    {
+        unsigned char c = text[i];
+        s = s->next[c] ? s->next[c] : dfaStep(m, &m->rev, s, c);
+        m->starts[i] = s->match || (i == 0 && s->matchAtEnd);
+    }
+}
+
+/**
+ * @brief Runs the anchored forward DFA from `start` until it dies.
+ * @return End of the longest match starting at `start`, -1 if none.
+*/
+static int regexLongest(struct regexMatcher *m, int start)
+{
+    struct dfaState *s = dfaStart(m, &m->fwd, start == 0);
+    int end = s->match ? start : -1;
+    int i;
+
+    for (i = start; i < m->len && s->n; i++)
+    {
+        unsigned char c = m->text[i];
+        s = s->next[c] ? s->next[c] : dfaStep(m, &m->fwd, s, c);
+        if (s->match) end = i + 1;
+    }
+    if (i == m->len && s->matchAtEnd) end = m->len;
+
+    return end;
+}
+
+/**
+ * @brief Finds the next leftmost-longest, non-overlapping match of the scanned text.
+ * @note Empty matches are skipped, so `x*` only finds runs of x.
+ * @return 1 with `start` and `len` set, 0 once there are no more matches.
+*/
+int editorRegexNext(struct regexMatcher *m, int *start, int *len)
+{
+    while (m->pos < m->len)
+    {
+        unsigned char *next = memchr(&m->starts[m->pos], 1, m->len - m->pos);
+        if (next == NULL) break;
+
+        int at = next - m->starts;
+        int end = regexLongest(m, at);
+
+        if (end > at)
+        {
+            *start = at;
+            *len = end - at;
+            m->pos = end;
+            return 1;
+        }
+        m->pos = at + 1;
+    }
+
+    m->pos = m->len;
+    return 0;
+}
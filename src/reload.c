@@ -0,0 +1,424 @@
+#include "../lib/reload.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/clipboard.h"
+#include "../lib/cursors.h"
+#include "../lib/diff.h"
+#include "../lib/event.h"
+#include "../lib/file_io.h"
+#include "../lib/input.h"
+#include "../lib/output.h"
+#include "../lib/search.h"
+#include "../lib/undo.h"
+#include "../lib/watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/*
+ * Files open in buffers are watched for changes made elsewhere. A shown buffer without unsaved
+ * changes is brought up to date at once: the rows past the unchanged start and end are diffed
+ * against the new lines by their hashes, and only the hunks are rewritten. Other rows keep their
+ * highlighting, the cursor stays on its line and the reload is undone as one step. A buffer with
+ * unsaved changes is left as it is, and saving it over the changed file asks first.
+*/
+
+/**
+ * @brief What is compared to tell that a file changed.
+*/
+struct reloadStat
+{
+    int exists;
+    off_t size;
+    ino_t ino;
+    struct timespec mtime;
+};
+
+struct reloadFile
+{
+    char *path;
+    struct reloadStat disk; // the file as the rows were read from it or saved to it
+    int conflict; // changed while the buffer had unsaved changes, not reloaded
+    int watch; // -1 if the file can't be watched
+};
+
+static struct
+{
+    struct reloadFile *list;
+    int count;
+} reload;
+
+static void reloadStatOf(const struct stat *st, struct reloadStat *rs)
+{
+    rs->exists = 1;
+    rs->size = st->st_size;
+    rs->ino = st->st_ino;
+    rs->mtime = st->st_mtim;
+}
+
+static void reloadStatPath(const char *path, struct reloadStat *rs)
+{
+    struct stat st;
+    memset(rs, 0, sizeof(*rs));
+    if (stat(path, &st) == 0) reloadStatOf(&st, rs);
+}
+
+static int reloadStatSame(const struct reloadStat *a, const struct reloadStat *b)
+{
+    return a->exists == b->exists && a->size == b->size && a->ino == b->ino &&
+        a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+static struct reloadFile *reloadFind(const char *path)
+{
+    for (int i = 0; i < reload.count; i++)
+    {
+        if (!strcmp(reload.list[i].path, path)) return &reload.list[i];
+    }
+    return NULL;
+}
+
+static void reloadChanged(const char *path, void *arg)
+{
+    (void)path;
+    (void)arg;
+    editorReloadCheck();
+}
+
+/**
+ * @brief Starts watching `fileName` for changes made elsewhere, from its state now. Called
+ * @brief before its rows are read, so a change made while reading is caught as well.
+*/
+void editorReloadTrack(const char *fileName)
+{
+    struct reloadFile *f = reloadFind(fileName);
+
+    if (f == NULL)
+    {
+        reload.list = realloc(reload.list, sizeof(struct reloadFile) * (reload.count + 1));
+        f = &reload.list[reload.count++];
+        f->path = strdup(fileName);
+
+        // without a watch, changes are still found when the buffer is shown again or saved
+        f->watch = editorWatchAdd(fileName, reloadChanged, NULL);
+    }
+
+    reloadStatPath(f->path, &f->disk);
+    f->conflict = 0;
+}
+
+/**
+ * @brief Stops watching `fileName`, once no buffer holds it.
+*/
+void editorReloadUntrack(const char *fileName)
+{
+    struct reloadFile *f = reloadFind(fileName);
+    if (f == NULL) return;
+
+    editorWatchRemove(f->watch);
+    free(f->path);
+
+    int i = f - reload.list;
+    memmove(f, f + 1, sizeof(struct reloadFile) * (reload.count - i - 1));
+    reload.count--;
+}
+
+/**
+ * @brief Reads the whole file, `rs` is set from the descriptor it was read through.
+ * @return The text, NULL if it could not be read.
+*/
+static char *reloadRead(const char *path, size_t *len, struct reloadStat *rs)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+    reloadStatOf(&st, rs);
+
+    // the file may still be growing
+    size_t cap = st.st_size + 1, used = 0;
+    char *buf = malloc(cap);
+    ssize_t n;
+
+    while ((n = read(fd, &buf[used], cap - used)) != 0)
+    {
+        if (n == -1)
+        {
+            if (errno == EINTR) continue;
+            free(buf);
+            close(fd);
+            return NULL;
+        }
+
+        used += n;
+        if (used == cap)
+        {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    close(fd);
+
+    *len = used;
+    return buf;
+}
+
+/**
+ * @brief Splits `buf` into lines the way `editorOpen` reads them, without their line breaks.
+ * @return Number of lines.
+*/
+static int reloadSplit(char *buf, size_t len, char ***lines, size_t **lens)
+{
+    int n = 0;
+    for (char *p = buf, *end = buf + len; p < end; n++)
+    {
+        char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+
+    *lines = malloc(sizeof(char *) * (n ? n : 1));
+    *lens = malloc(sizeof(size_t) * (n ? n : 1));
+
+    size_t i = 0;
+    for (int j = 0; j < n; j++)
+    {
+        char *nl = memchr(&buf[i], '\n', len - i);
+        size_t end = nl ? (size_t)(nl - buf) : len;
+        size_t linelen = end - i;
+
+        while (linelen > 0 && buf[i + linelen - 1] == '\r') linelen--;
+
+        (*lines)[j] = &buf[i];
+        (*lens)[j] = linelen;
+        i = end + 1;
+    }
+    return n;
+}
+
+static int reloadSame(const erow *row, const char *s, size_t len)
+{
+    return (size_t)row->size == len && memcmp(row->chars, s, len) == 0;
+}
+
+/**
+ * @brief Appends a hunk, merged into the previous one when they touch.
+*/
+static void reloadPush(struct diffHunk **hunks, int *count, int *cap, struct diffHunk h)
+{
+    if (*count)
+    {
+        struct diffHunk *last = &(*hunks)[*count - 1];
+        if (last->a + last->alen == h.a && last->b + last->blen == h.b)
+        {
+            last->alen += h.alen;
+            last->blen += h.blen;
+            return;
+        }
+    }
+
+    if (*count == *cap)
+    {
+        *cap = *cap ? *cap * 2 : 16;
+        *hunks = realloc(*hunks, sizeof(struct diffHunk) * *cap);
+    }
+    (*hunks)[(*count)++] = h;
+}
+
+/**
+ * @brief Compares the rows the diff paired up by hash, a pair that differs after all becomes a
+ * @brief hunk of its own. The rows checked start at `a` and line `b`, and end at row `aend`.
+ * @return Number of hunks.
+*/
+static int reloadVerify(struct diffHunk **hunks, int count, char **lines, size_t *lens, int a, int b, int aend)
+{
+    struct diffHunk *out = NULL;
+    int n = 0, cap = 0;
+
+    for (int k = 0; k <= count; k++)
+    {
+        int alim = k < count ? (*hunks)[k].a : aend;
+
+        for (; a < alim; a++, b++)
+        {
+            if (!reloadSame(&editor.row[a], lines[b], lens[b])) reloadPush(&out, &n, &cap, (struct diffHunk){ a, 1, b, 1 });
+        }
+        if (k == count) break;
+
+        reloadPush(&out, &n, &cap, (*hunks)[k]);
+        a += (*hunks)[k].alen;
+        b += (*hunks)[k].blen;
+    }
+
+    free(*hunks);
+    *hunks = out;
+    return n;
+}
+
+/**
+ * @brief Row `y` after the hunks are applied: the same line, or where its hunk ended up.
+*/
+static int reloadMapRow(const struct diffHunk *hunks, int count, int y)
+{
+    int delta = 0;
+
+    for (int k = 0; k < count && y >= hunks[k].a; k++)
+    {
+        const struct diffHunk *h = &hunks[k];
+        if (y < h->a + h->alen)
+        {
+            int off = y - h->a;
+            return h->b + (off < h->blen ? off : (h->blen ? h->blen - 1 : 0));
+        }
+        delta = h->b + h->blen - (h->a + h->alen);
+    }
+    return y + delta;
+}
+
+/**
+ * @brief Brings the rows to the `n` new lines, touching only the ones that differ.
+ * @return Number of rows rewritten, inserted or deleted.
+*/
+static int reloadApply(char **lines, size_t *lens, int n)
+{
+    int p = 0, s = 0;
+
+    while (p < editor.numrows && p < n && reloadSame(&editor.row[p], lines[p], lens[p])) p++;
+    while (s < editor.numrows - p && s < n - p &&
+        reloadSame(&editor.row[editor.numrows - 1 - s], lines[n - 1 - s], lens[n - 1 - s])) s++;
+
+    // the common start and end never overlap, checked anyway so the sizes below are known to be
+    // in range
+    int na = editor.numrows - p - s, nb = n - p - s;
+    if (na < 0 || nb < 0 || (na == 0 && nb == 0)) return 0;
+
+    // only the middle is hashed and diffed
+    uint64_t *ha = malloc(sizeof(uint64_t) * (na ? na : 1));
+    uint64_t *hb = malloc(sizeof(uint64_t) * (nb ? nb : 1));
+    for (int i = 0; i < na; i++) ha[i] = editorDiffHash(editor.row[p + i].chars, editor.row[p + i].size);
+    for (int j = 0; j < nb; j++) hb[j] = editorDiffHash(lines[p + j], lens[p + j]);
+
+    struct diffHunk *hunks;
+    int count = editorDiff(ha, na, hb, nb, &hunks);
+    free(ha);
+    free(hb);
+
+    for (int k = 0; k < count; k++)
+    {
+        hunks[k].a += p;
+        hunks[k].b += p;
+    }
+    count = reloadVerify(&hunks, count, lines, lens, p, p, p + na);
+
+    int cy = reloadMapRow(hunks, count, editor.cy);
+    int changed = 0;
+    for (int k = 0; k < count; k++) changed += hunks[k].alen > hunks[k].blen ? hunks[k].alen : hunks[k].blen;
+
+    editorSearchCancel();
+    editorCursorClear();
+    editorSelectClear();
+    editorUndoSeparate();
+
+    editorReplaceRows(hunks, count, lines, lens);
+    free(hunks);
+
+    editor.cy = cy < editor.numrows ? cy : editor.numrows;
+    if (editor.cy == editor.numrows) editor.cx = 0;
+    else if (editor.cx > editor.row[editor.cy].size) editor.cx = editor.row[editor.cy].size;
+
+    editorUndoReloaded();
+    return changed;
+}
+
+/**
+ * @brief Reloads the shown buffer if its file changed elsewhere, or only notes the change if the
+ * @brief buffer has unsaved changes.
+ * @note Does nothing while another buffer is shown, it is checked when shown again. Nor while a
+ * @note save is writing, the file is then ours.
+*/
+void editorReloadCheck()
+{
+    struct reloadFile *f = editor.fileName ? reloadFind(editor.fileName) : NULL;
+    if (f == NULL || editorSaveRunning()) return;
+
+    struct reloadStat now;
+    reloadStatPath(f->path, &now);
+    if (reloadStatSame(&now, &f->disk)) return;
+
+    if (!now.exists)
+    {
+        // saving writes it again
+        f->disk = now;
+        editorSetStatusMessage("%.20s was deleted on disk.", f->path);
+        return;
+    }
+
+    if (editor.unsaved)
+    {
+        if (!f->conflict) editorSetStatusMessage("%.20s changed on disk, Ctrl-S asks before overwriting it.", f->path);
+        f->conflict = 1;
+        return;
+    }
+
+    size_t len;
+    char *buf = reloadRead(f->path, &len, &now);
+    if (buf == NULL) return;
+
+    char **lines;
+    size_t *lens;
+    int n = reloadSplit(buf, len, &lines, &lens);
+
+    int changed = reloadApply(lines, lens, n);
+    editor.unsaved = 0;
+    f->disk = now;
+    f->conflict = 0;
+
+    free(lines);
+    free(lens);
+    free(buf);
+
+    if (changed) editorSetStatusMessage("%.20s changed on disk, %d lines reloaded.", f->path, changed);
+    editorEventRequestRedraw();
+}
+
+/**
+ * @brief Called once a save is written: the file is the rows again.
+*/
+void editorReloadSaved(const char *fileName)
+{
+    struct reloadFile *f = reloadFind(fileName);
+    if (f == NULL) return;
+
+    reloadStatPath(f->path, &f->disk);
+    f->conflict = 0;
+}
+
+/**
+ * @brief Asks before a save overwrites changes made to the file elsewhere since it was read.
+ * @return 1 if the save may go ahead.
+*/
+int editorReloadConfirmSave()
+{
+    struct reloadFile *f = editor.fileName ? reloadFind(editor.fileName) : NULL;
+    if (f == NULL) return 1;
+
+    struct reloadStat now;
+    reloadStatPath(f->path, &now);
+    if (!now.exists || (!f->conflict && reloadStatSame(&now, &f->disk))) return 1;
+
+    char prompt[80];
+    snprintf(prompt, sizeof(prompt), "%.20s changed on disk. Overwrite it? (y/n): %%s", f->path);
+
+    char *answer = editorPrompt(prompt, NULL);
+    int yes = answer && (answer[0] == 'y' || answer[0] == 'Y');
+    free(answer);
+    return yes;
+}
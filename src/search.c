@@ -0,0 +1,579 @@
+#include "../lib/search.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/event.h"
+#include "../lib/regex.h"
+#include "../lib/trigram.h"
+#include "../lib/jobs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+
+/**
+ * @brief Rough frequency rank of a byte in source code and logs, lower is rarer.
+*/
+static int byteRank(unsigned char c)
+{
+    static const char *letters = "etaoinsrhldcumfpgwybvkxjqz"; // most to least common
+
+    if (c == ' ') return 255;
+    if (islower(c)) return 200 - (strchr(letters, c) - letters) * 4;
+    if (isdigit(c)) return 120;
+    if (isupper(c)) return 100;
+    if (c == '\t' || c == '_' || c == '.' || c == ',' || c == '(' || c == ')') return 90;
+    if (ispunct(c)) return 50;
+    return 10;
+}
+
+/**
+ * @brief Compiles `pat` into shift tables and picks the byte used by the `memchr` prefilter.
+ * @param pat Pattern bytes, need not be NUL terminated.
+ * @param len Pattern length, must be at least 1.
+ * @return The compiled pattern, free with `editorSearchFree`.
+*/
+struct searchPattern *editorSearchCompile(const char *pat, int len)
+{
+    if (len <= 0) return NULL;
+
+    struct searchPattern *p = malloc(sizeof(struct searchPattern));
+    p->pat = malloc(len + 1);
+    memcpy(p->pat, pat, len);
+    p->pat[len] = '\0';
+    p->len = len;
+
+    for (int c = 0; c < 256; c++)
+    {
+        p->shiftFwd[c] = len;
+        p->shiftBwd[c] = len;
+    }
+    for (int i = 0; i < len - 1; i++)
+        p->shiftFwd[(unsigned char)pat[i]] = len - 1 - i;
+    for (int i = len - 1; i > 0; i--)
+        p->shiftBwd[(unsigned char)pat[i]] = i;
+
+    p->rareIdx = 0;
+    for (int i = 1; i < len; i++)
+    {
+        if (byteRank(pat[i]) < byteRank(pat[p->rareIdx])) p->rareIdx = i;
+    }
+    p->rare = pat[p->rareIdx];
+
+    return p;
+}
+
+void editorSearchFree(struct searchPattern *p)
+{
+    if (p == NULL) return;
+    free(p->pat);
+    free(p);
+}
+
+/**
+ * @brief Horspool scan left to right, for texts where the rare byte turned out to be common.
+*/
+static int horspoolForward(const struct searchPattern *p, const char *text, int len, int from)
+{
+    const unsigned char *t = (const unsigned char *)text;
+    int last = p->len - 1;
+
+    for (int i = from; i <= len - p->len; i += p->shiftFwd[t[i + last]])
+    {
+        if (t[i + last] == (unsigned char)p->pat[last] && !memcmp(&text[i], p->pat, last)) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Horspool scan right to left, the window shifts on its first byte.
+*/
+static int horspoolBackward(const struct searchPattern *p, const char *text, int at)
+{
+    const unsigned char *t = (const unsigned char *)text;
+
+    for (int i = at; i >= 0; i -= p->shiftBwd[t[i]])
+    {
+        if (t[i] == (unsigned char)p->pat[0] && !memcmp(&text[i + 1], &p->pat[1], p->len - 1)) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Finds the first match starting at or after `from`.
+ * @note Candidates come from `memchr` (vectorized in libc) on the pattern's rarest byte and are
+ * @note verified with `memcmp`. If candidates keep failing, the rest is scanned with Horspool.
+ * @return Start index of the match in `text`, -1 if none.
+*/
+int editorSearchForward(const struct searchPattern *p, const char *text, int len, int from)
+{
+    if (p == NULL || from < 0 || len - from < p->len) return -1;
+
+    const char *s = &text[from + p->rareIdx];
+    const char *lastRare = &text[len - p->len + p->rareIdx];
+    int misses = 0;
+
+    while (s <= lastRare)
+    {
+        s = memchr(s, p->rare, lastRare - s + 1);
+        if (s == NULL) return -1;
+
+        const char *start = s - p->rareIdx;
+        if (!memcmp(start, p->pat, p->len)) return start - text;
+
+        s++;
+        if (++misses > SEARCH_MISS_LIMIT && (s - text) - from < misses * SEARCH_MISS_SPAN)
+            return horspoolForward(p, text, len, start - text + 1);
+    }
+    return -1;
+}
+
+/**
+ * @brief Finds the last match starting at or before `at`, directly on `text` without reversing it.
+ * @return Start index of the match in `text`, -1 if none.
+*/
+int editorSearchBackward(const struct searchPattern *p, const char *text, int len, int at)
+{
+    if (p == NULL) return -1;
+    if (at > len - p->len) at = len - p->len;
+    if (at < 0) return -1;
+
+    const char *firstRare = &text[p->rareIdx];
+    const char *s = &text[at + p->rareIdx];
+    int misses = 0;
+
+    while (s >= firstRare)
+    {
+        s = memrchr(firstRare, p->rare, s - firstRare + 1);
+        if (s == NULL) return -1;
+
+        const char *start = s - p->rareIdx;
+        if (!memcmp(start, p->pat, p->len)) return start - text;
+
+        s--;
+        if (++misses > SEARCH_MISS_LIMIT && at - (start - text) < misses * SEARCH_MISS_SPAN)
+            return horspoolBackward(p, text, start - text - 1);
+    }
+    return -1;
+}
+
+/**
+ * @brief Counts non-overlapping matches in `text`.
+*/
+int editorSearchCount(const struct searchPattern *p, const char *text, int len)
+{
+    int count = 0;
+    int at = 0;
+
+    while ((at = editorSearchForward(p, text, len, at)) != -1)
+    {
+        count++;
+        at += p->len;
+    }
+    return count;
+}
+
+/**
+ * @brief A slice of rows searched by one job, with the matches it found in order.
+*/
+struct searchWorker
+{
+    int start, end; // rows [start, end), or positions in `search.rows` when searching candidates
+    struct searchMatch *matches;
+    int count, cap;
+};
+
+/**
+ * @brief The whole-buffer search: running workers and, once they finish, the sorted match table.
+*/
+static struct
+{
+    char *query;
+    int regex; // `re` instead of `pattern`
+    struct searchPattern *pattern;
+    struct regex *re;
+    const char *error; // why the regex did not compile
+    int *rows; // candidate rows from the trigram index, NULL to search every row
+    int numrows;
+    struct searchWorker workers[SEARCH_MAX_THREADS];
+    int numworkers;
+    int running; // jobs submitted and not collected yet
+    int done; // `matches` is complete
+    int remaining; // jobs whose `done` callback has not run
+    struct editorJobToken *token; // of the running jobs, NULL when none
+    void (*onDone)();
+
+    struct searchMatch *matches;
+    int count;
+} search;
+
+static void searchAppend(struct searchWorker *w, int row, int col, int len)
+{
+    if (w->count == w->cap)
+    {
+        w->cap = w->cap ? w->cap * 2 : 64;
+        w->matches = realloc(w->matches, sizeof(struct searchMatch) * w->cap);
+    }
+    w->matches[w->count].row = row;
+    w->matches[w->count].col = col;
+    w->matches[w->count].len = len;
+    w->count++;
+}
+
+/**
+ * @brief Collects every match of the worker's rows. Literal matches may overlap, so that the
+ * @brief matches of a longer query are always a subset of the table (see `searchRefine`);
+ * @brief regex matches are leftmost-longest and do not. Each job has its own regex matcher,
+ * @brief whose DFA is built lazily from the shared compiled pattern.
+ * @brief Checks the cancel flag every `SEARCH_CANCEL_ROWS` rows.
+*/
+static void searchRows(struct searchWorker *w, struct editorJobToken *token)
+{
+    const struct searchPattern *p = search.pattern;
+    struct regexMatcher *m = search.regex ? editorRegexMatcher(search.re) : NULL;
+
+    for (int k = w->start; k < w->end; k++)
+    {
+        if ((k - w->start) % SEARCH_CANCEL_ROWS == 0 && token && editorJobCancelled(token)) break;
+
+        int r = search.rows ? search.rows[k] : k;
+        erow *row = &editor.row[r];
+        int at = 0, len;
+
+        if (m)
+        {
+            editorRegexScan(m, row->chars, row->size);
+            while (editorRegexNext(m, &at, &len)) searchAppend(w, r, at, len);
+            continue;
+        }
+
+        while ((at = editorSearchForward(p, row->chars, row->size, at)) != -1)
+        {
+            searchAppend(w, r, at, p->len);
+            at++;
+        }
+    }
+
+    editorRegexMatcherFree(m);
+}
+
+static void searchJob(void *arg, struct editorJobToken *token)
+{
+    searchRows(arg, token);
+}
+
+/**
+ * @brief Concatenates the workers' matches, which are already in buffer order. The jobs, if
+ * @brief any, must have returned.
+*/
+static void searchCollect()
+{
+    for (int i = 0; i < search.numworkers; i++) search.count += search.workers[i].count;
+
+    if (search.running)
+    {
+        editorJobTokenRelease(search.token);
+        search.token = NULL;
+        search.running = 0;
+    }
+
+    search.matches = malloc(sizeof(struct searchMatch) * (search.count ? search.count : 1));
+    int n = 0;
+
+    for (int i = 0; i < search.numworkers; i++)
+    {
+        struct searchWorker *w = &search.workers[i];
+        if (w->count) memcpy(&search.matches[n], w->matches, sizeof(struct searchMatch) * w->count);
+        n += w->count;
+        free(w->matches);
+        w->matches = NULL;
+        w->count = w->cap = 0;
+    }
+
+    search.done = 1;
+}
+
+/**
+ * @brief Runs on the main thread after each job, the last one of the current search collects.
+*/
+static void searchJobDone(void *arg, struct editorJobToken *token)
+{
+    (void)arg;
+
+    // a cancelled or already collected search
+    if (token != search.token || --search.remaining > 0) return;
+
+    searchCollect();
+
+    if (search.onDone) search.onDone();
+    editorEventRequestRedraw();
+}
+
+/**
+ * @brief Stops any running search and frees its results.
+*/
+void editorSearchCancel()
+{
+    if (search.running)
+    {
+        // the jobs' `done` callbacks come later and find a different token
+        editorJobCancel(search.token);
+        editorJobWait(search.token);
+        editorJobTokenRelease(search.token);
+        search.token = NULL;
+        search.running = 0;
+    }
+
+    for (int i = 0; i < search.numworkers; i++)
+    {
+        free(search.workers[i].matches);
+        search.workers[i].matches = NULL;
+        search.workers[i].count = search.workers[i].cap = 0;
+    }
+    search.numworkers = 0;
+
+    free(search.matches);
+    search.matches = NULL;
+    search.count = 0;
+    search.done = 0;
+
+    editorSearchFree(search.pattern);
+    search.pattern = NULL;
+    editorRegexFree(search.re);
+    search.re = NULL;
+    free(search.query);
+    search.query = NULL;
+    search.error = NULL;
+    free(search.rows);
+    search.rows = NULL;
+}
+
+/**
+ * @brief Narrows a complete match table when `query` extends its query by appending bytes.
+ * @note Every match of the longer query starts where a match of the shorter one does, so only
+ * @note the appended bytes are compared at each existing match and no row is scanned again.
+ * @return 1 if the table was refined in place, 0 if a full scan is needed.
+*/
+static int searchRefine(const char *query, int len, int regex)
+{
+    struct searchPattern *old = search.pattern;
+
+    if (regex || !search.done || old == NULL || len <= old->len || memcmp(query, old->pat, old->len)) return 0;
+
+    const char *tail = &query[old->len];
+    int tailLen = len - old->len;
+    int n = 0;
+
+    for (int i = 0; i < search.count; i++)
+    {
+        struct searchMatch *m = &search.matches[i];
+        erow *row = &editor.row[m->row];
+        int at = m->col + old->len;
+
+        if (at + tailLen <= row->size && !memcmp(&row->chars[at], tail, tailLen))
+        {
+            search.matches[n] = *m;
+            search.matches[n++].len = len;
+        }
+    }
+    search.count = n;
+
+    search.pattern = editorSearchCompile(query, len);
+    editorSearchFree(old);
+    free(search.query);
+    search.query = strdup(search.pattern->pat);
+    return 1;
+}
+
+/**
+ * @brief Starts searching the whole buffer for `query`, cancelling the previous search.
+ * @note If the previous search is complete and `query` extends it, its table is filtered instead.
+ * @param regex Treat `query` as a regular expression. If it does not compile, the search is done
+ * @param regex with no matches and `editorSearchError` says why.
+ * @note Rows are split into byte-balanced slices, one job each, and scanned on the job pool.
+ * @note Small buffers are searched right away on the calling thread.
+ * @param onDone Called on the main thread once the match table is complete.
+*/
+void editorSearchStart(const char *query, int len, int regex, void (*onDone)())
+{
+    search.onDone = onDone;
+    if (searchRefine(query, len, regex))
+    {
+        if (search.onDone) search.onDone();
+        return;
+    }
+
+    editorSearchCancel();
+
+    if (len <= 0) return;
+
+    search.query = strndup(query, len);
+    search.regex = regex;
+
+    if (regex) search.re = editorRegexCompile(query, len, &search.error);
+    else search.pattern = editorSearchCompile(query, len);
+
+    if (search.error)
+    {
+        searchCollect();
+        if (search.onDone) search.onDone();
+        return;
+    }
+
+    // with the index on, only rows containing all of the query's trigrams need a look
+    search.numrows = regex ? -1 : editorTrigramCandidates(query, len, &search.rows);
+    if (search.numrows == -1) search.numrows = editor.numrows;
+
+    long total = 0;
+    for (int k = 0; k < search.numrows; k++) total += editor.row[search.rows ? search.rows[k] : k].size + 1;
+
+    int threads = sysconf(_SC_NPROCESSORS_ONLN); // the pool has as many workers
+    if (threads > SEARCH_MAX_THREADS) threads = SEARCH_MAX_THREADS;
+    if (threads > search.numrows) threads = search.numrows;
+    if (total < SEARCH_THREAD_BYTES || threads < 2) threads = 1;
+
+    // cut the rows where each slice reaches its share of the bytes
+    long share = total / threads + 1;
+    long acc = 0;
+    int start = 0;
+
+    for (int k = 0; k < search.numrows && search.numworkers < threads - 1; k++)
+    {
+        acc += editor.row[search.rows ? search.rows[k] : k].size + 1;
+        if (acc >= share * (search.numworkers + 1))
+        {
+            search.workers[search.numworkers].start = start;
+            search.workers[search.numworkers].end = k + 1;
+            search.numworkers++;
+            start = k + 1;
+        }
+    }
+    search.workers[search.numworkers].start = start;
+    search.workers[search.numworkers].end = search.numrows;
+    search.numworkers++;
+
+    if (search.numworkers == 1)
+    {
+        searchRows(&search.workers[0], NULL);
+        searchCollect();
+        if (search.onDone) search.onDone();
+        return;
+    }
+
+    search.token = editorJobTokenNew();
+    search.remaining = search.numworkers;
+    search.running = 1;
+
+    for (int i = 0; i < search.numworkers; i++)
+        editorJobSubmit(search.token, searchJob, searchJobDone, &search.workers[i]);
+}
+
+/**
+ * @brief Blocks until the running search, if any, has completed.
+*/
+void editorSearchWait()
+{
+    if (!search.running) return;
+
+    editorJobWait(search.token);
+    searchCollect();
+
+    if (search.onDone) search.onDone();
+}
+
+int editorSearchDone()
+{
+    return search.done;
+}
+
+int editorSearchTotal()
+{
+    return search.done ? search.count : 0;
+}
+
+/**
+ * @brief The query of the current search, NULL if there is none.
+*/
+const char *editorSearchQuery()
+{
+    return search.query;
+}
+
+/**
+ * @brief Why the current regex failed to compile, NULL if it did not fail.
+*/
+const char *editorSearchError()
+{
+    return search.error;
+}
+
+struct searchMatch *editorSearchMatchAt(int idx)
+{
+    if (!search.done || idx < 0 || idx >= search.count) return NULL;
+    return &search.matches[idx];
+}
+
+/**
+ * @brief Binary search for the first match at or after (`row`, `col`).
+ * @return Index into the match table, `count` if every match is before.
+*/
+static int searchLowerBound(int row, int col)
+{
+    int lo = 0, hi = search.count;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        struct searchMatch *m = &search.matches[mid];
+
+        if (m->row < row || (m->row == row && m->col < col)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief Finds the match after (`direction` 1) or before (-1) a position, wrapping around.
+ * @return Index into the match table, -1 if there are no matches.
+*/
+int editorSearchNext(int row, int col, int direction)
+{
+    if (!search.done || search.count == 0) return -1;
+
+    if (direction == 1)
+    {
+        int i = searchLowerBound(row, col + 1);
+        return i == search.count ? 0 : i;
+    }
+
+    int i = searchLowerBound(row, col) - 1;
+    return i < 0 ? search.count - 1 : i;
+}
+
+/**
+ * @brief Index of the match starting exactly at (`row`, `col`), -1 if none.
+*/
+int editorSearchIndexOf(int row, int col)
+{
+    if (!search.done) return -1;
+
+    int i = searchLowerBound(row, col);
+    if (i < search.count && search.matches[i].row == row && search.matches[i].col == col) return i;
+    return -1;
+}
+
+/**
+ * @brief Matches on a row, for highlighting.
+ * @param first Set to the index of the row's first match.
+ * @return Number of matches on the row.
+*/
+int editorSearchRowMatches(int row, int *first)
+{
+    if (!search.done || search.count == 0) return 0;
+
+    int lo = searchLowerBound(row, 0);
+    int hi = searchLowerBound(row + 1, 0);
+
+    *first = lo;
+    return hi - lo;
+}
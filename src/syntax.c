@@ -1,17 +1,23 @@
 #include "../lib/editor.h"
 #include "../lib/syntax.h"
+#include "../lib/latency.h"
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 
-void editorUpdateSyntax(erow *row)
+/**
+ * @brief Highlights a single row from its `render` and the previous row's comment state.
+ * @param row The row to highlight.
+ * @return 1 if the row's `hl_open_comment` changed, so the next row needs highlighting too.
+*/
+static int editorHighlightRow(erow *row)
 {
     row->hl = realloc(row->hl, row->rsize);
 
     // sets the string row->hl to sd "0000000000000" by default
     memset(row->hl, HL_NORMAL, row->rsize);
 
-    if (editor.syntax == NULL) return;
+    if (editor.syntax == NULL) return 0;
 
     char **keywords = editor.syntax->keywords;
 
@@ -27,6 +33,9 @@ void editorUpdateSyntax(erow *row)
     int in_string = 0;
     int in_comment = (row->idx > 0 && editor.row[row->idx - 1].hl_open_comment);
 
+    // a long row's window is highlighted as if nothing was open where it starts
+    if (row->window && row->window->rstart > 0) in_comment = 0;
+
     int ch = 0;
     while (ch < row->rsize)
     {
@@ -68,7 +77,7 @@ void editorUpdateSyntax(erow *row)
             if (in_string) 
             {
                 row->hl[ch] = HL_STRING;
-                if (c == '\\' && (ch + 1 < row->size))
+                if (c == '\\' && (ch + 1 < row->rsize))
                 {
                     row->hl[ch + 1] = HL_STRING;
                     ch += 2;
@@ -143,12 +152,51 @@ void editorUpdateSyntax(erow *row)
         ch++;  
     }
 
+    // nor does it know how the row ends, so rows below keep their state
+    if (row->window) return 0;
+
     int changed = (row->hl_open_comment != in_comment);
     row->hl_open_comment = in_comment;
 
-    // recursive call
-    if (changed && (row->idx + 1) < editor.numrows)
-        editorUpdateSyntax(&editor.row[row->idx + 1]);
+    return changed;
+}
+
+/**
+ * @brief Highlights `row` and keeps going down while multiline comment state changes.
+ * @note Iterative so that opening a comment above a huge block does not recurse once per row.
+*/
+void editorUpdateSyntax(erow *row)
+{
+    editorLatencyBegin(LAT_HIGHLIGHT);
+
+    while (editorHighlightRow(row) && (row->idx + 1) < editor.numrows)
+        row = &editor.row[row->idx + 1];
+
+    editorLatencyEnd(LAT_HIGHLIGHT);
+}
+
+/**
+ * @brief Highlights a batch of rewritten rows in one pass from top to bottom.
+ * @param rows Indices of the rewritten rows, in ascending order.
+ * @note A row already reached by the comment cascade of an earlier one is not highlighted again.
+*/
+void editorUpdateSyntaxRows(const int *rows, int n)
+{
+    editorLatencyBegin(LAT_HIGHLIGHT);
+
+    int done = -1;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (rows[i] <= done) continue;
+
+        erow *row = &editor.row[rows[i]];
+        while (editorHighlightRow(row) && (row->idx + 1) < editor.numrows)
+            row = &editor.row[row->idx + 1];
+        done = row->idx;
+    }
+
+    editorLatencyEnd(LAT_HIGHLIGHT);
 }
 
 int editorSyntaxToColor(int hl) 
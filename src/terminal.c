@@ -2,6 +2,10 @@
 #include "../lib/const.h"
 #include "../lib/input.h"
 #include "../lib/editor.h"
+#include "../lib/buffer.h"
+#include "../lib/event.h"
+#include "../lib/latency.h"
+#include "../lib/headless.h"
 
 #include <unistd.h>
 #include <termios.h>
@@ -9,6 +13,7 @@
 #include <sys/ioctl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /**
  * @brief Sets terminal attribute to disable 'ECHO'
@@ -41,11 +46,14 @@ void enableRaw()
     // Set the minimum number of bytes to be read to 0
     raw.c_cc[VMIN] = 0;
 
-    // Set time to wait before read() returns; to 10ms
-    raw.c_cc[VTIME] = 10;
+    // Never wait inside read(), the event loop sleeps in epoll_wait until input arrives
+    raw.c_cc[VTIME] = 0;
 
     // Save 'raw' attributes into terminal
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) die("tcsetattr"); 
+
+    // Enable bracketed paste, pasted text arrives wrapped in '<esc>[200~' and '<esc>[201~'
+    write(STDOUT_FILENO, "\x1b[?2004h", 8);
 }
 
 /**
@@ -55,6 +63,7 @@ void enableRaw()
 */
 void disableRaw()
 {
+    write(STDOUT_FILENO, "\x1b[?2004l", 8);
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &(editor.originalTermios)) == -1) die("tcsetattr");
 }
 
@@ -73,43 +82,185 @@ void die(const char* str)
 }
 
 /**
- * @brief Function for reading single keypresses. The different key press constants are mapped here.
- * @return The character read.
+ * @brief Input bytes read from the terminal but not yet decoded into keys.
+ * @note `start` is the next byte to decode, `end` is one past the last byte read.
 */
-int editorReadKey()
+static struct
 {
+    char buf[INPUT_BUF_SIZE];
+    int start;
+    int end;
+} input;
+
+/**
+ * @brief Text received between the bracketed paste markers, see `editorReadPaste`.
+*/
+static struct abuf paste = ABUF_INIT;
+
+/**
+ * @brief Waits for input and reads as many bytes as the terminal has available with one `read`.
+ * @note In headless mode the bytes come from the script instead.
+ * @param timeout Milliseconds to wait, -1 waits forever.
+ * @return Number of bytes read, 0 if the wait timed out.
+*/
+static int inputFill(int timeout)
+{
+    // Move the undecoded tail to the front to make room
+    if (input.start > 0)
+    {
+        memmove(input.buf, &input.buf[input.start], input.end - input.start);
+        input.end -= input.start;
+        input.start = 0;
+    }
+
+    if (input.end == INPUT_BUF_SIZE) return 0;
+
     int nread;
-    char c;
 
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1)
+    if (editor.headless)
+    {
+        nread = editorHeadlessInput(&input.buf[input.end], INPUT_BUF_SIZE - input.end, timeout);
+    }
+    else
     {
+        if (!editorEventWaitInput(timeout)) return 0;
+
+        nread = read(STDIN_FILENO, &input.buf[input.end], INPUT_BUF_SIZE - input.end);
         if (nread == -1 && errno != EAGAIN) die("read");
     }
+    if (nread <= 0) return 0;
+
+    input.end += nread;
+    return nread;
+}
+
+/**
+ * @brief Takes the next byte from the input buffer, reading from the terminal once if it is empty.
+ * @param c Pointer to store the byte to.
+ * @param timeout Milliseconds to wait if the buffer is empty, -1 waits forever.
+ * @return 1 if a byte was read, 0 on timeout.
+*/
+static int inputByte(char *c, int timeout)
+{
+    if (input.start == input.end && inputFill(timeout) == 0) return 0;
+
+    *c = input.buf[input.start++];
+    return 1;
+}
+
+/**
+ * @brief Collects everything up to the `<esc>[201~` end marker into `paste`.
+ * @note Scans the input buffer in bulk with `memchr` instead of decoding byte by byte.
+*/
+static void inputReadPaste()
+{
+    static const char endMarker[] = "\x1b[201~";
+    const int markerLen = sizeof(endMarker) - 1;
+
+    paste.len = 0;
+
+    while (1)
+    {
+        char *avail = &input.buf[input.start];
+        int availLen = input.end - input.start;
+        char *esc = memchr(avail, '\x1b', availLen);
+
+        if (esc == NULL)
+        {
+            abAppend(&paste, avail, availLen);
+            input.start = input.end;
+        }
+        else
+        {
+            abAppend(&paste, avail, esc - avail);
+            input.start += esc - avail;
+
+            // Marker may be split across two reads
+            if (input.end - input.start < markerLen)
+            {
+                if (inputFill(ESCAPE_TIMEOUT) == 0)
+                {
+                    // Terminal went quiet mid-marker, keep the escape as text
+                    abAppend(&paste, &input.buf[input.start++], 1);
+                }
+                continue;
+            }
+
+            if (!memcmp(&input.buf[input.start], endMarker, markerLen))
+            {
+                input.start += markerLen;
+                return;
+            }
+
+            abAppend(&paste, &input.buf[input.start++], 1);
+            continue;
+        }
+
+        // Paste ended without the end marker
+        if (inputFill(ESCAPE_TIMEOUT) == 0) return;
+    }
+}
+
+/**
+ * @brief Returns the text of the last `PASTE_KEY` received.
+ * @param len Pointer to store the length of the pasted text to.
+ * @return Pointer to the pasted text, valid until the next paste.
+*/
+const char *editorReadPaste(int *len)
+{
+    *len = paste.len;
+    return paste.b;
+}
+
+/**
+ * @brief Function for reading single keypresses. The different key press constants are mapped here.
+ * @note Input is read from the terminal in chunks of up to `INPUT_BUF_SIZE` bytes and decoded from
+ * @note the buffer, so a burst of keys costs one `read` instead of one per byte.
+ * @return The character read.
+*/
+static int editorDecodeKey()
+{
+    char c;
+
+    while (!inputByte(&c, -1));
 
     // Escape sequences
     if (c == '\x1b')
     {
-        char seq[3];
+        char seq[2];
 
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+        if (!inputByte(&seq[0], ESCAPE_TIMEOUT)) return '\x1b';
+        if (!inputByte(&seq[1], ESCAPE_TIMEOUT)) return '\x1b';
 
         if (seq[0] == '[')
         {
-            if (seq[1] >= 0 && seq[1] <= 9)
+            if (seq[1] >= '0' && seq[1] <= '9')
             {
-                if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
-                if (seq[2] == '~')
+                // '<esc>[<number>~'
+                int param = seq[1] - '0';
+                char ch;
+
+                while (1)
                 {
-                    switch(seq[1])
+                    if (!inputByte(&ch, ESCAPE_TIMEOUT)) return '\x1b';
+                    if (ch < '0' || ch > '9') break;
+                    param = param * 10 + (ch - '0');
+                }
+
+                if (ch == '~')
+                {
+                    switch(param)
                     {
-                        case '1': return HOME_KEY;
-                        case '3': return DEL_KEY;
-                        case '4': return END_KEY;
-                        case '5': return PAGE_UP;
-                        case '6': return PAGE_DOWN;
-                        case '7': return HOME_KEY;
-                        case '8': return END_KEY;
+                        case 1: return HOME_KEY;
+                        case 3: return DEL_KEY;
+                        case 4: return END_KEY;
+                        case 5: return PAGE_UP;
+                        case 6: return PAGE_DOWN;
+                        case 7: return HOME_KEY;
+                        case 8: return END_KEY;
+                        case 200: 
+                            inputReadPaste();
+                            return PASTE_KEY;
                     }
                 }
             }
@@ -148,6 +299,17 @@ int editorReadKey()
     }
 }
 
+/**
+ * @brief Reads the next key and timestamps it for the input-to-screen latency.
+ * @return The key read, see `editorDecodeKey`.
+*/
+int editorReadKey()
+{
+    int c = editorDecodeKey();
+    editorLatencyKey();
+    return c;
+}
+
 /**
  * @brief Get the current terminal window size.
  * @param rows Integer pointer to number of rows
@@ -191,6 +353,7 @@ int getCursorPosition(int* rows, int* cols)
     //<rows>;<cols>R
     while (i < sizeof(buf) - 1)
     {
+        if (!editorEventWaitInput(ESCAPE_TIMEOUT * 10)) break;
         if (read(STDIN_FILENO, &buf[i], 1) != 1) break;
         if (buf[i] == 'R') break;
         i++;
@@ -0,0 +1,568 @@
+#include "../lib/trigram.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/event.h"
+#include "../lib/latency.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Maps every three-byte sequence to the rows containing it. Rows are identified by `erow.uid`,
+ * which does not shift when rows are inserted or deleted above them; the uid to row index map
+ * is rebuilt only when a query needs it after such a change.
+ *
+ * Changes are lazy. A new or edited row is marked dirty and queued; a timer indexes the queue a
+ * few milliseconds at a time. An edited row is indexed under a new uid and its old uid is marked
+ * dead, so posting lists are only ever appended to. Queries treat dirty rows as candidates and
+ * skip dead uids. Once dead rows outnumber live ones, the whole index is rebuilt.
+*/
+
+enum trigramFlags
+{
+    TRI_INDEXED = 1, // postings are current
+    TRI_DIRTY = 2, // queued for (re)indexing
+    TRI_DEAD = 4 // deleted or superseded, its postings are ignored
+};
+
+/**
+ * @brief Posting list of one trigram: ascending-ish uids as zigzag varint deltas.
+*/
+struct trigramList
+{
+    uint32_t key; // the trigram's bytes, with bit 24 set when the slot is used
+    uint32_t last; // uid appended last, also used to skip repeats within a row
+    uint32_t count;
+    uint32_t len, cap; // bytes of `data`
+    unsigned char *data;
+};
+
+/**
+ * @brief The index of one buffer. Buffers not shown keep theirs aside, see `editorTrigramDetach`.
+*/
+struct trigramIndex
+{
+    int enabled;
+
+    struct trigramList *lists; // open addressing
+    uint32_t mask;
+    uint32_t used;
+    size_t postingBytes;
+
+    uint32_t nextUid;
+    uint32_t uidcap;
+    unsigned char *flags;
+    int *rowOf; // uid to row index, valid unless `moved`
+    uint32_t *hits; // per-uid counters of the intersection
+    uint32_t stamp;
+    int moved;
+
+    uint32_t *dirty; // queued uids, processed from `head`
+    int head, ndirty, dirtycap;
+    long indexedRows, deadRows;
+
+    int timer;
+    int busy;
+    int shown; // progress percentage last drawn
+};
+
+static struct trigramIndex tri = { .timer = -1, .shown = -1 };
+
+#define TRI_USED (1u << 24)
+
+static uint32_t trigramHash(uint32_t key)
+{
+    return (key * 2654435761u) >> 8;
+}
+
+static void trigramTableInit(uint32_t size)
+{
+    tri.lists = calloc(size, sizeof(struct trigramList));
+    tri.mask = size - 1;
+    tri.used = 0;
+}
+
+static struct trigramList *trigramFind(uint32_t key)
+{
+    key |= TRI_USED;
+
+    for (uint32_t i = trigramHash(key) & tri.mask; tri.lists[i].key; i = (i + 1) & tri.mask)
+    {
+        if (tri.lists[i].key == key) return &tri.lists[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns the posting list of `key`, creating it and growing the table as needed.
+*/
+static struct trigramList *trigramGet(uint32_t key)
+{
+    if ((tri.used + 1) * 2 > tri.mask + 1)
+    {
+        struct trigramList *old = tri.lists;
+        uint32_t oldsize = tri.mask + 1;
+
+        trigramTableInit(oldsize * 2);
+        for (uint32_t i = 0; i < oldsize; i++)
+        {
+            if (!old[i].key) continue;
+
+            uint32_t j = trigramHash(old[i].key) & tri.mask;
+            while (tri.lists[j].key) j = (j + 1) & tri.mask;
+            tri.lists[j] = old[i];
+            tri.used++;
+        }
+        free(old);
+    }
+
+    key |= TRI_USED;
+
+    uint32_t i;
+    for (i = trigramHash(key) & tri.mask; tri.lists[i].key; i = (i + 1) & tri.mask)
+    {
+        if (tri.lists[i].key == key) return &tri.lists[i];
+    }
+
+    tri.lists[i].key = key;
+    tri.used++;
+    return &tri.lists[i];
+}
+
+static void trigramAppend(struct trigramList *l, uint32_t uid)
+{
+    if (l->count && l->last == uid) return;
+
+    if (l->len + 5 > l->cap)
+    {
+        uint32_t cap = l->cap ? l->cap * 2 : 8;
+        tri.postingBytes += cap - l->cap;
+        l->cap = cap;
+        l->data = realloc(l->data, cap);
+    }
+
+    int32_t delta = (int32_t)(uid - l->last);
+    uint32_t zz = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+
+    while (zz >= 0x80)
+    {
+        l->data[l->len++] = (zz & 0x7f) | 0x80;
+        zz >>= 7;
+    }
+    l->data[l->len++] = zz;
+
+    l->last = uid;
+    l->count++;
+}
+
+static void uidGrow(uint32_t need)
+{
+    if (need <= tri.uidcap) return;
+
+    uint32_t cap = tri.uidcap ? tri.uidcap : 1024;
+    while (cap < need) cap *= 2;
+
+    tri.flags = realloc(tri.flags, cap);
+    memset(&tri.flags[tri.uidcap], 0, cap - tri.uidcap);
+    tri.rowOf = realloc(tri.rowOf, sizeof(int) * cap);
+    tri.hits = realloc(tri.hits, sizeof(uint32_t) * cap);
+    memset(&tri.hits[tri.uidcap], 0, sizeof(uint32_t) * (cap - tri.uidcap));
+    tri.uidcap = cap;
+}
+
+static void trigramSlice(int fd, void *arg);
+
+/**
+ * @brief Starts the indexing timer unless it is already running.
+*/
+static void trigramWake()
+{
+    if (tri.busy) return;
+
+    tri.busy = 1;
+    editorEventBusy(1);
+    if (tri.timer == -1) tri.timer = editorEventAddTimer(TRIGRAM_SLICE_MS, 1, trigramSlice, NULL);
+    else editorEventArmTimer(tri.timer, TRIGRAM_SLICE_MS, 1);
+}
+
+/**
+ * @brief Stops the indexing timer, the queue is kept.
+*/
+static void trigramSleep()
+{
+    if (!tri.busy) return;
+
+    editorEventArmTimer(tri.timer, 0, 0);
+    tri.busy = 0;
+    editorEventBusy(-1);
+}
+
+static void trigramQueue(uint32_t uid)
+{
+    tri.flags[uid] |= TRI_DIRTY;
+
+    if (tri.ndirty == tri.dirtycap)
+    {
+        tri.dirtycap = tri.dirtycap ? tri.dirtycap * 2 : 1024;
+        tri.dirty = realloc(tri.dirty, sizeof(uint32_t) * tri.dirtycap);
+    }
+    tri.dirty[tri.ndirty++] = uid;
+    trigramWake();
+}
+
+static void trigramUpdateRowOf()
+{
+    if (!tri.moved) return;
+
+    for (int r = 0; r < editor.numrows; r++) tri.rowOf[editor.row[r].uid] = r;
+    tri.moved = 0;
+}
+
+/**
+ * @brief Drops every posting and queues all rows again under fresh uids 0..numrows-1.
+*/
+static void trigramRebuild()
+{
+    trigramSleep();
+
+    for (uint32_t i = 0; i <= tri.mask; i++) free(tri.lists[i].data);
+    free(tri.lists);
+    trigramTableInit(1024);
+    tri.postingBytes = 0;
+
+    tri.nextUid = editor.numrows;
+    uidGrow(tri.nextUid + 1);
+    memset(tri.flags, 0, tri.uidcap);
+
+    tri.head = tri.ndirty = 0;
+    tri.indexedRows = tri.deadRows = 0;
+
+    for (int r = 0; r < editor.numrows; r++)
+    {
+        editor.row[r].uid = r;
+        tri.rowOf[r] = r;
+        trigramQueue(r);
+    }
+    tri.moved = 0;
+}
+
+/**
+ * @brief Indexes one dirty row. A row indexed before gets a new uid, the old one becomes dead.
+*/
+static void trigramIndexRow(uint32_t uid)
+{
+    erow *row = &editor.row[tri.rowOf[uid]];
+
+    if (tri.flags[uid] & TRI_INDEXED)
+    {
+        tri.flags[uid] = TRI_DEAD;
+        tri.indexedRows--;
+        tri.deadRows++;
+
+        uid = tri.nextUid++;
+        uidGrow(tri.nextUid);
+        row->uid = uid;
+        tri.rowOf[uid] = row->idx;
+    }
+
+    const unsigned char *s = (const unsigned char *)row->chars;
+    for (int i = 0; i + 2 < row->size; i++)
+        trigramAppend(trigramGet((uint32_t)s[i] << 16 | (uint32_t)s[i + 1] << 8 | s[i + 2]), uid);
+
+    tri.flags[uid] = TRI_INDEXED;
+    tri.indexedRows++;
+}
+
+/**
+ * @brief Timer callback, indexes queued rows for up to `TRIGRAM_SLICE_NS`.
+*/
+static void trigramSlice(int fd, void *arg)
+{
+    (void)fd;
+    (void)arg;
+
+    uint64_t start = editorLatencyNow();
+
+    trigramUpdateRowOf();
+
+    while (tri.head < tri.ndirty)
+    {
+        uint32_t uid = tri.dirty[tri.head++];
+
+        if ((tri.flags[uid] & (TRI_DIRTY | TRI_DEAD)) == TRI_DIRTY) trigramIndexRow(uid);
+
+        if ((tri.head & 63) == 0 && editorLatencyNow() - start > TRIGRAM_SLICE_NS) break;
+    }
+
+    int percent = editor.numrows ? (int)(tri.indexedRows * 100 / editor.numrows) : 100;
+
+    if (tri.head == tri.ndirty)
+    {
+        tri.head = tri.ndirty = 0;
+        trigramSleep();
+
+        percent = 100;
+        if (tri.deadRows > 1024 && tri.deadRows > tri.indexedRows) trigramRebuild();
+    }
+
+    if (percent != tri.shown)
+    {
+        tri.shown = percent;
+        editorEventRequestRedraw();
+    }
+}
+
+/**
+ * @brief Turns the index on and queues the rows already loaded.
+*/
+void editorTrigramEnable()
+{
+    if (tri.enabled) return;
+
+    tri.enabled = 1;
+    trigramTableInit(1024);
+    trigramRebuild();
+}
+
+int editorTrigramEnabled()
+{
+    return tri.enabled;
+}
+
+static void trigramFree(struct trigramIndex *t)
+{
+    for (uint32_t i = 0; t->lists && i <= t->mask; i++) free(t->lists[i].data);
+    free(t->lists);
+    free(t->flags);
+    free(t->rowOf);
+    free(t->hits);
+    free(t->dirty);
+}
+
+/**
+ * @brief Sets the index of the buffer being switched away from aside and starts an empty one.
+ * @return The index to hand back to `editorTrigramRestore` when the buffer is shown again.
+*/
+struct trigramIndex *editorTrigramDetach()
+{
+    trigramSleep();
+
+    struct trigramIndex *t = malloc(sizeof(struct trigramIndex));
+    *t = tri;
+
+    memset(&tri, 0, sizeof(tri));
+    tri.enabled = t->enabled;
+    tri.timer = t->timer;
+    tri.shown = -1;
+    if (tri.enabled) trigramTableInit(1024);
+    return t;
+}
+
+/**
+ * @brief Drops the current index for one set aside by `editorTrigramDetach`, resuming its
+ * @brief queue. NULL indexes the current rows from scratch, for a buffer shown the first time.
+*/
+void editorTrigramRestore(struct trigramIndex *t)
+{
+    trigramSleep();
+    trigramFree(&tri);
+
+    if (t == NULL)
+    {
+        int enabled = tri.enabled, timer = tri.timer;
+        memset(&tri, 0, sizeof(tri));
+        tri.enabled = enabled;
+        tri.timer = timer;
+        tri.shown = -1;
+        if (tri.enabled)
+        {
+            trigramTableInit(1024);
+            trigramRebuild();
+        }
+        return;
+    }
+
+    t->timer = tri.timer;
+    tri = *t;
+    free(t);
+
+    tri.busy = 0;
+    tri.moved = 1;
+    if (tri.head < tri.ndirty) trigramWake();
+}
+
+/**
+ * @brief Frees an index set aside by `editorTrigramDetach`.
+*/
+void editorTrigramFree(struct trigramIndex *t)
+{
+    if (t == NULL) return;
+    trigramFree(t);
+    free(t);
+}
+
+/**
+ * @brief Reindexes from scratch, for when all rows were replaced without going through
+ * @brief `editorInsertRow`/`editorDelRow`.
+*/
+void editorTrigramReset()
+{
+    if (tri.enabled) trigramRebuild();
+}
+
+/**
+ * @brief Gives a new row its uid and queues it. Called before the row is first rendered.
+*/
+void editorTrigramRowAdded(erow *row)
+{
+    row->uid = tri.nextUid++;
+    if (!tri.enabled) return;
+
+    uidGrow(tri.nextUid);
+    tri.flags[row->uid] = 0;
+    tri.moved = 1;
+    trigramQueue(row->uid);
+}
+
+/**
+ * @brief Queues an edited row for reindexing, called whenever its `chars` change.
+*/
+void editorTrigramRowChanged(erow *row)
+{
+    if (!tri.enabled || (tri.flags[row->uid] & TRI_DIRTY)) return;
+    trigramQueue(row->uid);
+}
+
+void editorTrigramRowRemoved(erow *row)
+{
+    if (!tri.enabled) return;
+
+    if (tri.flags[row->uid] & TRI_INDEXED)
+    {
+        tri.indexedRows--;
+        tri.deadRows++;
+    }
+    tri.flags[row->uid] = TRI_DEAD;
+    tri.moved = 1;
+}
+
+static int cmpListCount(const void *a, const void *b)
+{
+    const struct trigramList *x = *(struct trigramList *const *)a;
+    const struct trigramList *y = *(struct trigramList *const *)b;
+    return (x->count > y->count) - (x->count < y->count);
+}
+
+static int cmpInt(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * @brief Rows that may contain `query`: those in every posting list of its trigrams, plus rows
+ * @brief not indexed yet. Only the `TRIGRAM_QUERY_LISTS` shortest lists are intersected, by
+ * @brief counting per uid how many of them it appeared in so far.
+ * @param rows Set to a sorted array of row indices, free with `free`.
+ * @return Number of rows, or -1 if the index cannot answer (off, building, query too short).
+*/
+int editorTrigramCandidates(const char *query, int len, int **rows)
+{
+    if (!tri.enabled || len < 3) return -1;
+    if (tri.ndirty - tri.head > editor.numrows / TRIGRAM_PENDING_LIMIT) return -1;
+
+    trigramUpdateRowOf();
+
+    struct trigramList *lists[len];
+    int k = 0;
+    int missing = 0;
+    const unsigned char *q = (const unsigned char *)query;
+
+    for (int i = 0; i + 2 < len; i++)
+    {
+        struct trigramList *l = trigramFind((uint32_t)q[i] << 16 | (uint32_t)q[i + 1] << 8 | q[i + 2]);
+        if (l == NULL)
+        {
+            missing = 1;
+            break;
+        }
+
+        int seen = 0;
+        for (int j = 0; j < k; j++) seen |= (lists[j] == l);
+        if (!seen) lists[k++] = l;
+    }
+
+    int cap = 64, n = 0;
+    *rows = malloc(sizeof(int) * cap);
+
+    if (!missing)
+    {
+        qsort(lists, k, sizeof(struct trigramList *), cmpListCount);
+        if (k > TRIGRAM_QUERY_LISTS) k = TRIGRAM_QUERY_LISTS;
+
+        if (tri.stamp >= UINT32_MAX / (TRIGRAM_QUERY_LISTS + 1) - 1)
+        {
+            memset(tri.hits, 0, sizeof(uint32_t) * tri.uidcap);
+            tri.stamp = 0;
+        }
+        uint32_t base = ++tri.stamp * (TRIGRAM_QUERY_LISTS + 1);
+
+        for (int i = 0; i < k; i++)
+        {
+            const unsigned char *p = lists[i]->data;
+            const unsigned char *end = p + lists[i]->len;
+            uint32_t uid = 0;
+
+            while (p < end)
+            {
+                uint32_t zz = 0;
+                int shift = 0;
+                do
+                {
+                    zz |= (uint32_t)(*p & 0x7f) << shift;
+                    shift += 7;
+                } while (*p++ & 0x80);
+                uid += (uint32_t)((zz >> 1) ^ -(zz & 1));
+
+                if (i == 0) tri.hits[uid] = base + 1;
+                else if (tri.hits[uid] == base + i) tri.hits[uid]++;
+                else continue;
+
+                if (i == k - 1 && tri.flags[uid] == TRI_INDEXED)
+                {
+                    if (n == cap) *rows = realloc(*rows, sizeof(int) * (cap *= 2));
+                    (*rows)[n++] = tri.rowOf[uid];
+                }
+            }
+        }
+    }
+
+    for (int i = tri.head; i < tri.ndirty; i++)
+    {
+        uint32_t uid = tri.dirty[i];
+        if ((tri.flags[uid] & (TRI_DIRTY | TRI_DEAD)) != TRI_DIRTY) continue;
+
+        if (n == cap) *rows = realloc(*rows, sizeof(int) * (cap *= 2));
+        (*rows)[n++] = tri.rowOf[uid];
+    }
+
+    qsort(*rows, n, sizeof(int), cmpInt);
+    return n;
+}
+
+/**
+ * @brief Describes the index for the status bar: build progress, or memory in use once built.
+ * @return Length written to `buf`, 0 if the index is off.
+*/
+int editorTrigramStatus(char *buf, int size)
+{
+    if (!tri.enabled) return 0;
+
+    if (tri.busy && tri.ndirty - tri.head > editor.numrows / TRIGRAM_PENDING_LIMIT)
+        return snprintf(buf, size, "idx %d%%", tri.shown < 0 ? 0 : tri.shown);
+
+    size_t bytes = (size_t)(tri.mask + 1) * sizeof(struct trigramList) + tri.postingBytes +
+        (size_t)tri.uidcap * (1 + sizeof(int) + sizeof(uint32_t)) + (size_t)tri.dirtycap * sizeof(uint32_t);
+
+    return snprintf(buf, size, "idx %.1fM", bytes / 1048576.0);
+}
@@ -0,0 +1,1394 @@
+#include "../lib/undo.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/file_io.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Every change to the rows is logged as an operation: bytes replaced inside one row, or whole
+ * rows inserted or deleted. The text an operation removes or adds lives in one append-only
+ * arena, in log order, so the log needs no allocation per operation and undoing a paste only
+ * touches the pasted rows.
+ *
+ * Operations are grouped into steps, one per keypress. Typing and backspacing extend the last
+ * operation instead of adding one per key, up to a word boundary. Splitting or joining rows
+ * is logged without the text that moved, which matters on long rows. Once the log and the arena
+ * outgrow the limit, the oldest steps are dropped.
+ *
+ * Saving moves the applied history to `.<name>.undo` beside the file: a header with a hash of
+ * the saved text, then one varint-encoded record per operation, each ending with its length
+ * stored backwards so records can be walked in both directions. The save job appends the
+ * operations logged since the last save, and drops the oldest steps once the file outgrows the
+ * limit too. The file is only opened when an undo goes past the history kept in memory, and is
+ * then read through a mapping. Its hash must match the file as it was opened, otherwise the file
+ * was changed elsewhere and the history is ignored.
+*/
+
+enum undoType
+{
+    UNDO_CHANGE, // `oldLen` bytes at `col` replaced by `len` bytes, text is the old then the new bytes
+    UNDO_ROWS_INSERT, // `len` rows inserted at `row`, text is the rows joined by '\n'
+    UNDO_ROWS_DELETE, // `len` rows deleted at `row`, same text
+    UNDO_SPLIT, // `row` split at `col` by Enter, no text
+    UNDO_JOIN, // row `row + 1` appended to `row`, which was `col` bytes long, no text
+    UNDO_STEP_START = 8 // history file only: the record starts a step
+};
+
+enum undoDisk
+{
+    DISK_NONE = 0, // no usable history file
+    DISK_UNCHECKED, // the opened file may have one, not looked at yet
+    DISK_MAPPED
+};
+
+struct undoOp
+{
+    unsigned char type;
+    unsigned int step;
+    int row, col;
+    int oldLen, len;
+    size_t off, size; // text in the arena
+    int cx, cy; // cursor before the step, read from its first operation
+    int ax, ay; // cursor after the step, read from its last operation
+};
+
+/**
+ * @brief The history of one buffer. Buffers not shown keep theirs aside, see `editorUndoDetach`.
+*/
+struct undoHistory
+{
+    struct undoOp *ops;
+    int numops, cap;
+    int cur; // operations applied, the rest can be redone
+
+    char *text;
+    size_t textLen, textCap;
+    size_t limit;
+
+    unsigned int step;
+    int pending; // next operation starts a step
+    int pcx, pcy; // cursor when it was marked pending
+    int merge; // the last operation may be extended by typing
+    int suspended;
+    int saved; // `cur` when the file was last saved, -1 once unreachable
+    size_t savedDisk; // and `diskPos`
+    int saving; // `cur` when the save being written was started, -1 once it is off the history
+    size_t savingDisk; // and `diskPos`
+
+    char *origin; // file the buffer was opened from, whose history file is read
+    int disk;
+    unsigned char *map;
+    size_t mapSize;
+    size_t diskPos; // end of the last record applied
+    size_t diskEnd; // end of the records that can be redone, memory operations follow
+};
+
+static struct undoHistory undo = { .limit = UNDO_MEMORY_LIMIT, .pending = 1, .saving = -1 };
+
+/**
+ * @brief Sets the memory the log and its text may use before the oldest steps are dropped.
+*/
+void editorUndoSetLimit(size_t bytes)
+{
+    undo.limit = bytes;
+}
+
+/**
+ * @brief Unmaps the history file, keeping the saved state only if it is in memory.
+*/
+static void undoDiskClose()
+{
+    // the position of a save being written is lost with the records
+    if (undo.map) undo.saving = -1;
+
+    if (undo.map) munmap(undo.map, undo.mapSize);
+    undo.map = NULL;
+    undo.mapSize = 0;
+    undo.disk = DISK_NONE;
+
+    if (undo.savedDisk != undo.diskPos) undo.saved = -1;
+    undo.savedDisk = undo.savingDisk = undo.diskPos = undo.diskEnd = 0;
+}
+
+/**
+ * @brief Forgets all history, used when a file is opened.
+*/
+void editorUndoReset()
+{
+    free(undo.ops);
+    free(undo.text);
+    undo.ops = NULL;
+    undo.text = NULL;
+    undo.numops = undo.cap = undo.cur = 0;
+    undo.textLen = undo.textCap = 0;
+    undo.pending = 1;
+    undo.merge = 0;
+
+    undoDiskClose();
+    free(undo.origin);
+    undo.origin = NULL;
+    undo.saved = 0;
+    undo.saving = -1;
+}
+
+/**
+ * @brief Sets the history of the buffer being switched away from aside and starts an empty one.
+ * @return The history to hand back to `editorUndoRestore` when the buffer is shown again.
+*/
+struct undoHistory *editorUndoDetach()
+{
+    struct undoHistory *h = malloc(sizeof(struct undoHistory));
+    *h = undo;
+
+    memset(&undo, 0, sizeof(undo));
+    undo.limit = h->limit;
+    undo.suspended = h->suspended;
+    undo.pending = 1;
+    undo.saving = -1;
+    return h;
+}
+
+/**
+ * @brief Drops the current history for one set aside by `editorUndoDetach`, or for an empty
+ * @brief one if `h` is NULL.
+*/
+void editorUndoRestore(struct undoHistory *h)
+{
+    editorUndoReset();
+    if (h == NULL) return;
+
+    h->limit = undo.limit;
+    h->suspended = undo.suspended;
+    undo = *h;
+    free(h);
+}
+
+/**
+ * @brief Frees a history set aside by `editorUndoDetach`.
+*/
+void editorUndoFree(struct undoHistory *h)
+{
+    if (h == NULL) return;
+
+    free(h->ops);
+    free(h->text);
+    free(h->origin);
+    if (h->map) munmap(h->map, h->mapSize);
+    free(h);
+}
+
+/**
+ * @brief Notes the file the buffer was read from; its history file is looked at on demand.
+*/
+void editorUndoAttach(const char *fileName)
+{
+    free(undo.origin);
+    undo.origin = strdup(fileName);
+    undo.disk = DISK_UNCHECKED;
+}
+
+/**
+ * @brief Path of the history file kept for `fileName`: `.<name>.undo` in the same directory.
+ * @return A string to be freed by the caller.
+*/
+char *editorUndoFile(const char *fileName)
+{
+    const char *base = strrchr(fileName, '/');
+    base = base ? base + 1 : fileName;
+
+    int dirLen = base - fileName;
+    char *path = malloc(dirLen + strlen(base) + 7);
+    sprintf(path, "%.*s.%s.undo", dirLen, fileName, base);
+    return path;
+}
+
+/**
+ * @brief Stops recording until the matching `editorUndoResume`, while loading a file or replaying.
+*/
+void editorUndoSuspend()
+{
+    undo.suspended++;
+}
+
+void editorUndoResume()
+{
+    undo.suspended--;
+}
+
+/**
+ * @brief Stores the cursor after the step just finished on its last operation.
+*/
+static void undoClose()
+{
+    if (!undo.pending && undo.cur > 0)
+    {
+        undo.ops[undo.cur - 1].ax = editor.cx;
+        undo.ops[undo.cur - 1].ay = editor.cy;
+    }
+    undo.pending = 1;
+    undo.pcx = editor.cx;
+    undo.pcy = editor.cy;
+}
+
+/**
+ * @brief Called before each keypress: whatever it changes is undone as one step.
+*/
+void editorUndoBoundary()
+{
+    undoClose();
+}
+
+/**
+ * @brief Like `editorUndoBoundary`, and typing does not extend what came before either: changes
+ * @brief made outside of a keypress are undone on their own.
+*/
+void editorUndoSeparate()
+{
+    undoClose();
+    undo.merge = 0;
+}
+
+static void undoReserve(size_t size)
+{
+    if (undo.text && undo.textLen + size <= undo.textCap) return;
+
+    size_t cap = undo.textCap ? undo.textCap : 4096;
+    while (cap < undo.textLen + size) cap *= 2;
+    undo.text = realloc(undo.text, cap);
+    undo.textCap = cap;
+}
+
+/**
+ * @brief Removes the first `k` operations from the log and their text from the arena.
+*/
+static void undoDropFront(int k)
+{
+    if (k == 0) return;
+
+    size_t drop = k < undo.numops ? undo.ops[k].off : undo.textLen;
+    if (drop) memmove(undo.text, &undo.text[drop], undo.textLen - drop);
+    undo.textLen -= drop;
+
+    memmove(undo.ops, &undo.ops[k], sizeof(struct undoOp) * (undo.numops - k));
+    undo.numops -= k;
+    undo.cur -= k;
+    for (int i = 0; i < undo.numops; i++) undo.ops[i].off -= drop;
+
+    undo.saved = undo.saved >= k ? undo.saved - k : -1;
+    undo.saving = undo.saving >= k ? undo.saving - k : -1;
+}
+
+/**
+ * @brief Drops the oldest steps once over the limit, down to three quarters of it so the
+ * @brief compaction is not repeated on every operation. The step last applied is always kept.
+*/
+static void undoTrim()
+{
+    size_t used = sizeof(struct undoOp) * undo.numops + undo.textLen;
+    if (used <= undo.limit) return;
+
+    size_t target = undo.limit / 4 * 3;
+    unsigned int keep = undo.ops[undo.cur - 1].step;
+    int k = 0;
+
+    while (k < undo.cur && used > target && undo.ops[k].step != keep)
+    {
+        unsigned int step = undo.ops[k].step;
+        while (k < undo.numops && undo.ops[k].step == step)
+        {
+            used -= sizeof(struct undoOp) + undo.ops[k].size;
+            k++;
+        }
+    }
+    if (k == 0) return;
+
+    // the history file ends where the dropped steps began
+    if (undo.disk != DISK_NONE) undoDiskClose();
+    undoDropFront(k);
+}
+
+/**
+ * @brief Appends an operation with `size` bytes of text, discarding what could be redone.
+ * @return The operation, its text is at `undo.text + op->off`.
+*/
+static struct undoOp *undoPush(int type, size_t size)
+{
+    if (undo.diskPos < undo.diskEnd)
+    {
+        // undone steps from the history file can no longer be redone either
+        if (undo.savedDisk > undo.diskPos) undo.saved = -1;
+        undo.diskEnd = undo.diskPos;
+    }
+
+    if (undo.cur < undo.numops)
+    {
+        undo.textLen = undo.ops[undo.cur].off;
+        undo.numops = undo.cur;
+        if (undo.saved > undo.cur) undo.saved = -1;
+        if (undo.saving > undo.cur) undo.saving = -1;
+    }
+
+    if (undo.numops == undo.cap)
+    {
+        undo.cap = undo.cap ? undo.cap * 2 : 256;
+        undo.ops = realloc(undo.ops, sizeof(struct undoOp) * undo.cap);
+    }
+
+    if (undo.pending)
+    {
+        undo.step++;
+        undo.pending = 0;
+    }
+
+    struct undoOp *op = &undo.ops[undo.numops++];
+    undo.cur = undo.numops;
+
+    op->type = type;
+    op->step = undo.step;
+    op->off = undo.textLen;
+    op->size = size;
+    op->cx = undo.pcx;
+    op->cy = undo.pcy;
+    op->ax = editor.cx;
+    op->ay = editor.cy;
+
+    undoReserve(size);
+    undo.textLen += size;
+    return op;
+}
+
+/**
+ * @brief Extends the last operation with one typed or backspaced byte if it continues it.
+ * @return 1 if merged.
+*/
+static int undoMerge(int row, int col, const char *old, int oldLen, const char *text, int len)
+{
+    if (!undo.merge || undo.cur == 0 || undo.cur != undo.numops) return 0;
+
+    struct undoOp *op = &undo.ops[undo.cur - 1];
+    if (op->type != UNDO_CHANGE || op->row != row) return 0;
+
+    if (oldLen == 0 && len == 1 && op->oldLen == 0 && col == op->col + op->len)
+    {
+        // a word typed after a space starts a new step
+        if (text[0] != ' ' && undo.text[op->off + op->size - 1] == ' ') return 0;
+
+        undoReserve(1);
+        undo.text[undo.textLen++] = text[0];
+        op->len++;
+    }
+    else if (len == 0 && oldLen == 1 && op->len == 0 && col + 1 == op->col)
+    {
+        if (old[0] != ' ' && undo.text[op->off] == ' ') return 0;
+
+        undoReserve(1);
+        memmove(&undo.text[op->off + 1], &undo.text[op->off], op->size);
+        undo.text[op->off] = old[0];
+        undo.textLen++;
+        op->oldLen++;
+        op->col--;
+    }
+    else
+    {
+        return 0;
+    }
+
+    op->size++;
+    undo.pending = 0;
+    return 1;
+}
+
+/**
+ * @brief Records that `oldLen` bytes at `col` of `row` were replaced by `len` bytes.
+ * @note Call before the row is modified, `old` may point into it. Bytes shared at both ends
+ * @note of the old and new text are not stored.
+*/
+void editorUndoChange(int row, int col, const char *old, int oldLen, const char *text, int len)
+{
+    if (undo.suspended) return;
+
+    while (oldLen > 0 && len > 0 && *old == *text)
+    {
+        old++;
+        text++;
+        col++;
+        oldLen--;
+        len--;
+    }
+    while (oldLen > 0 && len > 0 && old[oldLen - 1] == text[len - 1])
+    {
+        oldLen--;
+        len--;
+    }
+    if (oldLen == 0 && len == 0) return;
+
+    if (undoMerge(row, col, old, oldLen, text, len)) return;
+
+    // the tail of a row cut off right after it was inserted as the next row: Enter
+    struct undoOp *last = undo.cur ? &undo.ops[undo.cur - 1] : NULL;
+    if (last && !undo.pending && undo.cur == undo.numops && last->type == UNDO_ROWS_INSERT && last->len == 1 &&
+        last->row == row + 1 && len == 0 && last->size == (size_t)oldLen &&
+        col + oldLen == editor.row[row].size && memcmp(&undo.text[last->off], old, oldLen) == 0)
+    {
+        undo.textLen -= last->size;
+        last->type = UNDO_SPLIT;
+        last->row = row;
+        last->col = col;
+        last->len = 0;
+        last->size = 0;
+        undo.merge = 0;
+        return;
+    }
+
+    struct undoOp *op = undoPush(UNDO_CHANGE, (size_t)oldLen + len);
+    op->row = row;
+    op->col = col;
+    op->oldLen = oldLen;
+    op->len = len;
+    if (oldLen) memcpy(&undo.text[op->off], old, oldLen);
+    if (len) memcpy(&undo.text[op->off + oldLen], text, len);
+
+    undo.merge = 1;
+    undoTrim();
+}
+
+static void undoRowsText(int type, int at, int n, char **lines, size_t *lens);
+
+/**
+ * @brief Logs rows `at`..`at + n - 1` with their text, joined by '\n'.
+*/
+static void undoRows(int type, int at, int n)
+{
+    if (undo.suspended) return;
+
+    // a row deleted right after it was appended to the one above: Backspace at the start of a row
+    struct undoOp *last = undo.cur ? &undo.ops[undo.cur - 1] : NULL;
+    erow *row = &editor.row[at];
+    if (last && !undo.pending && undo.cur == undo.numops && type == UNDO_ROWS_DELETE && n == 1 &&
+        last->type == UNDO_CHANGE && last->row == at - 1 && last->oldLen == 0 && last->len == row->size &&
+        last->col + row->size == editor.row[at - 1].size && memcmp(&undo.text[last->off], row->chars, row->size) == 0)
+    {
+        undo.textLen -= last->size;
+        last->type = UNDO_JOIN;
+        last->len = 0;
+        last->size = 0;
+        undo.merge = 0;
+        return;
+    }
+
+    undoRowsText(type, at, n, NULL, NULL);
+}
+
+/**
+ * @brief Logs `n` rows at `at` with the text of `lines`, or of the rows themselves if NULL.
+*/
+static void undoRowsText(int type, int at, int n, char **lines, size_t *lens)
+{
+    size_t size = n - 1;
+    for (int i = 0; i < n; i++) size += lines ? lens[i] : (size_t)editor.row[at + i].size;
+
+    struct undoOp *op = undoPush(type, size);
+    op->row = at;
+    op->col = 0;
+    op->oldLen = 0;
+    op->len = n;
+
+    char *p = &undo.text[op->off];
+    for (int i = 0; i < n; i++)
+    {
+        size_t len = lines ? lens[i] : (size_t)editor.row[at + i].size;
+
+        if (i) *p++ = '\n';
+        memcpy(p, lines ? lines[i] : editor.row[at + i].chars, len);
+        p += len;
+    }
+
+    undo.merge = 0;
+    undoTrim();
+}
+
+/**
+ * @brief Records rows just inserted at `at`.
+*/
+void editorUndoRowsInserted(int at, int n)
+{
+    undoRows(UNDO_ROWS_INSERT, at, n);
+}
+
+/**
+ * @brief Records rows about to be deleted at `at`.
+*/
+void editorUndoRowsDeleted(int at, int n)
+{
+    undoRows(UNDO_ROWS_DELETE, at, n);
+}
+
+/**
+ * @brief Records the `n` lines about to be inserted at `at`, for changes logged before they are
+ * @brief made to the rows, see `editorReplaceRows`.
+*/
+void editorUndoLinesInserted(int at, char **lines, size_t *lens, int n)
+{
+    if (undo.suspended) return;
+    undoRowsText(UNDO_ROWS_INSERT, at, n, lines, lens);
+}
+
+/**
+ * @brief Replaces `dlen` bytes at `at` of row `r` with `len` bytes of `s`.
+*/
+static void undoSplice(int r, int at, int dlen, const char *s, int len)
+{
+    erow *row = &editor.row[r];
+    editorRowWritable(row);
+
+    if (len > dlen) row->chars = realloc(row->chars, row->size - dlen + len + 1);
+    memmove(&row->chars[at + len], &row->chars[at + dlen], row->size - at - dlen + 1);
+    memcpy(&row->chars[at], s, len);
+    row->size += len - dlen;
+
+    editorUpdateRow(row);
+    editor.unsaved++;
+}
+
+/**
+ * @brief Inserts the `n` rows joined by '\n' in `s` at `at`, with one `editorInsertRows` call.
+*/
+static void undoInsertRows(int at, int n, char *s, size_t size)
+{
+    char **lines = malloc(sizeof(char *) * n);
+    size_t *lens = malloc(sizeof(size_t) * n);
+    char *end = s + size;
+
+    for (int i = 0; i < n; i++)
+    {
+        char *eol = (i < n - 1) ? memchr(s, '\n', end - s) : NULL;
+        if (!eol) eol = end;
+
+        lines[i] = s;
+        lens[i] = eol - s;
+        s = (eol < end) ? eol + 1 : end;
+    }
+
+    editorInsertRows(at, lines, lens, n);
+
+    free(lines);
+    free(lens);
+}
+
+/**
+ * @brief Moves the text after `col` of row `r` to a new row below it.
+*/
+static void undoSplit(int r, int col)
+{
+    erow *row = &editor.row[r];
+    editorInsertRow(r + 1, &row->chars[col], row->size - col);
+
+    row = &editor.row[r];
+    editorRowWritable(row);
+    row->size = col;
+    row->chars[col] = '\0';
+    editorUpdateRow(row);
+}
+
+/**
+ * @brief Appends row `r + 1` to row `r` and deletes it.
+*/
+static void undoJoin(int r)
+{
+    editorRowAppendString(&editor.row[r], editor.row[r + 1].chars, editor.row[r + 1].size);
+    editorDelRow(r + 1);
+}
+
+/**
+ * @brief Checks an operation against the rows before applying it, records read back from a
+ * @brief history file are not trusted.
+*/
+static int undoFits(const struct undoOp *op, int forward)
+{
+    switch (op->type)
+    {
+        case UNDO_CHANGE:
+            if (op->row < 0 || op->row >= editor.numrows || op->col < 0 || op->oldLen < 0 || op->len < 0) return 0;
+            if (op->size != (size_t)op->oldLen + op->len) return 0;
+            return op->col + (forward ? op->oldLen : op->len) <= editor.row[op->row].size;
+
+        case UNDO_SPLIT:
+        case UNDO_JOIN:
+            if (op->row < 0 || op->col < 0 || op->size != 0) return 0;
+            if ((op->type == UNDO_SPLIT) == forward) return op->row < editor.numrows && op->col <= editor.row[op->row].size;
+            return op->row + 1 < editor.numrows && op->col == editor.row[op->row].size;
+
+        case UNDO_ROWS_INSERT:
+        case UNDO_ROWS_DELETE:
+            if (op->row < 0 || op->len <= 0) return 0;
+            if ((op->type == UNDO_ROWS_INSERT) == forward) return op->row <= editor.numrows;
+            return op->row + op->len <= editor.numrows;
+    }
+    return 0;
+}
+
+static void undoApply(const struct undoOp *op, char *text, int forward)
+{
+    int insert = (op->type == UNDO_ROWS_INSERT) == forward;
+
+    switch (op->type)
+    {
+        case UNDO_CHANGE:
+            if (forward) undoSplice(op->row, op->col, op->oldLen, &text[op->oldLen], op->len);
+            else undoSplice(op->row, op->col, op->len, text, op->oldLen);
+            break;
+
+        case UNDO_ROWS_INSERT:
+        case UNDO_ROWS_DELETE:
+            if (insert) undoInsertRows(op->row, op->len, text, op->size);
+            else editorDelRows(op->row, op->len);
+            break;
+
+        case UNDO_SPLIT:
+        case UNDO_JOIN:
+            if ((op->type == UNDO_SPLIT) == forward) undoSplit(op->row, op->col);
+            else undoJoin(op->row);
+            break;
+    }
+}
+
+static void undoHashBlock(uint64_t h[4], const unsigned char *s)
+{
+    const uint64_t k = 0xff51afd7ed558ccdull;
+
+    for (int j = 0; j < 4; j++)
+    {
+        uint64_t w;
+        memcpy(&w, &s[j * 8], 8);
+        h[j] = (h[j] ^ w) * k;
+        h[j] ^= h[j] >> 29;
+    }
+}
+
+/**
+ * @brief Starts hashing a file text of `len` bytes fed in pieces to `editorUndoHashUpdate`.
+ * @note Four independent multiply-xorshift lanes over 8-byte words, so the hash keeps up with the
+ * @note disk when saving a large file.
+*/
+void editorUndoHashInit(struct undoHashState *s, size_t len)
+{
+    s->h[0] = len;
+    s->h[1] = 1;
+    s->h[2] = 2;
+    s->h[3] = 3;
+    s->carried = 0;
+}
+
+void editorUndoHashUpdate(struct undoHashState *s, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    if (len == 0) return;
+
+    if (s->carried)
+    {
+        size_t n = sizeof(s->carry) - s->carried;
+        if (n > len) n = len;
+        memcpy(&s->carry[s->carried], p, n);
+        s->carried += n;
+        p += n;
+        len -= n;
+
+        if (s->carried < sizeof(s->carry)) return;
+        undoHashBlock(s->h, s->carry);
+        s->carried = 0;
+    }
+
+    for (; len >= sizeof(s->carry); p += sizeof(s->carry), len -= sizeof(s->carry)) undoHashBlock(s->h, p);
+
+    memcpy(s->carry, p, len);
+    s->carried = len;
+}
+
+/**
+ * @return The hash, the same whichever way the text was split into pieces.
+*/
+uint64_t editorUndoHashFinal(struct undoHashState *s)
+{
+    const uint64_t k = 0xff51afd7ed558ccdull;
+
+    uint64_t r = s->h[0] ^ (s->h[1] * 3) ^ (s->h[2] * 5) ^ (s->h[3] * 7);
+    for (size_t i = 0; i < s->carried; i++) r = (r ^ s->carry[i]) * 0x100000001b3ull;
+
+    r ^= r >> 33;
+    r *= k;
+    r ^= r >> 33;
+    return r;
+}
+
+static uint64_t undoHash(const unsigned char *s, size_t len)
+{
+    struct undoHashState state;
+    editorUndoHashInit(&state, len);
+    editorUndoHashUpdate(&state, s, len);
+    return editorUndoHashFinal(&state);
+}
+
+static void putVarint(FILE *fp, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        putc((v & 0x7f) | 0x80, fp);
+        v >>= 7;
+    }
+    putc(v, fp);
+}
+
+/**
+ * @brief Reads a varint at `*at`, advancing it.
+ * @return 0 if it runs past `end`.
+*/
+static int getVarint(const unsigned char *map, size_t *at, size_t end, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; *at < end && shift < 64; shift += 7)
+    {
+        unsigned char b = map[(*at)++];
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes one history record: flags, position, lengths, cursors, the text and, stored
+ * @brief backwards, the length of all that.
+*/
+static void undoWriteRecord(FILE *fp, const struct undoOp *op, int flags, const char *text)
+{
+    uint64_t fields[] = { op->type | flags, op->row, op->col, op->oldLen, op->len,
+        op->cx, op->cy, op->ax, op->ay, op->size };
+    long start = ftell(fp);
+
+    for (int i = 0; i < (int)(sizeof(fields) / sizeof(fields[0])); i++) putVarint(fp, fields[i]);
+    fwrite(text, 1, op->size, fp);
+
+    unsigned char len[10];
+    int n = 0;
+    for (uint64_t v = ftell(fp) - start; ; v >>= 7)
+    {
+        len[n++] = (v & 0x7f) | (v >= 0x80 ? 0x80 : 0);
+        if (v < 0x80) break;
+    }
+    while (n) putc(len[--n], fp);
+}
+
+static size_t undoRecordStart(const unsigned char *map, size_t end);
+
+/**
+ * @brief Decodes the record starting at `at` in the history file, `next` is set to its end.
+ * @return Its flags, or -1 if it is malformed.
+*/
+static int undoReadRecord(size_t at, size_t end, struct undoOp *op, char **text, size_t *next)
+{
+    size_t start = at;
+    uint64_t fields[10];
+
+    for (int i = 0; i < 10; i++)
+    {
+        if (!getVarint(undo.map, &at, end, &fields[i]) || fields[i] > INT32_MAX) return -1;
+    }
+    if (fields[9] > end - at) return -1;
+
+    op->type = fields[0] & ~UNDO_STEP_START;
+    op->row = fields[1];
+    op->col = fields[2];
+    op->oldLen = fields[3];
+    op->len = fields[4];
+    op->cx = fields[5];
+    op->cy = fields[6];
+    op->ax = fields[7];
+    op->ay = fields[8];
+    op->size = fields[9];
+    *text = (char *)&undo.map[at];
+
+    // the backwards length takes as many bytes as it would forwards
+    uint64_t len = at + op->size - start;
+    *next = at + op->size + 1;
+    for (uint64_t v = len; v >= 0x80; v >>= 7) (*next)++;
+    if (*next > end || undoRecordStart(undo.map, *next) != start) return -1;
+
+    return fields[0] & UNDO_STEP_START;
+}
+
+/**
+ * @brief Start of the record ending at `end` in the history file mapped at `map`, from the
+ * @brief backwards length at its end.
+ * @return 0 if malformed, no record starts inside the header.
+*/
+static size_t undoRecordStart(const unsigned char *map, size_t end)
+{
+    uint64_t len = 0;
+    size_t at = end;
+
+    for (int shift = 0; at > UNDO_FILE_HEADER && shift < 64; shift += 7)
+    {
+        unsigned char b = map[--at];
+        len |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return (len <= at - UNDO_FILE_HEADER) ? at - len : 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Maps `path` read-only.
+ * @return The mapping, or NULL if the file is missing or empty.
+*/
+static unsigned char *undoMap(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    unsigned char *map = NULL;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) map = NULL;
+        *size = st.st_size;
+    }
+    close(fd);
+    return map;
+}
+
+/**
+ * @brief Opens the history file of the opened file on first use, if its hash matches the
+ * @brief opened file. That file is unchanged until the first save, which loads this first.
+ * @return 1 if there is a history file.
+*/
+static int undoDiskLoad()
+{
+    if (undo.disk != DISK_UNCHECKED) return undo.disk == DISK_MAPPED;
+    undo.disk = DISK_NONE;
+
+    char *path = editorUndoFile(undo.origin);
+    size_t size;
+    unsigned char *map = undoMap(path, &size);
+    free(path);
+    if (!map) return 0;
+
+    if (size < UNDO_FILE_HEADER || memcmp(map, UNDO_FILE_MAGIC, 8) != 0)
+    {
+        munmap(map, size);
+        return 0;
+    }
+
+    uint64_t hash;
+    memcpy(&hash, &map[8], sizeof(hash));
+
+    size_t fileSize = 0;
+    unsigned char *file = undoMap(undo.origin, &fileSize);
+    uint64_t fileHash = undoHash(file, fileSize);
+    if (file) munmap(file, fileSize);
+
+    if (hash != fileHash)
+    {
+        munmap(map, size);
+        return 0;
+    }
+
+    // in-memory operations follow on from the end of the file
+    undo.map = map;
+    undo.mapSize = size;
+    undo.diskPos = undo.diskEnd = size;
+    if (undo.savedDisk == 0) undo.savedDisk = size;
+    undo.disk = DISK_MAPPED;
+    return 1;
+}
+
+static void undoMoveCursor(int cx, int cy)
+{
+    if (cy > editor.numrows) cy = editor.numrows;
+    if (cy < editor.numrows && cx > editor.row[cy].size) cx = editor.row[cy].size;
+    if (cy == editor.numrows) cx = 0;
+
+    editor.cx = cx;
+    editor.cy = cy;
+
+    undo.merge = 0;
+    undoClose();
+
+    if (undo.cur == undo.saved && undo.diskPos == undo.savedDisk) editor.unsaved = 0;
+}
+
+/**
+ * @brief Gives up on a history file that turned out to be malformed. If part of a step was
+ * @brief applied, the operations in memory no longer match the rows and are dropped too.
+*/
+static void undoDiskFail(int applied)
+{
+    if (applied)
+    {
+        undo.numops = undo.cur = 0;
+        undo.textLen = 0;
+        undo.saved = -1;
+        undo.saving = -1;
+    }
+    undoDiskClose();
+}
+
+/**
+ * @brief Reverts the last step of the history file, which precedes everything in memory.
+ * @return 0 if there is none, or the file turns out to be malformed.
+*/
+static int undoDiskUndo()
+{
+    if (!undoDiskLoad() || undo.diskPos <= UNDO_FILE_HEADER) return 0;
+
+    struct undoOp op;
+    char *text;
+    size_t next;
+    int applied = 0;
+    int ok = 0;
+
+    // records are applied backwards until the one starting the step
+    editorUndoSuspend();
+    while (!ok && undo.diskPos > UNDO_FILE_HEADER)
+    {
+        size_t start = undoRecordStart(undo.map, undo.diskPos);
+        int flags = start ? undoReadRecord(start, undo.diskPos, &op, &text, &next) : -1;
+        if (flags == -1 || !undoFits(&op, 0)) break;
+
+        undoApply(&op, text, 0);
+        undo.diskPos = start;
+        applied++;
+        ok = flags;
+    }
+    editorUndoResume();
+
+    if (!ok)
+    {
+        undoDiskFail(applied);
+        undoMoveCursor(editor.cx, editor.cy);
+        return 0;
+    }
+
+    undoMoveCursor(op.cx, op.cy);
+    return 1;
+}
+
+/**
+ * @brief Applies the next step of the history file that was undone.
+ * @return 0 if it turns out to be malformed.
+*/
+static int undoDiskRedo()
+{
+    struct undoOp op;
+    char *text;
+    size_t next;
+    int applied = 0;
+    int ok = 1;
+
+    editorUndoSuspend();
+    while (undo.diskPos < undo.diskEnd)
+    {
+        int flags = undoReadRecord(undo.diskPos, undo.diskEnd, &op, &text, &next);
+        if (flags == 0 && applied == 0) flags = -1; // a step must start here
+        if (flags > 0 && applied) break;
+
+        if (flags == -1 || !undoFits(&op, 1))
+        {
+            ok = 0;
+            break;
+        }
+
+        undoApply(&op, text, 1);
+        undo.diskPos = next;
+        applied++;
+    }
+    editorUndoResume();
+
+    if (!ok)
+    {
+        undoDiskFail(applied);
+        undoMoveCursor(editor.cx, editor.cy);
+        return 0;
+    }
+
+    undoMoveCursor(op.ax, op.ay);
+    return 1;
+}
+
+/**
+ * @brief Reverts the last step and moves the cursor to where it was before it.
+ * @return 0 if there is nothing to undo.
+*/
+int editorUndo()
+{
+    undoClose();
+    if (undo.cur == 0) return undoDiskUndo();
+
+    unsigned int step = undo.ops[undo.cur - 1].step;
+
+    editorUndoSuspend();
+    while (undo.cur > 0 && undo.ops[undo.cur - 1].step == step)
+    {
+        undo.cur--;
+        undoApply(&undo.ops[undo.cur], &undo.text[undo.ops[undo.cur].off], 0);
+    }
+    editorUndoResume();
+
+    undoMoveCursor(undo.ops[undo.cur].cx, undo.ops[undo.cur].cy);
+    return 1;
+}
+
+/**
+ * @brief Applies the next undone step again, from the history file first.
+ * @return 0 if there is nothing to redo.
+*/
+int editorRedo()
+{
+    undoClose();
+
+    if (undo.diskPos < undo.diskEnd) return undoDiskRedo();
+
+    if (undo.cur == undo.numops) return 0;
+
+    unsigned int step = undo.ops[undo.cur].step;
+
+    editorUndoSuspend();
+    while (undo.cur < undo.numops && undo.ops[undo.cur].step == step)
+    {
+        undoApply(&undo.ops[undo.cur], &undo.text[undo.ops[undo.cur].off], 1);
+        undo.cur++;
+    }
+    editorUndoResume();
+
+    undoMoveCursor(undo.ops[undo.cur - 1].ax, undo.ops[undo.cur - 1].ay);
+    return 1;
+}
+
+/**
+ * @brief Records a save adds to the history file, written by its job once the text is on disk,
+ * @brief see `editorUndoSaveWrite`.
+*/
+struct undoDiskWrite
+{
+    char *path; // history file of the saved file
+    char *from; // history file the records before `base` are copied from, NULL if it is `path`
+    size_t base; // end of the records kept from the file, 0 to start a new one
+    char *records; // the operations in memory, encoded
+    size_t len;
+    size_t limit;
+
+    size_t size; // size of the history file once written, 0 if that failed
+    size_t dropped; // bytes of the oldest steps dropped to keep under `limit`
+};
+
+static void undoDiskWriteFree(struct undoDiskWrite *w)
+{
+    free(w->path);
+    free(w->from);
+    free(w->records);
+    free(w);
+}
+
+/**
+ * @brief Called when a save takes its snapshot of the rows, before the file is overwritten: its
+ * @brief history file, if any, has to be checked against it now. Only the operations in memory
+ * @brief are encoded here, the save job appends them to the file, see `editorUndoSaveWrite`,
+ * @brief and `editorUndoSaved` maps it once that is done. Edits made meanwhile are logged after
+ * @brief it as usual.
+ * @return The records to hand to `editorUndoSaveWrite`.
+*/
+struct undoDiskWrite *editorUndoBeforeSave()
+{
+    undoDiskLoad();
+
+    // steps undone into the old history file cannot be redone past the saved text, like after an edit
+    if (undo.diskPos < undo.diskEnd)
+    {
+        if (undo.savedDisk > undo.diskPos) undo.saved = -1;
+        undo.diskEnd = undo.diskPos;
+        undo.numops = undo.cur = 0;
+        undo.textLen = 0;
+    }
+
+    // typing must not extend an operation the file holds
+    undo.merge = 0;
+    undo.saving = undo.cur;
+    undo.savingDisk = undo.diskPos;
+
+    struct undoDiskWrite *w = calloc(1, sizeof(struct undoDiskWrite));
+    w->path = editorUndoFile(editor.fileName);
+    w->limit = undo.limit;
+
+    // the records of the mapped file up to the cursor stay, saved as another file they are copied
+    if (undo.disk == DISK_MAPPED)
+    {
+        w->base = undo.diskPos;
+        w->from = editorUndoFile(undo.origin);
+        if (strcmp(w->from, w->path) == 0)
+        {
+            free(w->from);
+            w->from = NULL;
+        }
+    }
+
+    FILE *fp = open_memstream(&w->records, &w->len);
+    if (!fp) return w;
+
+    for (int i = 0; i < undo.cur; i++)
+    {
+        int start = (i == 0 || undo.ops[i].step != undo.ops[i - 1].step) ? UNDO_STEP_START : 0;
+        undoWriteRecord(fp, &undo.ops[i], start, &undo.text[undo.ops[i].off]);
+    }
+
+    if (fclose(fp) != 0)
+    {
+        free(w->records);
+        w->records = NULL;
+    }
+    return w;
+}
+
+static int undoWriteAt(int fd, const void *buf, size_t len, size_t at)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, p, len, at);
+        if (n == -1)
+        {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        p += n;
+        at += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Copies the first `len` bytes of the history file `from` to `fd`.
+*/
+static int undoCopyFile(const char *from, int fd, size_t len)
+{
+    int in = open(from, O_RDONLY);
+    if (in == -1) return 0;
+
+    char *buf = malloc(SAVE_CHUNK);
+    size_t at = 0;
+    int ok = 1;
+
+    while (ok && at < len)
+    {
+        size_t want = len - at < SAVE_CHUNK ? len - at : SAVE_CHUNK;
+        ssize_t n = pread(in, buf, want, at);
+        if (n == -1 && errno == EINTR) continue;
+
+        ok = n > 0 && undoWriteAt(fd, buf, n, at);
+        if (ok) at += n;
+    }
+
+    free(buf);
+    close(in);
+    return ok;
+}
+
+/**
+ * @brief Start of the oldest step to keep so the records after it take at most `target` bytes,
+ * @brief the last step is always kept.
+*/
+static size_t undoDiskCut(const unsigned char *map, size_t size, size_t target)
+{
+    size_t cut = size, at = size;
+
+    while (at > UNDO_FILE_HEADER)
+    {
+        size_t start = undoRecordStart(map, at);
+        uint64_t flags;
+        size_t p = start;
+        if (start == 0 || !getVarint(map, &p, at, &flags)) break;
+
+        at = start;
+        if (!(flags & UNDO_STEP_START)) continue;
+        if (size - start > target && cut != size) break;
+        cut = start;
+    }
+    return cut < size ? cut : UNDO_FILE_HEADER;
+}
+
+/**
+ * @brief Rewrites the history file open as `fd` without its oldest steps, down to three quarters
+ * @brief of the limit so this is not repeated on every save.
+ * @return 1 with the new size in `size`, 0 if that failed and the file is as it was.
+*/
+static int undoDiskCompact(struct undoDiskWrite *w, int fd, uint64_t hash, size_t *size)
+{
+    unsigned char *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return 0;
+
+    size_t cut = undoDiskCut(map, *size, w->limit / 4 * 3);
+    if (cut == UNDO_FILE_HEADER)
+    {
+        munmap(map, *size);
+        return 1;
+    }
+
+    char *tmp = malloc(strlen(w->path) + 5);
+    sprintf(tmp, "%s.tmp", w->path);
+
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok = out != -1 &&
+        undoWriteAt(out, UNDO_FILE_MAGIC, 8, 0) &&
+        undoWriteAt(out, &hash, sizeof(hash), 8) &&
+        undoWriteAt(out, &map[cut], *size - cut, UNDO_FILE_HEADER);
+    if (out != -1 && close(out) != 0) ok = 0;
+    if (ok && rename(tmp, w->path) != 0) ok = 0;
+    if (!ok) unlink(tmp);
+
+    if (ok)
+    {
+        w->dropped = cut - UNDO_FILE_HEADER;
+        *size -= w->dropped;
+    }
+
+    free(tmp);
+    munmap(map, *size + w->dropped);
+    return ok;
+}
+
+/**
+ * @brief Appends the records of a save to its history file, from the save job once the text is
+ * @brief written. The records kept before them are not rewritten, and the hash of the text goes
+ * @brief in last, so a file cut short never matches the text. Past the limit the oldest steps
+ * @brief are dropped.
+ * @param hash Hash of the text written to the file, see `editorUndoHashInit`.
+*/
+void editorUndoSaveWrite(struct undoDiskWrite *w, uint64_t hash)
+{
+    if (w->records == NULL) return;
+
+    int fd = open(w->path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) return;
+
+    size_t base = w->base;
+    int ok = 1;
+
+    if (base == 0)
+    {
+        uint64_t none = 0;
+        ok = undoWriteAt(fd, UNDO_FILE_MAGIC, 8, 0) && undoWriteAt(fd, &none, sizeof(none), 8);
+        base = UNDO_FILE_HEADER;
+    }
+    else if (w->from)
+    {
+        ok = undoCopyFile(w->from, fd, base);
+    }
+
+    size_t size = base + w->len;
+    ok = ok && undoWriteAt(fd, w->records, w->len, base) && ftruncate(fd, size) == 0 &&
+        undoWriteAt(fd, &hash, sizeof(hash), 8);
+
+    if (ok && size - UNDO_FILE_HEADER > w->limit) ok = undoDiskCompact(w, fd, hash, &size);
+    if (close(fd) != 0) ok = 0;
+
+    if (ok) w->size = size;
+}
+
+/**
+ * @brief Called instead of `editorUndoSaved` when the text could not be written, the history
+ * @brief file was then left alone.
+*/
+void editorUndoSaveFailed(struct undoDiskWrite *w)
+{
+    undoDiskWriteFree(w);
+    undo.saving = -1;
+}
+
+/**
+ * @brief Called once the rows were reloaded from a file changed elsewhere, see `editorReloadCheck`.
+ * @brief The reload is a step of its own, after which the rows are the saved text.
+*/
+void editorUndoReloaded()
+{
+    editorUndoSeparate();
+    undo.saved = undo.cur;
+    undo.savedDisk = undo.diskPos;
+}
+
+/**
+ * @brief Maps the history file written by the save that finished instead of the operations it
+ * @brief holds. Steps undone since the snapshot are redone from the file, edits made during the
+ * @brief save follow it in memory.
+*/
+void editorUndoSaved(struct undoDiskWrite *w)
+{
+    int saving = undo.saving;
+    undo.saving = -1;
+    undo.merge = 0;
+
+    size_t size = 0;
+    unsigned char *map = w->size ? undoMap(w->path, &size) : NULL;
+
+    // an edit after undoing past the snapshot, or history dropped meanwhile, leaves the saved text
+    // on a branch that is only in the file
+    int diverged = saving < 0 || undo.diskEnd < undo.savingDisk;
+
+    int applied = undo.cur;
+    size_t pos = 0;
+
+    if (map && !diverged && size == w->size)
+    {
+        // operations of the file undone in memory are now redone from it, steps undone into the
+        // old records moved with the ones dropped before them
+        if (undo.diskPos == undo.savingDisk)
+        {
+            pos = size;
+            for (int i = applied; i < saving && pos; i++) pos = undoRecordStart(map, pos);
+        }
+        else if (undo.diskPos >= UNDO_FILE_HEADER + w->dropped)
+        {
+            pos = undo.diskPos - w->dropped;
+        }
+    }
+
+    if (map && pos < UNDO_FILE_HEADER)
+    {
+        munmap(map, size);
+        map = NULL;
+    }
+
+    if (!map)
+    {
+        // history stays as it is, unless the file it maps was replaced by a shorter one
+        undo.saved = diverged ? -1 : saving;
+        undo.savedDisk = undo.savingDisk;
+        if (w->dropped && !w->from) undoDiskClose();
+        undoDiskWriteFree(w);
+        return;
+    }
+
+    if (undo.map) munmap(undo.map, undo.mapSize);
+    undo.map = map;
+    undo.mapSize = size;
+    undo.disk = DISK_MAPPED;
+
+    // later saves append to this file
+    free(undo.origin);
+    undo.origin = strdup(editor.fileName);
+
+    undoDropFront(saving);
+    undo.cur = applied > saving ? applied - saving : 0;
+
+    undo.diskPos = pos;
+    undo.diskEnd = size;
+    undo.saved = 0;
+    undo.savedDisk = size;
+    undoDiskWriteFree(w);
+}
@@ -0,0 +1,132 @@
+#include "../lib/watch.h"
+#include "../lib/const.h"
+#include "../lib/event.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+/*
+ * Files are watched through their directory rather than their inode, so a file replaced by a
+ * rename (atomic saves, rotated logs) keeps being watched under its name. All events of one read
+ * of the inotify descriptor are coalesced: a file written in many small pieces gets one callback.
+*/
+
+#define WATCH_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+struct watchEntry
+{
+    int used;
+    int wd; // of the directory
+    char *name; // file name within it
+    char *path;
+    editorWatchCallback changed;
+    void *arg;
+    int fired; // seen in the events being handled
+};
+
+static struct
+{
+    int fd; // -1 until the first watch
+    struct watchEntry *list;
+    int count;
+} watches = { .fd = -1 };
+
+/**
+ * @brief Event loop callback for the inotify descriptor, calls back each changed file once.
+*/
+static void watchEvents(int fd, void *arg)
+{
+    (void)arg;
+    char buf[WATCH_EVENT_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+            struct inotify_event *ev = (struct inotify_event *)p;
+
+            for (int i = 0; i < watches.count; i++)
+            {
+                struct watchEntry *w = &watches.list[i];
+                if (!w->used) continue;
+
+                // events were dropped, any file may have changed
+                if (ev->mask & IN_Q_OVERFLOW) w->fired = 1;
+                else if (ev->wd == w->wd && ev->len && !strcmp(ev->name, w->name)) w->fired = 1;
+            }
+        }
+    }
+
+    // a callback may add or remove watches, so entries are looked up again each time
+    for (int i = 0; i < watches.count; i++)
+    {
+        struct watchEntry *w = &watches.list[i];
+        if (!w->used || !w->fired) continue;
+
+        w->fired = 0;
+        w->changed(w->path, w->arg);
+    }
+    editorEventRequestRedraw();
+}
+
+/**
+ * @brief Calls `changed(path, arg)` from the event loop whenever the file at `path` is written,
+ * @brief created, deleted or renamed over.
+ * @return Id for `editorWatchRemove`, or -1 if the directory can't be watched.
+*/
+int editorWatchAdd(const char *path, editorWatchCallback changed, void *arg)
+{
+    if (watches.fd == -1)
+    {
+        watches.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watches.fd == -1) return -1;
+        editorEventAddFd(watches.fd, watchEvents, NULL);
+    }
+
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+
+    // the directory may already be watched for another file, its mask stays the same
+    int wd = inotify_add_watch(watches.fd, dir, WATCH_MASK);
+    free(dir);
+    if (wd == -1) return -1;
+
+    int id = 0;
+    while (id < watches.count && watches.list[id].used) id++;
+    if (id == watches.count)
+    {
+        watches.list = realloc(watches.list, sizeof(struct watchEntry) * (watches.count + 1));
+        watches.count++;
+    }
+
+    struct watchEntry *w = &watches.list[id];
+    w->used = 1;
+    w->wd = wd;
+    w->name = strdup(slash ? slash + 1 : path);
+    w->path = strdup(path);
+    w->changed = changed;
+    w->arg = arg;
+    w->fired = 0;
+    return id;
+}
+
+/**
+ * @brief Stops calling back for watch `id`, and drops its directory once no watch needs it.
+*/
+void editorWatchRemove(int id)
+{
+    if (id < 0 || id >= watches.count || !watches.list[id].used) return;
+
+    struct watchEntry *w = &watches.list[id];
+    w->used = 0;
+    free(w->name);
+    free(w->path);
+
+    for (int i = 0; i < watches.count; i++)
+    {
+        if (watches.list[i].used && watches.list[i].wd == w->wd) return;
+    }
+    inotify_rm_watch(watches.fd, w->wd);
+}
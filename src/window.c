@@ -0,0 +1,366 @@
+#include "../lib/window.h"
+#include "../lib/const.h"
+#include "../lib/editor.h"
+#include "../lib/output.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Windows are the leaves of a tree of splits, each one a viewport on the shown buffer: its own
+ * cursor and scroll offsets, nothing else. Rows, their render and their highlighting are shared,
+ * so an edit updates a row once for every window. The active window's viewport lives in `editor`
+ * like before there were windows; the others are swapped in only to be drawn.
+*/
+
+enum windowSplit
+{
+    WINDOW_LEAF = 0,
+    WINDOW_STACKED, // `first` above `second`
+    WINDOW_SIDE // `first` left of `second`, with a separator column between
+};
+
+struct windowNode
+{
+    int split;
+    struct windowNode *parent, *first, *second;
+
+    int top, left, rows, cols; // text area, the window's status bar is the line below it
+    int cx, cy, rx, rowoff, coloff; // stale for the active window, see `editor`
+};
+
+static struct
+{
+    struct windowNode *root; // NULL while there is a single window
+    struct windowNode *active;
+    int count;
+    int screenRows; // windows and their status bars, the message bar excluded
+    int screenCols;
+} windows;
+
+static void windowSave(struct windowNode *w)
+{
+    w->cx = editor.cx;
+    w->cy = editor.cy;
+    w->rx = editor.rx;
+    w->rowoff = editor.rowoff;
+    w->coloff = editor.coloff;
+}
+
+/**
+ * @brief Moves a window's viewport into `editor`, clamping a cursor left past rows or text that
+ * @brief an edit in another window removed.
+*/
+static void windowLoad(struct windowNode *w)
+{
+    editor.cy = w->cy < editor.numrows ? w->cy : editor.numrows;
+    editor.cx = w->cx;
+    if (editor.cy < editor.numrows && editor.cx > editor.row[editor.cy].size) editor.cx = editor.row[editor.cy].size;
+    if (editor.cy == editor.numrows) editor.cx = 0;
+    editor.rx = w->rx;
+    editor.rowoff = w->rowoff;
+    editor.coloff = w->coloff;
+    editor.screenRows = w->rows;
+    editor.screenCols = w->cols;
+}
+
+/**
+ * @brief Divides the area at `top`, `left` between the windows of `node`, status bars included.
+*/
+static void windowLayout(struct windowNode *node, int top, int left, int rows, int cols)
+{
+    if (node->split == WINDOW_LEAF)
+    {
+        node->top = top;
+        node->left = left;
+        node->rows = rows > 1 ? rows - 1 : 1;
+        node->cols = cols > 1 ? cols : 1;
+        return;
+    }
+
+    if (node->split == WINDOW_STACKED)
+    {
+        int half = rows / 2;
+        windowLayout(node->first, top, left, half, cols);
+        windowLayout(node->second, top + half, left, rows - half, cols);
+    }
+    else
+    {
+        int half = cols / 2;
+        windowLayout(node->first, top, left, rows, half);
+        windowLayout(node->second, top, left + half + 1, rows, cols - half - 1);
+    }
+}
+
+/**
+ * @brief Lays out every window again and gives the active one's size to `editor`.
+*/
+static void windowRelayout()
+{
+    windowLayout(windows.root, 0, 0, windows.screenRows, windows.screenCols);
+    editor.screenRows = windows.active->rows;
+    editor.screenCols = windows.active->cols;
+}
+
+/**
+ * @brief Sets the terminal size, called instead of assigning `editor.screenRows`/`screenCols`.
+*/
+void editorWindowResize(int rows, int cols)
+{
+    if (windows.root == NULL)
+    {
+        editor.screenRows = rows - 2;
+        editor.screenCols = cols;
+        return;
+    }
+
+    windows.screenRows = rows - 1;
+    windows.screenCols = cols;
+    windowRelayout();
+}
+
+static struct windowNode *windowFirstLeaf(struct windowNode *node)
+{
+    while (node->split != WINDOW_LEAF) node = node->first;
+    return node;
+}
+
+/**
+ * @brief Leaf after `w` in drawing order, wrapping around to the first.
+*/
+static struct windowNode *windowNextLeaf(struct windowNode *w)
+{
+    while (w->parent && w == w->parent->second) w = w->parent;
+    if (w->parent == NULL) return windowFirstLeaf(w);
+    return windowFirstLeaf(w->parent->second);
+}
+
+/**
+ * @brief Splits the active window in two showing the same place, the active one stays first.
+*/
+static void windowSplit(int split)
+{
+    int rows = editor.screenRows + 1, cols = editor.screenCols;
+    if ((split == WINDOW_STACKED && rows / 2 < WINDOW_MIN_ROWS + 1) ||
+        (split == WINDOW_SIDE && cols / 2 < WINDOW_MIN_COLS + LN_OFFSET))
+    {
+        editorSetStatusMessage("No room to split.");
+        return;
+    }
+
+    if (windows.root == NULL)
+    {
+        windows.root = calloc(1, sizeof(struct windowNode));
+        windows.active = windows.root;
+        windows.count = 1;
+        windows.screenRows = editor.screenRows + 1;
+        windows.screenCols = editor.screenCols;
+    }
+
+    struct windowNode *w = windows.active;
+    windowSave(w);
+
+    struct windowNode *first = malloc(sizeof(struct windowNode));
+    struct windowNode *second = malloc(sizeof(struct windowNode));
+    *first = *w;
+    *second = *w;
+    first->parent = second->parent = w;
+
+    w->split = split;
+    w->first = first;
+    w->second = second;
+
+    windows.active = first;
+    windows.count++;
+    windowRelayout();
+}
+
+/**
+ * @brief Closes the active window, its sibling takes the space. The last window stays.
+*/
+static void windowClose()
+{
+    if (windows.root == NULL)
+    {
+        editorSetStatusMessage("Only one window.");
+        return;
+    }
+
+    struct windowNode *w = windows.active;
+    struct windowNode *parent = w->parent;
+    struct windowNode *sibling = (parent->first == w) ? parent->second : parent->first;
+
+    // the sibling's subtree moves up into the parent node
+    *parent = (struct windowNode){ .split = sibling->split, .parent = parent->parent,
+        .first = sibling->first, .second = sibling->second,
+        .cx = sibling->cx, .cy = sibling->cy, .rx = sibling->rx,
+        .rowoff = sibling->rowoff, .coloff = sibling->coloff };
+    if (parent->split != WINDOW_LEAF) parent->first->parent = parent->second->parent = parent;
+    free(sibling);
+    free(w);
+
+    windows.count--;
+    windows.active = windowFirstLeaf(parent);
+
+    if (windows.count == 1)
+    {
+        windowLoad(windows.root);
+        free(windows.root);
+        windows.root = NULL;
+        editor.screenRows = windows.screenRows - 1;
+        editor.screenCols = windows.screenCols;
+        return;
+    }
+
+    windowRelayout();
+    windowLoad(windows.active);
+}
+
+static void windowFree(struct windowNode *node)
+{
+    if (node->split != WINDOW_LEAF)
+    {
+        windowFree(node->first);
+        windowFree(node->second);
+    }
+    free(node);
+}
+
+/**
+ * @brief Runs the window command typed after the Ctrl-W prefix.
+*/
+void editorWindowCommand(int key)
+{
+    switch (key)
+    {
+        case 's':
+        case CTRL_KEY('s'):
+            windowSplit(WINDOW_STACKED);
+            break;
+
+        case 'v':
+        case CTRL_KEY('v'):
+            windowSplit(WINDOW_SIDE);
+            break;
+
+        case 'w':
+        case CTRL_KEY('w'):
+            if (windows.root == NULL) break;
+            windowSave(windows.active);
+            windows.active = windowNextLeaf(windows.active);
+            windowLoad(windows.active);
+            break;
+
+        case 'c':
+        case 'q':
+            windowClose();
+            break;
+
+        case 'o':
+            // the active viewport is already in `editor`
+            if (windows.root == NULL) break;
+            windowFree(windows.root);
+            windows.root = NULL;
+            editor.screenRows = windows.screenRows - 1;
+            editor.screenCols = windows.screenCols;
+            break;
+
+        default:
+            editorSetStatusMessage("Ctrl-W then: s split, v split side by side, w next, c close, o only");
+    }
+}
+
+int editorWindowCount()
+{
+    return windows.root ? windows.count : 1;
+}
+
+/**
+ * @brief Screen position of the active window's text area, 0-based.
+*/
+void editorWindowOrigin(int *top, int *left)
+{
+    *top = windows.root ? windows.active->top : 0;
+    *left = windows.root ? windows.active->left : 0;
+}
+
+/**
+ * @return Width of the whole screen, for the message bar.
+*/
+int editorWindowScreenCols()
+{
+    return windows.root ? windows.screenCols : editor.screenCols;
+}
+
+static void windowDrawNode(struct abuf *ab, struct windowNode *node)
+{
+    if (node->split != WINDOW_LEAF)
+    {
+        // left before right, so a window clearing the rest of its lines never wipes a neighbour
+        windowDrawNode(ab, node->first);
+        windowDrawNode(ab, node->second);
+        return;
+    }
+
+    if (node == windows.active)
+    {
+        editorDrawWindow(ab, node->top, node->left);
+        return;
+    }
+
+    windowSave(windows.active);
+    windowLoad(node);
+    editorScroll();
+    editorDrawWindow(ab, node->top, node->left);
+    windowSave(node);
+    windowLoad(windows.active);
+}
+
+/**
+ * @brief Draws every window with its status bar, the active one already scrolled.
+*/
+void editorWindowDraw(struct abuf *ab)
+{
+    windowDrawNode(ab, windows.root);
+
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;1H", windows.screenRows + 1);
+    abAppend(ab, buf, len);
+}
+
+/**
+ * @brief Keeps the other windows on the same text when rows are inserted above their cursor.
+*/
+static void windowShift(struct windowNode *node, int at, int n)
+{
+    if (node->split != WINDOW_LEAF)
+    {
+        windowShift(node->first, at, n);
+        windowShift(node->second, at, n);
+        return;
+    }
+    if (node == windows.active) return;
+
+    if (n > 0)
+    {
+        if (node->cy >= at) node->cy += n;
+        if (node->rowoff >= at) node->rowoff += n;
+        return;
+    }
+
+    // deleted rows: what was below them moves up, a position inside them lands on the first row after
+    int end = at - n;
+    if (node->cy >= end) node->cy += n;
+    else if (node->cy > at) node->cy = at;
+    if (node->rowoff >= end) node->rowoff += n;
+    else if (node->rowoff > at) node->rowoff = at;
+}
+
+void editorWindowRowsInserted(int at, int n)
+{
+    if (windows.root) windowShift(windows.root, at, n);
+}
+
+void editorWindowRowsDeleted(int at, int n)
+{
+    if (windows.root) windowShift(windows.root, at, -n);
+}